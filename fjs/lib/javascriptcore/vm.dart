@@ -694,8 +694,12 @@ return 0
       };
     }
     if(type == JSHandyType.js_Date) {
-      int timestamp = getInt(value)!;
-      return constructDate ? DateTime.fromMillisecondsSinceEpoch(timestamp) : timestamp;
+      final time = getNumber(value)!;
+      // an invalid date has no timestamp.
+      if(time.isNaN) {
+        return null;
+      }
+      return constructDate ? DateTime.fromMillisecondsSinceEpoch(time.toInt()) : time.toInt();
     }
     if(type == JSHandyType.js_ArrayBuffer || type == JSHandyType.js_SharedArrayBuffer) {
       Pointer<Uint8> buff = runWithExceptionHandle((exception) => jSObjectGetArrayBufferBytesPtr(ctx, value, exception));
@@ -0,0 +1,161 @@
+import 'dart:typed_data';
+
+import '../types.dart';
+import 'codec.dart';
+import 'qjs_ffi.dart';
+import 'vm.dart';
+
+/// The result of an operation of a [QuickJSBatch], an operand of the operations added after it.
+class JSBatchRef {
+  /// Index of the result, in order of the operations that produce one.
+  final int index;
+
+  const JSBatchRef._(this.index);
+}
+
+/// A sequence of property reads and writes, calls and conversions run with a single native call by [run].
+///
+/// Glue code that would otherwise cross into native code for every key, property and handle free, is encoded into
+/// one buffer instead. Operands are one of:
+/// - a [JSValuePointer], borrowed for the run
+/// - a [JSBatchRef] of an earlier operation
+/// - any other Dart value, converted like [QuickJSVm.dartToJS] for the operation only, handles nested in it are
+///   freed after the run
+///
+/// ```dart
+/// final batch = QuickJSBatch(vm);
+/// final headers = batch.get(vm.global, ['request', 'headers']);
+/// batch.set(headers, 'accept', 'text/html');
+/// final length = batch.read(batch.get(headers, 'length'));
+/// final result = batch.run();
+/// print(result.reads[length]);
+/// ```
+class QuickJSBatch {
+  final QuickJSVm vm;
+  late final JSBatchEncoder _encoder = JSBatchEncoder(
+    constructDate: vm.constructDate,
+    toHandle: (value) {
+      final handle = value is Map ? vm.newObject(value) : vm.dartToJS(value);
+      ownedHandles.add(handle);
+      return handle;
+    },
+  );
+  /// Borrowed handles referred by the operations.
+  final List<JSValuePointer> handles = [];
+  final Map<JSValuePointer, int> _handleIndexes = {};
+  /// Handles created while encoding values, released after [run].
+  final List<JSValuePointer> ownedHandles = [];
+  int _resultCount = 0;
+  int _readCount = 0;
+
+  QuickJSBatch(this.vm);
+
+  /// The encoded operations.
+  Uint8List get bytes => _encoder.bytes;
+
+  /// Number of operations that produce a result.
+  int get resultCount => _resultCount;
+
+  /// Number of [read] operations.
+  int get readCount => _readCount;
+
+  /// Convert [value] once, its handle is available to later operations.
+  JSBatchRef value(dynamic value) {
+    _encoder.writeByte(JSBatchOp.value);
+    _encoder.encode(value);
+    return _result();
+  }
+
+  /// `target[path[0]][path[1]]...`, [path] is a key or a List of keys.
+  ///
+  /// Like optional chaining, the result is `undefined` once the path reaches `null` or `undefined`.
+  JSBatchRef get(dynamic target, dynamic path) {
+    final keys = path is List ? path : [path];
+    _encoder.writeByte(JSBatchOp.get);
+    _writeRef(target);
+    _encoder.writeVarUint(keys.length);
+    keys.forEach((key) => _encoder.writeKey(key.toString()));
+    return _result();
+  }
+
+  /// `target[key] = value`.
+  void set(dynamic target, dynamic key, dynamic value) {
+    _encoder.writeByte(JSBatchOp.set);
+    _writeRef(target);
+    _encoder.writeKey(key.toString());
+    _writeRef(value);
+  }
+
+  /// Define a data property [key] of [target].
+  void define(dynamic target, dynamic key, dynamic value, {
+    bool configurable = true,
+    bool enumerable = true,
+    bool writable = true,
+  }) {
+    _encoder.writeByte(JSBatchOp.define);
+    _writeRef(target);
+    _encoder.writeKey(key.toString());
+    _writeRef(value);
+    _encoder.writeByte((configurable ? JS_PROP_CONFIGURABLE : 0) | (writable ? JS_PROP_WRITABLE : 0) | (enumerable ? JS_PROP_ENUMERABLE : 0));
+  }
+
+  /// `func.call(thisVal, ...args)`.
+  JSBatchRef call(dynamic func, [dynamic thisVal, List? args]) {
+    _encoder.writeByte(JSBatchOp.call);
+    _writeRef(func);
+    _writeRef(thisVal ?? vm.$undefined);
+    _encoder.writeVarUint(args?.length ?? 0);
+    args?.forEach(_writeRef);
+    return _result();
+  }
+
+  /// Release the result of an earlier operation once it is no longer needed by this batch.
+  void free(JSBatchRef ref) {
+    _encoder.writeByte(JSBatchOp.free);
+    _encoder.writeResultRef(ref.index);
+  }
+
+  /// Convert [value] to Dart, like [QuickJSVm.jsToDart]. Returns its index in [QuickJSBatchResult.reads].
+  int read(dynamic value) {
+    _encoder.writeByte(JSBatchOp.read);
+    _writeRef(value);
+    return _readCount++;
+  }
+
+  /// Hand [handle] over to this batch, it is freed after the run.
+  JSValuePointer own(JSValuePointer handle) {
+    ownedHandles.add(handle);
+    return handle;
+  }
+
+  /// Run the operations, see [QuickJSVm.execBatch].
+  QuickJSBatchResult run() => vm.execBatch(this);
+
+  JSBatchRef _result() => JSBatchRef._(_resultCount++);
+
+  void _writeRef(dynamic operand) {
+    if(operand is JSBatchRef) {
+      _encoder.writeResultRef(operand.index);
+    } else if(operand is JSValuePointer) {
+      final index = _handleIndexes.putIfAbsent(operand, () {
+        handles.add(operand);
+        return handles.length - 1;
+      });
+      _encoder.writeHandleRef(index);
+    } else {
+      _encoder.writeValueRef(operand);
+    }
+  }
+}
+
+class QuickJSBatchResult {
+  /// Handle of each result, `undefined` for results freed by the batch.
+  final List<JSValuePointer> handles;
+  /// Values converted by [QuickJSBatch.read], in order.
+  final List<dynamic> reads;
+
+  QuickJSBatchResult(this.handles, this.reads);
+
+  /// Handle of the result of [ref], owned by the vm like the handles returned by its methods.
+  JSValuePointer operator [](JSBatchRef ref) => handles[ref.index];
+}
@@ -0,0 +1,108 @@
+import 'dart:collection';
+import 'dart:io';
+import 'dart:typed_data';
+
+/// Bytecode compiled by QuickJS, keyed by a hash of the source it was compiled from.
+///
+/// Used by [QuickJSVm.evalCode] and the ES6 module loader to skip parsing and compiling sources that were seen
+/// before. Entries are kept in memory, and in [directory] when it is given so they survive restarts.
+/// A cache can be shared by any number of vms.
+class BytecodeCache {
+  /// Where entries are persisted, `null` for a memory only cache.
+  final Directory? directory;
+  /// Max number of entries kept in memory, the least recently used entry is dropped first.
+  final int maxEntries;
+  final LinkedHashMap<String, Uint8List> _entries = LinkedHashMap();
+
+  BytecodeCache({this.directory, this.maxEntries = 256}) {
+    directory?.createSync(recursive: true);
+  }
+
+  /// Number of entries kept in memory.
+  int get length => _entries.length;
+
+  /// Cache key of [source] compiled as [filename] with [evalFlags] by QuickJS [version].
+  static String keyOf(String version, String filename, int evalFlags, String source) {
+    // 64 bit FNV-1a
+    int hash = -3750763034362895579;
+    void add(String value) {
+      for (int i = 0; i < value.length; i++) {
+        hash ^= value.codeUnitAt(i);
+        hash *= 0x100000001b3;
+      }
+      // separator, U+FFFF is a noncharacter.
+      hash ^= 0xffff;
+      hash *= 0x100000001b3;
+    }
+    add(version);
+    add(filename);
+    add(evalFlags.toString());
+    add(source);
+    return '${hash.toUnsigned(64).toRadixString(16).padLeft(16, '0')}-${source.length.toRadixString(16)}';
+  }
+
+  Uint8List? get(String key) {
+    final bytecode = _entries.remove(key);
+    if (bytecode != null) {
+      _entries[key] = bytecode;
+      return bytecode;
+    }
+    final file = _fileOf(key);
+    if (file == null) {
+      return null;
+    }
+    try {
+      if (!file.existsSync()) {
+        return null;
+      }
+      final bytecode = file.readAsBytesSync();
+      _remember(key, bytecode);
+      return bytecode;
+    } on FileSystemException {
+      return null;
+    }
+  }
+
+  void put(String key, Uint8List bytecode) {
+    _remember(key, bytecode);
+    final file = _fileOf(key);
+    if (file == null) {
+      return;
+    }
+    try {
+      // write then rename, so that a concurrent reader never sees a partial entry.
+      final temp = File('${file.path}.$pid.tmp');
+      temp.writeAsBytesSync(bytecode, flush: true);
+      temp.renameSync(file.path);
+    } on FileSystemException {
+      // the disk cache is best effort.
+    }
+  }
+
+  /// Drop all entries, including those in [directory].
+  void clear() {
+    _entries.clear();
+    final dir = directory;
+    if (dir == null || !dir.existsSync()) {
+      return;
+    }
+    for (final entity in dir.listSync()) {
+      if (entity is File && entity.path.endsWith('.qjsc')) {
+        entity.deleteSync();
+      }
+    }
+  }
+
+  void _remember(String key, Uint8List bytecode) {
+    _entries.remove(key);
+    _entries[key] = bytecode;
+    while (_entries.length > maxEntries) {
+      _entries.remove(_entries.keys.first);
+    }
+  }
+
+  File? _fileOf(String key) {
+    final dir = directory;
+    return dir == null ? null : File('${dir.path}${Platform.pathSeparator}$key.qjsc');
+  }
+}
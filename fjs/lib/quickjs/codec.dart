@@ -0,0 +1,346 @@
+import 'dart:convert';
+import 'dart:ffi';
+import 'dart:typed_data';
+
+import 'external_buffer.dart';
+import 'qjs_ffi.dart';
+
+/// Value tags of the buffer written by `QJS_Serialize`, keep in sync with `interface.cpp`.
+abstract class JSSerializeTag {
+  static const int undefined = 0;
+  static const int null_ = 1;
+  static const int false_ = 2;
+  static const int true_ = 3;
+  static const int int32 = 4;
+  static const int float64 = 5;
+  static const int string = 6;
+  static const int array = 7;
+  static const int object = 8;
+  static const int date = 9;
+  static const int bytes = 10;
+  /// A `JSValue*` owned by the reader, for values that need to be converted by the vm.
+  static const int handle = 11;
+}
+
+/// Emit plain objects as handles instead of maps.
+const int JS_SERIALIZE_OBJECT_AS_HANDLE = 1 << 0;
+
+/// Write the value as `JSON.stringify` sees it: `toJSON()` is applied, functions and `undefined` properties are left
+/// out and cycles throw. No handles, dates or bytes are written.
+const int JS_SERIALIZE_JSON = 1 << 1;
+
+/// With [JS_SERIALIZE_JSON], also write the `name`, `message` and `stack` of a top level object when they are not
+/// enumerable own properties, as for errors.
+const int JS_SERIALIZE_DUMP = 1 << 2;
+
+/// Convert a [handle] found in a serialized buffer. The handle is freed by the caller afterwards.
+typedef JSHandleResolver = dynamic Function(JSValuePointer handle);
+
+/// Convert a Dart [value] the encoder can not write itself. The returned handle is borrowed by `QJS_BuildValue`.
+typedef JSHandleProvider = JSValuePointer Function(dynamic value);
+
+/// Decodes a buffer written by `QJS_Serialize` in one pass.
+class JSValueDecoder {
+  static const _utf8 = Utf8Decoder(allowMalformed: true);
+
+  final Uint8List _bytes;
+  final ByteData _data;
+  int _offset = 0;
+  /// Object keys in order of first appearance, later occurrences refer to them by index.
+  final List<String> _keys = [];
+
+  /// Value used for JS `undefined`.
+  final dynamic undefinedValue;
+  /// Whether to construct `DateTime` for JS Date values.
+  final bool constructDate;
+  /// Whether to decode integral numbers as `int`, like [jsonDecode] does with the output of `JSON.stringify`.
+  final bool jsonNumbers;
+  final JSHandleResolver resolveHandle;
+
+  JSValueDecoder(this._bytes, {
+    required this.resolveHandle,
+    this.undefinedValue,
+    this.constructDate = true,
+    this.jsonNumbers = false,
+  }) : _data = ByteData.sublistView(_bytes);
+
+  dynamic decode() {
+    final tag = _bytes[_offset++];
+    switch (tag) {
+      case JSSerializeTag.undefined:
+        return undefinedValue;
+      case JSSerializeTag.null_:
+        return null;
+      case JSSerializeTag.false_:
+        return false;
+      case JSSerializeTag.true_:
+        return true;
+      case JSSerializeTag.int32:
+        final value = _data.getInt32(_offset, Endian.little);
+        _offset += 4;
+        return value;
+      case JSSerializeTag.float64:
+        final value = _readFloat64();
+        // JSON.stringify writes the integral numbers below 1e21 without fraction or exponent.
+        if (jsonNumbers && value.isFinite && value == value.truncateToDouble() && value.abs() < 9.2e18) {
+          return value.toInt();
+        }
+        return value;
+      case JSSerializeTag.string:
+        return _readString(_readVarUint());
+      case JSSerializeTag.array:
+        final length = _readUint32();
+        return List<dynamic>.generate(length, (_) => decode());
+      case JSSerializeTag.object:
+        final count = _readUint32();
+        final Map<String, dynamic> result = {};
+        for (int i = 0; i < count; i++) {
+          final key = _readKey();
+          result[key] = decode();
+        }
+        return result;
+      case JSSerializeTag.date:
+        final time = _readFloat64();
+        // an invalid date has no timestamp, like in QuickJSVm.jsToDart.
+        if (time.isNaN) {
+          return null;
+        }
+        return constructDate ? DateTime.fromMillisecondsSinceEpoch(time.toInt()) : time.toInt();
+      case JSSerializeTag.bytes:
+        final length = _readVarUint();
+        final result = Uint8List.fromList(Uint8List.sublistView(_bytes, _offset, _offset + length));
+        _offset += length;
+        return result;
+      case JSSerializeTag.handle:
+        final handle = Pointer<JSValueOpaque>.fromAddress(_data.getUint64(_offset, Endian.little));
+        _offset += 8;
+        return resolveHandle(handle);
+      default:
+        throw StateError('Unknown serialize tag $tag at ${_offset - 1}');
+    }
+  }
+
+  int _readUint32() {
+    final value = _data.getUint32(_offset, Endian.little);
+    _offset += 4;
+    return value;
+  }
+
+  double _readFloat64() {
+    final value = _data.getFloat64(_offset, Endian.little);
+    _offset += 8;
+    return value;
+  }
+
+  int _readVarUint() {
+    int result = 0;
+    int shift = 0;
+    while (true) {
+      final byte = _bytes[_offset++];
+      result |= (byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        return result;
+      }
+      shift += 7;
+    }
+  }
+
+  String _readString(int length) {
+    final result = _utf8.convert(_bytes, _offset, _offset + length);
+    _offset += length;
+    return result;
+  }
+
+  String _readKey() {
+    final k = _readVarUint();
+    if (k & 1 == 1) {
+      return _keys[k >> 1];
+    }
+    final key = _readString(k >> 1);
+    _keys.add(key);
+    return key;
+  }
+}
+
+/// Encodes Dart values into the `QJS_Serialize` format, to be built in one call by `QJS_BuildValue`.
+///
+/// Follows the conversion rules of `QuickJSVm.dartToJS`, values without an encoding are passed to [toHandle].
+class JSValueEncoder {
+  static const _int32Min = -0x80000000;
+  static const _int32Max = 0x7fffffff;
+
+  Uint8List _bytes = Uint8List(256);
+  late ByteData _data = ByteData.sublistView(_bytes);
+  int _length = 0;
+  /// Object keys already written, mapped to their index in the key table.
+  final Map<String, int> _keys = {};
+
+  /// Whether to write `DateTime` as JS Date values, otherwise as milliseconds since epoch.
+  final bool constructDate;
+  final JSHandleProvider toHandle;
+
+  JSValueEncoder({
+    required this.toHandle,
+    this.constructDate = true,
+  });
+
+  /// The encoded bytes, a view on the internal buffer.
+  Uint8List get bytes => Uint8List.sublistView(_bytes, 0, _length);
+
+  void encode(dynamic value) {
+    if(value == null) {
+      _writeByte(JSSerializeTag.null_);
+    } else if(value == DART_UNDEFINED) {
+      _writeByte(JSSerializeTag.undefined);
+    } else if(value == true) {
+      _writeByte(JSSerializeTag.true_);
+    } else if(value == false) {
+      _writeByte(JSSerializeTag.false_);
+    } else if(value is String) {
+      _writeByte(JSSerializeTag.string);
+      _writeUtf8(value);
+    } else if(value is int && value >= _int32Min && value <= _int32Max) {
+      _writeByte(JSSerializeTag.int32);
+      _reserve(4);
+      _data.setInt32(_length, value, Endian.little);
+      _length += 4;
+    } else if(value is num) {
+      _writeByte(JSSerializeTag.float64);
+      _writeFloat64(value.toDouble());
+    } else if(value is DateTime) {
+      _writeByte(constructDate ? JSSerializeTag.date : JSSerializeTag.float64);
+      _writeFloat64(value.millisecondsSinceEpoch.toDouble());
+    } else if(value is TypedData && value is! Uint8List && ExternalBuffer.typeOf(value) != null) {
+      // a typed array, like `QuickJSVm.dartToJS` makes for a top level value.
+      _writeHandle(toHandle(value));
+    } else if(value is TypedData && value is List<int>) {
+      final list = value.buffer.asUint8List(value.offsetInBytes, value.lengthInBytes);
+      _writeByte(JSSerializeTag.bytes);
+      _writeVarUint(list.length);
+      _writeBytes(list);
+    } else if(value is List) {
+      _writeByte(JSSerializeTag.array);
+      _writeUint32(value.length);
+      for(final element in value) {
+        encode(element);
+      }
+    } else if(value is Map && value.keys.every((key) => key is String || key is int)) {
+      _writeByte(JSSerializeTag.object);
+      _writeUint32(value.length);
+      value.forEach((key, element) {
+        _writeKey(key.toString());
+        encode(element);
+      });
+    } else {
+      // JSValuePointer, functions, futures, errors and values that fall back to JSON.
+      _writeHandle(toHandle(value));
+    }
+  }
+
+  void _writeHandle(Pointer handle) {
+    _writeByte(JSSerializeTag.handle);
+    _reserve(8);
+    _data.setUint64(_length, handle.address, Endian.little);
+    _length += 8;
+  }
+
+  void _reserve(int extra) {
+    if(_length + extra <= _bytes.length) {
+      return;
+    }
+    int capacity = _bytes.length;
+    while(capacity < _length + extra) {
+      capacity += capacity >> 1;
+    }
+    final bytes = Uint8List(capacity);
+    bytes.setRange(0, _length, _bytes);
+    _bytes = bytes;
+    _data = ByteData.sublistView(bytes);
+  }
+
+  void _writeByte(int value) {
+    _reserve(1);
+    _bytes[_length++] = value;
+  }
+
+  void _writeBytes(List<int> value) {
+    _reserve(value.length);
+    _bytes.setRange(_length, _length + value.length, value);
+    _length += value.length;
+  }
+
+  void _writeUint32(int value) {
+    _reserve(4);
+    _data.setUint32(_length, value, Endian.little);
+    _length += 4;
+  }
+
+  void _writeFloat64(double value) {
+    _reserve(8);
+    _data.setFloat64(_length, value, Endian.little);
+    _length += 8;
+  }
+
+  void _writeVarUint(int value) {
+    while(value >= 0x80) {
+      _writeByte((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+    _writeByte(value);
+  }
+
+  void _writeUtf8(String value) {
+    final bytes = utf8.encode(value);
+    _writeVarUint(bytes.length);
+    _writeBytes(bytes);
+  }
+
+  void _writeKey(String key) {
+    final index = _keys[key];
+    if(index != null) {
+      _writeVarUint((index << 1) | 1);
+      return;
+    }
+    _keys[key] = _keys.length;
+    final bytes = utf8.encode(key);
+    _writeVarUint(bytes.length << 1);
+    _writeBytes(bytes);
+  }
+}
+
+/// Operation codes of the buffer run by `QJS_ExecBatch`, keep in sync with `interface.cpp`.
+abstract class JSBatchOp {
+  static const int value = 0;
+  static const int get = 1;
+  static const int set = 2;
+  static const int define = 3;
+  static const int call = 4;
+  static const int free = 5;
+  static const int read = 6;
+}
+
+/// Encodes operations for `QJS_ExecBatch`, the values and keys of all operations share one key table.
+class JSBatchEncoder extends JSValueEncoder {
+  JSBatchEncoder({
+    required JSHandleProvider toHandle,
+    bool constructDate = true,
+  }) : super(toHandle: toHandle, constructDate: constructDate);
+
+  void writeByte(int value) => _writeByte(value);
+
+  void writeVarUint(int value) => _writeVarUint(value);
+
+  void writeKey(String key) => _writeKey(key);
+
+  /// Refer to the borrowed handle at [index] of the handles passed along.
+  void writeHandleRef(int index) => _writeVarUint(index << 2);
+
+  /// Refer to the result of an earlier operation.
+  void writeResultRef(int index) => _writeVarUint((index << 2) | 1);
+
+  /// Pass [value] inline, it is built for the operation and released afterwards.
+  void writeValueRef(dynamic value) {
+    _writeByte(2);
+    encode(value);
+  }
+}
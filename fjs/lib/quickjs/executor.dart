@@ -0,0 +1,226 @@
+import 'dart:async';
+import 'dart:io';
+import 'dart:isolate';
+
+import '../error.dart';
+import 'vm.dart';
+
+/// Runs scripts on a pool of isolates, each one with its own [QuickJSVm]s, so independent workloads run in parallel
+/// instead of sharing the calling isolate.
+///
+/// Scripts and results are passed as messages, so results are limited to what [QuickJSVm.jsToDart] converts to sendable
+/// values: `null`, bools, numbers, strings, [DateTime]s, bytes and Lists/Maps of them. A result that is a promise is
+/// awaited in the worker. Each script gets a vm reset to the state left by [setup], see [QuickJSVmPool].
+///
+/// [setup] runs in each worker isolate, so it must be a top level or static function.
+class QuickJSExecutor {
+  final List<_Worker> _workers;
+  bool _closed = false;
+
+  QuickJSExecutor._(this._workers);
+
+  /// Spawn [concurrency] worker isolates, one per processor by default.
+  static Future<QuickJSExecutor> spawn({
+    int? concurrency,
+    QuickJSVmPreload? setup,
+    int? memoryLimit,
+  }) async {
+    final count = concurrency ?? Platform.numberOfProcessors;
+    if (count < 1) {
+      throw ArgumentError.value(concurrency, 'concurrency', 'must be positive');
+    }
+    final spawning = List.generate(count, (_) => _Worker.spawn(_WorkerConfig(setup, memoryLimit)));
+    try {
+      return QuickJSExecutor._(await Future.wait(spawning));
+    } catch (_) {
+      // shut down the workers which did start.
+      await Future.wait(spawning.map((_) => _.then((worker) => worker.close(), onError: (_) {})));
+      rethrow;
+    }
+  }
+
+  /// Number of worker isolates.
+  int get concurrency => _workers.length;
+
+  /// Evaluate [code] on the least busy worker and complete with the value it evaluates to.
+  ///
+  /// Completes with a [JSError] when the script throws, its result can not be sent back or its worker dies.
+  Future<dynamic> evalCode(String code, {String? filename}) {
+    if (_closed) {
+      throw StateError('QuickJSExecutor closed');
+    }
+    _Worker? worker;
+    for (final it in _workers) {
+      if (it.alive && (worker == null || it.pending.length < worker.pending.length)) {
+        worker = it;
+      }
+    }
+    if (worker == null) {
+      return Future.error(JSError('Every worker of the QuickJSExecutor died'));
+    }
+    return worker.submit(code, filename);
+  }
+
+  /// Wait for the submitted scripts, then shut the workers down.
+  Future<void> close() async {
+    if (_closed) {
+      return;
+    }
+    _closed = true;
+    await Future.wait(_workers.map((_) => _.close()));
+  }
+}
+
+class _WorkerConfig {
+  final QuickJSVmPreload? setup;
+  final int? memoryLimit;
+  SendPort? replyTo;
+
+  _WorkerConfig(this.setup, this.memoryLimit);
+}
+
+/// Messages received from a worker isolate:
+/// - its request [SendPort] once it is ready,
+/// - `[id, result]` or `[id, null, error, stack]` for a request,
+/// - `[error, stack]` when its setup fails or an error is uncaught, the isolate then exits,
+/// - `null` when it exits.
+class _Worker {
+  final ReceivePort _port = ReceivePort();
+  final Completer<SendPort> _ready = Completer();
+  final Completer<void> _exited = Completer();
+  late final Isolate isolate;
+  late final SendPort _requests;
+  final Map<int, Completer> pending = {};
+  JSError? _error;
+  int _nextId = 0;
+
+  _Worker() {
+    _port.listen(_onMessage);
+  }
+
+  /// Whether the isolate is still running, requests submitted after its death fail right away.
+  bool get alive => _error == null;
+
+  static Future<_Worker> spawn(_WorkerConfig config) async {
+    final worker = _Worker();
+    config.replyTo = worker._port.sendPort;
+    try {
+      worker.isolate = await Isolate.spawn(_workerMain, config,
+          onError: worker._port.sendPort, onExit: worker._port.sendPort);
+      worker._requests = await worker._ready.future;
+    } catch (_) {
+      worker._port.close();
+      rethrow;
+    }
+    return worker;
+  }
+
+  void _onMessage(message) {
+    if (message is SendPort) {
+      _ready.complete(message);
+      return;
+    }
+    if (message == null) {
+      _die(JSError('Worker isolate exited'));
+      _port.close();
+      _exited.complete();
+      return;
+    }
+    final List response = message;
+    if (response[0] is! int) {
+      _die(JSError(response[0], StackTrace.fromString(response[1] ?? '')));
+      return;
+    }
+    final completer = pending.remove(response[0])!;
+    if (response.length > 2) {
+      completer.completeError(JSError(response[2], StackTrace.fromString(response[3])));
+    } else {
+      completer.complete(response[1]);
+    }
+  }
+
+  /// Fail the spawn or every pending request with [error], the first error is kept.
+  void _die(JSError error) {
+    final reason = _error ??= error;
+    if (!_ready.isCompleted) {
+      _ready.completeError(reason);
+    }
+    final completers = List.of(pending.values);
+    pending.clear();
+    completers.forEach((_) => _.completeError(reason));
+  }
+
+  Future submit(String code, String? filename) {
+    if (_error != null) {
+      return Future.error(_error!);
+    }
+    final id = _nextId++;
+    final completer = Completer();
+    pending[id] = completer;
+    _requests.send([id, code, filename]);
+    return completer.future;
+  }
+
+  Future<void> close() async {
+    await Future.wait(pending.values.map((_) => _.future.catchError((_) {})));
+    if (!_exited.isCompleted) {
+      _requests.send(null);
+    }
+    await _exited.future;
+  }
+}
+
+void _workerMain(_WorkerConfig config) async {
+  final replyTo = config.replyTo!;
+  final QuickJSVmPool pool;
+  try {
+    pool = QuickJSVmPool(
+      size: 1,
+      memoryLimit: config.memoryLimit,
+      preload: config.setup,
+      // results are sent to another isolate, they must not point to memory of the vm.
+      create: () => QuickJSVm(arrayBufferCopy: true),
+    );
+  } catch (e, s) {
+    final error = JSError.wrap(e, s);
+    replyTo.send([error.message, error.stackTrace.toString()]);
+    return;
+  }
+  final requests = ReceivePort();
+  replyTo.send(requests.sendPort);
+  await for (final message in requests) {
+    if (message == null) {
+      break;
+    }
+    final List request = message;
+    // not awaited, scripts waiting on promises do not block the worker.
+    _workerRun(pool, replyTo, request[0], request[1], request[2]);
+  }
+  requests.close();
+  pool.dispose();
+}
+
+Future<void> _workerRun(QuickJSVmPool pool, SendPort replyTo, int id, String code, String? filename) async {
+  try {
+    final result = await pool.use((vm) async {
+      final value = vm.jsToDart(vm.evalCode(code, filename: filename));
+      if (value is! Future) {
+        return value;
+      }
+      vm.startEventLoop();
+      try {
+        return await value;
+      } finally {
+        vm.stopEventLoop();
+      }
+    });
+    try {
+      replyTo.send([id, result]);
+    } catch (e, s) {
+      replyTo.send([id, null, 'Result of type ${result.runtimeType} can not be sent: $e', s.toString()]);
+    }
+  } catch (e, s) {
+    final error = JSError.wrap(e, s);
+    replyTo.send([id, null, error.message, error.stackTrace.toString()]);
+  }
+}
@@ -0,0 +1,109 @@
+import 'dart:ffi';
+import 'dart:typed_data';
+
+import 'qjs_ffi.dart';
+
+/// Reference counted native memory shared by Dart and the ArrayBuffers of QuickJS.
+///
+/// Every ArrayBuffer of a [QuickJSVm] is backed by an external buffer: [QuickJSVm.jsToDart] returns a view of
+/// it instead of a copy, and passing [bytes] back to [QuickJSVm.dartToJS] creates an ArrayBuffer over the same
+/// memory. Each side holds its own reference, so the memory stays valid until both the JS value and the Dart
+/// view are gone, whichever goes first.
+class ExternalBuffer implements Finalizable {
+  static final _finalizer = NativeFinalizer(JS_ExternalBufferReleasePointer);
+  // keeps each buffer reachable as long as its view is.
+  static final _owners = Expando<ExternalBuffer>();
+
+  /// Start of the native memory.
+  final Pointer<Uint8> address;
+  /// Size of the native memory in bytes.
+  final int length;
+  /// A view of the native memory, which keeps this buffer alive.
+  late final Uint8List bytes = _view();
+
+  ExternalBuffer._(this.address, this.length) {
+    _finalizer.attach(this, address.cast(), externalSize: length);
+  }
+
+  /// Allocate a buffer of [length] bytes, its content is not initialized.
+  factory ExternalBuffer(int length) {
+    final address = JS_NewExternalBuffer(length);
+    if (address == nullptr) {
+      throw OutOfMemoryError();
+    }
+    return ExternalBuffer._(address, length);
+  }
+
+  /// Take over a reference of the external buffer at [address], e.g. from [JS_RetainArrayBuffer].
+  factory ExternalBuffer.adopt(Pointer<Uint8> address, int length) => ExternalBuffer._(address, length);
+
+  /// The buffer [view] is the [bytes] or a [typedView] of, `null` if it is not.
+  static ExternalBuffer? of(TypedData view) => _owners[view];
+
+  /// A view of [length] elements of [JSTypedArrayType] [type] from [offsetInBytes], which keeps this buffer alive.
+  TypedData typedView(int type, int offsetInBytes, int length) {
+    final buffer = bytes.buffer;
+    final TypedData view;
+    switch (type) {
+      case JSTypedArrayType.uint8Clamped:
+        view = buffer.asUint8ClampedList(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.int8:
+        view = buffer.asInt8List(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.uint8:
+        view = buffer.asUint8List(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.int16:
+        view = buffer.asInt16List(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.uint16:
+        view = buffer.asUint16List(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.int32:
+        view = buffer.asInt32List(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.uint32:
+        view = buffer.asUint32List(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.bigInt64:
+        view = buffer.asInt64List(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.bigUint64:
+        view = buffer.asUint64List(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.float32:
+        view = buffer.asFloat32List(offsetInBytes, length);
+        break;
+      case JSTypedArrayType.float64:
+        view = buffer.asFloat64List(offsetInBytes, length);
+        break;
+      default:
+        throw ArgumentError.value(type, 'type', 'unknown typed array type');
+    }
+    _owners[view] = this;
+    return view;
+  }
+
+  /// The [JSTypedArrayType] of [view], `null` for views without a matching typed array, e.g. [ByteData].
+  static int? typeOf(TypedData view) {
+    if (view is Uint8ClampedList) return JSTypedArrayType.uint8Clamped;
+    if (view is Int8List) return JSTypedArrayType.int8;
+    if (view is Uint8List) return JSTypedArrayType.uint8;
+    if (view is Int16List) return JSTypedArrayType.int16;
+    if (view is Uint16List) return JSTypedArrayType.uint16;
+    if (view is Int32List) return JSTypedArrayType.int32;
+    if (view is Uint32List) return JSTypedArrayType.uint32;
+    if (view is Int64List) return JSTypedArrayType.bigInt64;
+    if (view is Uint64List) return JSTypedArrayType.bigUint64;
+    if (view is Float32List) return JSTypedArrayType.float32;
+    if (view is Float64List) return JSTypedArrayType.float64;
+    return null;
+  }
+
+  Uint8List _view() {
+    final view = address.asTypedList(length);
+    _owners[view] = this;
+    return view;
+  }
+}
@@ -48,8 +48,8 @@ typedef JSAtom = Uint32;
  */
 typedef JSRuntimePointer = Pointer<JSRuntimeOpaque>;
 
-typedef C_To_HostCallbackFunc = JSValuePointer? Function(JSContextPointer ctx, JSValuePointer this_ptr, Uint32 argc, JSValuePointer argv,
-    JSValuePointer fn_data_ptr);
+typedef C_To_HostCallbackFunc = JSValuePointer? Function(JSContextPointer ctx, Int32 host_id, Int32 fn_id,
+    Int32 fn_generation, JSValuePointer this_ptr, Uint32 argc, JSValuePointer argv);
 
 /**
  * Used internally for C-to-Javascript function calls.
@@ -62,7 +62,7 @@ typedef QJS_C_To_HostCallbackFuncPointer = Pointer<
  */
 typedef QJS_C_To_HostInterruptFuncPointer = Pointer<
     NativeFunction<
-        Uint32 Function(JSRuntimePointer)> /*'C_To_HostInterruptFunc'*/ >;
+        Uint32 Function(JSRuntimePointer, Int32)> /*'C_To_HostInterruptFunc'*/ >;
 
 /// void JSFreeArrayBufferDataFunc(JSRuntime *rt, void *opaque, void *ptr)
 typedef JSFreeArrayBufferDataFunc = Void Function(JSRuntimePointer rt, Pointer opaque, Pointer<Uint8> ptr);
@@ -105,22 +105,38 @@ final hello_world = dylib.lookupFunction<
     HeapCharPointer Function(),
     HeapCharPointer Function()>("hello_world");
 
+/// Set the dispatcher of host function calls made by [rt].
+///
+/// The callback is bound to the isolate that created it, so it is set per runtime.
+///
+/// void QJS_SetHostCallback(JSRuntime *rt, QJS_C_To_HostCallbackFunc* fp)
 final JS_SetHostCallback = dylib.lookupFunction<
-    Void Function(QJS_C_To_HostCallbackFuncPointer),
-    void Function(
+    Void Function(JSRuntimePointer, QJS_C_To_HostCallbackFuncPointer),
+    void Function(JSRuntimePointer rt,
         QJS_C_To_HostCallbackFuncPointer fp)>("QJS_SetHostCallback");
 
+/// Set the id passed back to the host callbacks of [rt].
+///
+/// void QJS_SetHostId(JSRuntime *rt, int32_t host_id)
+final JS_SetHostId = dylib.lookupFunction<
+    Void Function(JSRuntimePointer, Int32),
+    void Function(JSRuntimePointer rt, int host_id)>("QJS_SetHostId");
+
 final JS_ArgvGetJSValueConstPointer = dylib.lookupFunction<
     JSValueConstPointer Function(Pointer, Uint32),
     JSValueConstPointer Function(
         JSValuePointer/* | JSValueConstPointer*/ argv,
         int index)>("QJS_ArgvGetJSValueConstPointer");
 
+/// Create a function which calls the host callback with [fn_id] and [fn_generation].
+///
+/// JSValue *QJS_NewFunction(JSContext *ctx, int32_t fn_id, int32_t fn_generation, const char* name)
 final JS_NewFunction = dylib.lookupFunction<
-    JSValuePointer Function(JSContextPointer, Pointer, HeapCharPointer),
+    JSValuePointer Function(JSContextPointer, Int32, Int32, HeapCharPointer),
     JSValuePointer Function(
         JSContextPointer ctx,
-        JSValuePointer/* | JSValueConstPointer*/ func_data,
+        int fn_id,
+        int fn_generation,
         HeapCharPointer)>("QJS_NewFunction");
 
 final JS_Throw = dylib.lookupFunction<
@@ -133,9 +149,10 @@ final JS_NewError = dylib.lookupFunction<
     JSValuePointer Function(JSContextPointer),
     JSValuePointer Function(JSContextPointer ctx)>("QJS_NewError");
 
+/// void QJS_SetInterruptCallback(JSRuntime *rt, QJS_C_To_HostInterruptFunc *cb)
 final JS_SetInterruptCallback = dylib.lookupFunction<
-    Void Function(QJS_C_To_HostInterruptFuncPointer),
-    void Function(
+    Void Function(JSRuntimePointer, QJS_C_To_HostInterruptFuncPointer),
+    void Function(JSRuntimePointer rt,
         QJS_C_To_HostInterruptFuncPointer cb)>("QJS_SetInterruptCallback");
 
 final JS_RuntimeEnableInterruptHandler = dylib.lookupFunction<
@@ -147,6 +164,38 @@ final JS_RuntimeDisableInterruptHandler = dylib.lookupFunction<
     void Function(
         JSRuntimePointer rt)>("QJS_RuntimeDisableInterruptHandler");
 
+/// Current time of the clock used by [JS_RuntimeSetDeadline], in nanoseconds.
+///
+/// int64_t QJS_GetMonotonicTime()
+final JS_GetMonotonicTime = dylib.lookupFunction<
+    Int64 Function(),
+    int Function()>("QJS_GetMonotonicTime");
+
+/// Interrupt execution once [JS_GetMonotonicTime] reaches [deadline_ns], checked natively without calling the host.
+///
+/// Set to `0` to remove the deadline.
+///
+/// void QJS_RuntimeSetDeadline(JSRuntime *rt, int64_t deadline_ns)
+final JS_RuntimeSetDeadline = dylib.lookupFunction<
+    Void Function(JSRuntimePointer, Int64),
+    void Function(JSRuntimePointer rt, int deadline_ns)>("QJS_RuntimeSetDeadline");
+
+/// Interrupt execution after about [ops] more ops, checked natively without calling the host.
+///
+/// Set to `-1` to remove the budget.
+///
+/// void QJS_RuntimeSetOpBudget(JSRuntime *rt, int64_t ops)
+final JS_RuntimeSetOpBudget = dylib.lookupFunction<
+    Void Function(JSRuntimePointer, Int64),
+    void Function(JSRuntimePointer rt, int ops)>("QJS_RuntimeSetOpBudget");
+
+/// Why execution was last interrupted, the index of an [InterruptReason]. Reading it clears it.
+///
+/// int32_t QJS_RuntimeTakeInterruptReason(JSRuntime *rt)
+final JS_RuntimeTakeInterruptReason = dylib.lookupFunction<
+    Int32 Function(JSRuntimePointer),
+    int Function(JSRuntimePointer rt)>("QJS_RuntimeTakeInterruptReason");
+
 /// Max stack size. Set to 0 to no limit.
 ///
 /// void QJS_RuntimeSetMaxStackSize(JSRuntime *rt, size_t stack_size)
@@ -163,6 +212,45 @@ final JS_RuntimeSetMemoryLimit = dylib.lookupFunction<
     void Function(
         JSRuntimePointer rt, int limit)>("QJS_RuntimeSetMemoryLimit");
 
+/// Run an automatic collection once the heap reaches [threshold] bytes, -1 to disable them. After each one, the
+/// threshold is set [growth_percent] % above the heap size.
+///
+/// void QJS_RuntimeSetGCThreshold(JSRuntime *rt, size_t threshold, int32_t growth_percent)
+final JS_RuntimeSetGCThreshold = dylib.lookupFunction<
+    Void Function(JSRuntimePointer, IntPtr, Int32),
+    void Function(JSRuntimePointer rt, int threshold, int growth_percent)>("QJS_RuntimeSetGCThreshold");
+
+/// Kinds of collection run by [JS_RuntimeRunGC].
+abstract class JSGCKind {
+  static const full = 0;
+  static const minor = 1;
+  /// full collection, only if something was allocated since the last one.
+  static const idle = 2;
+}
+
+/// Run a collection of [kind], one of [JSGCKind]. Returns 1 if it ran.
+///
+/// int32_t QJS_RuntimeRunGC(JSRuntime *rt, int32_t kind)
+final JS_RuntimeRunGC = dylib.lookupFunction<
+    Int32 Function(JSRuntimePointer, Int32),
+    int Function(JSRuntimePointer rt, int kind)>("QJS_RuntimeRunGC");
+
+/// Collector mode, the index of a [GCMode]. In generational mode, a minor collection runs every [young_threshold]
+/// GC objects allocated.
+///
+/// void QJS_RuntimeSetGCMode(JSRuntime *rt, int32_t mode, int32_t young_threshold)
+final JS_RuntimeSetGCMode = dylib.lookupFunction<
+    Void Function(JSRuntimePointer, Int32, Int32),
+    void Function(JSRuntimePointer rt, int mode, int young_threshold)>("QJS_RuntimeSetGCMode");
+
+/// Write the 8 fields of the collector stats to [out]: minor count, minor time, full count, full time, max pause,
+/// last pause, bytes freed and bytes freed by the last collection, times in microseconds.
+///
+/// void QJS_RuntimeGetGCStats(JSRuntime *rt, int64_t *out)
+final JS_RuntimeGetGCStats = dylib.lookupFunction<
+    Void Function(JSRuntimePointer, Pointer<Int64>),
+    void Function(JSRuntimePointer rt, Pointer<Int64> out)>("QJS_RuntimeGetGCStats");
+
 final JS_RuntimeComputeMemoryUsage = dylib.lookupFunction<
     JSValuePointer Function(JSRuntimePointer, JSContextPointer),
     JSValuePointer Function(JSRuntimePointer rt,
@@ -194,6 +282,22 @@ final JS_NewBool = dylib.lookupFunction<
 final JS_NewRuntime = dylib.lookupFunction<JSRuntimePointer Function(),
     JSRuntimePointer Function()>("QJS_NewRuntime");
 
+/// Create a runtime allocating with [allocator], the index of a [RuntimeAllocator].
+///
+/// JSRuntime *QJS_NewRuntimeWithAllocator(int32_t allocator)
+final JS_NewRuntimeWithAllocator = dylib.lookupFunction<
+    JSRuntimePointer Function(Int32),
+    JSRuntimePointer Function(int allocator)>("QJS_NewRuntimeWithAllocator");
+
+/// Write the counters of the size classes of a [RuntimeAllocator.slab] runtime to [out], 4 per class: block size
+/// (0 for the large blocks, last), blocks in use, blocks allocated overall and blocks carved from chunks. Returns
+/// the number of classes, 0 for other allocators.
+///
+/// int32_t QJS_RuntimeGetAllocatorStats(JSRuntime *rt, int64_t *out)
+final JS_RuntimeGetAllocatorStats = dylib.lookupFunction<
+    Int32 Function(JSRuntimePointer, Pointer<Int64>),
+    int Function(JSRuntimePointer rt, Pointer<Int64> out)>("QJS_RuntimeGetAllocatorStats");
+
 final JS_FreeRuntime = dylib.lookupFunction<Void Function(JSRuntimePointer),
     void Function(JSRuntimePointer rt)>("QJS_FreeRuntime");
 
@@ -216,6 +320,52 @@ final JS_DupValuePointer = dylib.lookupFunction<
         JSValuePointer/* | JSValueConstPointer*/ val)>(
     "QJS_DupValuePointer");
 
+/// Open a handle scope, returns a mark to be passed to [JS_CloseHandleScope].
+///
+/// uint64_t QJS_OpenHandleScope(JSContext *ctx)
+final JS_OpenHandleScope = dylib.lookupFunction<
+    Uint64 Function(JSContextPointer ctx),
+    int Function(JSContextPointer ctx)>("QJS_OpenHandleScope");
+
+/// Free every handle allocated after [mark] that is still alive.
+///
+/// void QJS_CloseHandleScope(JSContext *ctx, uint64_t mark)
+final JS_CloseHandleScope = dylib.lookupFunction<
+    Void Function(JSContextPointer ctx, Uint64 mark),
+    void Function(JSContextPointer ctx, int mark)>("QJS_CloseHandleScope");
+
+/// Move [value] out of every open handle scope, it must then be freed explicitly.
+///
+/// void QJS_EscapeHandle(JSContext *ctx, JSValue *value)
+final JS_EscapeHandle = dylib.lookupFunction<
+    Void Function(JSContextPointer ctx, JSValuePointer value),
+    void Function(JSContextPointer ctx, JSValuePointer value)>("QJS_EscapeHandle");
+
+/// Capture the current globals of [ctx] as the state [JS_ResetGlobals] returns to.
+///
+/// Returns -1 with the exception pending in [ctx] on failure.
+///
+/// int QJS_SnapshotGlobals(JSContext *ctx)
+final JS_SnapshotGlobals = dylib.lookupFunction<
+    Int32 Function(JSContextPointer ctx),
+    int Function(JSContextPointer ctx)>("QJS_SnapshotGlobals");
+
+/// Put the globals of [ctx] back to the last [JS_SnapshotGlobals] and drop the pending jobs of its runtime.
+///
+/// Returns -1 with the exception pending in [ctx] on failure.
+///
+/// int QJS_ResetGlobals(JSContext *ctx)
+final JS_ResetGlobals = dylib.lookupFunction<
+    Int32 Function(JSContextPointer ctx),
+    int Function(JSContextPointer ctx)>("QJS_ResetGlobals");
+
+/// Number of handles currently held by the host in [ctx].
+///
+/// int64_t QJS_GetLiveHandleCount(JSContext *ctx)
+final JS_GetLiveHandleCount = dylib.lookupFunction<
+    Int64 Function(JSContextPointer ctx),
+    int Function(JSContextPointer ctx)>("QJS_GetLiveHandleCount");
+
 final JS_NewObject = dylib.lookupFunction<
     JSValuePointer Function(JSContextPointer),
     JSValuePointer Function(JSContextPointer ctx)>("QJS_NewObject");
@@ -252,14 +402,62 @@ final JS_GetString = dylib.lookupFunction<
         JSValuePointer/* | JSValueConstPointer*/ value)>(
     "QJS_GetString");
 
+/// Create a string from [len] bytes of UTF-8, [string] does not need to be NUL terminated.
+///
+/// JSValue *QJS_NewStringLen(JSContext *ctx, const char *string, size_t len)
+final JS_NewStringLen = dylib.lookupFunction<
+    JSValuePointer Function(JSContextPointer, HeapCharPointer, IntPtr),
+    JSValuePointer Function(
+        JSContextPointer ctx, HeapCharPointer string, int len)>("QJS_NewStringLen");
+
+/// Create a string from [len] Latin-1 characters, copied without conversion.
+///
+/// JSValue *QJS_NewStringLatin1(JSContext *ctx, const uint8_t *string, size_t len)
+final JS_NewStringLatin1 = dylib.lookupFunction<
+    JSValuePointer Function(JSContextPointer, Pointer<Uint8>, IntPtr),
+    JSValuePointer Function(
+        JSContextPointer ctx, Pointer<Uint8> string, int len)>("QJS_NewStringLatin1");
+
+/// Create a string from [len] UTF-16 code units, copied without conversion.
+///
+/// JSValue *QJS_NewStringUTF16(JSContext *ctx, const uint16_t *string, size_t len)
+final JS_NewStringUTF16 = dylib.lookupFunction<
+    JSValuePointer Function(JSContextPointer, Pointer<Uint16>, IntPtr),
+    JSValuePointer Function(
+        JSContextPointer ctx, Pointer<Uint16> string, int len)>("QJS_NewStringUTF16");
+
+/// Borrow the characters of a string [value]: Latin-1 bytes when `wide.value` is 0, UTF-16 code units otherwise.
+///
+/// Returns `nullptr` when [value] is not a string. The buffer is valid as long as [value] is alive.
+///
+/// const void *QJS_GetStringBuffer(JSValueConst *value, size_t *len, int32_t *wide)
+final JS_GetStringBuffer = dylib.lookupFunction<
+    Pointer Function(Pointer, Pointer<IntPtr>, Pointer<Int32>),
+    Pointer Function(JSValuePointer/* | JSValueConstPointer*/ value,
+        Pointer<IntPtr> len, Pointer<Int32> wide)>("QJS_GetStringBuffer");
+
+/// Convert [value] to UTF-8 without copying the result, it must be released with [JS_FreeCString].
+///
+/// const char *QJS_ToCStringLen(JSContext *ctx, JSValueConst *value, size_t *len)
+final JS_ToCStringLen = dylib.lookupFunction<
+    HeapCharPointer Function(JSContextPointer, Pointer, Pointer<IntPtr>),
+    HeapCharPointer Function(JSContextPointer ctx,
+        JSValuePointer/* | JSValueConstPointer*/ value, Pointer<IntPtr> len)>("QJS_ToCStringLen");
+
+/// void QJS_FreeCString(JSContext *ctx, const char *ptr)
+final JS_FreeCString = dylib.lookupFunction<
+    Void Function(JSContextPointer, HeapCharPointer),
+    void Function(JSContextPointer ctx, HeapCharPointer ptr)>("QJS_FreeCString");
+
 final JS_IsJobPending = dylib.lookupFunction<
     Uint32 Function(JSRuntimePointer),
     int Function(JSRuntimePointer rt)>("QJS_IsJobPending");
 
+/// The returned handle is allocated in [ctx], which must belong to [rt].
 final JS_ExecutePendingJob = dylib.lookupFunction<
-    JSValuePointer Function(JSRuntimePointer rt, Uint32 maxJobsToExecute),
+    JSValuePointer Function(JSRuntimePointer rt, JSContextPointer ctx, Uint32 maxJobsToExecute),
     JSValuePointer Function(
-        JSRuntimePointer rt, int maxJobsToExecute)>("QJS_ExecutePendingJob");
+        JSRuntimePointer rt, JSContextPointer ctx, int maxJobsToExecute)>("QJS_ExecutePendingJob");
 
 final JS_GetProp = dylib.lookupFunction<
     JSValuePointer Function(JSContextPointer, Pointer, Pointer),
@@ -269,6 +467,27 @@ final JS_GetProp = dylib.lookupFunction<
         /*JSValuePointer | */JSValueConstPointer prop_name)>(
     "QJS_GetProp");
 
+/// `obj.length` as an integer, -1 with the exception pending on failure.
+///
+/// int64_t QJS_GetLength(JSContext *ctx, JSValueConst *obj)
+final JS_GetLength = dylib.lookupFunction<
+    Int64 Function(JSContextPointer, JSValueConstPointer),
+    int Function(JSContextPointer ctx, JSValueConstPointer obj)>("QJS_GetLength");
+
+/// JSValue *QJS_GetIndexed(JSContext *ctx, JSValueConst *obj, uint32_t idx)
+final JS_GetIndexed = dylib.lookupFunction<
+    JSValuePointer Function(JSContextPointer, JSValueConstPointer, Uint32),
+    JSValuePointer Function(JSContextPointer ctx, JSValueConstPointer obj, int idx)>("QJS_GetIndexed");
+
+/// Write a handle for each element of the fast array [obj] to [out], when they fit in [capacity].
+///
+/// Returns the number of elements, or -1 if [obj] is not a fast array.
+///
+/// int64_t QJS_GetFastArrayElements(JSContext *ctx, JSValueConst *obj, JSValue **out, uint32_t capacity)
+final JS_GetFastArrayElements = dylib.lookupFunction<
+    Int64 Function(JSContextPointer, JSValueConstPointer, JSValuePointerPointer, Uint32),
+    int Function(JSContextPointer ctx, JSValueConstPointer obj, JSValuePointerPointer out, int capacity)>("QJS_GetFastArrayElements");
+
 final JS_SetProp = dylib.lookupFunction<
     Void Function(JSContextPointer, Pointer, Pointer, Pointer),
     void Function(
@@ -315,15 +534,124 @@ final JS_CallVoid = dylib.lookupFunction<
         int argc,
         JSValueConstPointerPointer argv_ptrs)>("QJS_CallVoid");
 
+/// A buffer of at least [argc] JSValues for the arguments of the next [JS_CallArgs], [JS_CallArgsInto] or
+/// [JS_CallConstructorArgs], reused by every call. `nullptr` when out of memory.
+///
+/// JSValue *QJS_GetArgArena(JSContext *ctx, int argc)
+final JS_GetArgArena = dylib.lookupFunction<
+    Pointer Function(JSContextPointer, Int32),
+    Pointer Function(JSContextPointer ctx, int argc)>("QJS_GetArgArena");
+
+/// size_t QJS_SizeOfJSValue()
+final JS_SizeOfJSValue = dylib.lookupFunction<
+    IntPtr Function(),
+    int Function()>("QJS_SizeOfJSValue");
+
+/// Call with the arguments written in the argument arena.
+///
+/// JSValue *QJS_CallArgs(JSContext *ctx, JSValueConst *func_obj, JSValueConst *this_obj, int argc)
+final JS_CallArgs = dylib.lookupFunction<
+    JSValuePointer Function(JSContextPointer, Pointer, Pointer, Int32 argc),
+    JSValuePointer Function(
+        JSContextPointer ctx,
+        JSValuePointer/* | JSValueConstPointer*/ func_obj,
+        JSValuePointer/* | JSValueConstPointer*/ this_obj,
+        int argc)>("QJS_CallArgs");
+
+/// Call with the arguments written in the argument arena, replacing the value of [result] with the returned value.
+/// Returns -1 when the function threw, leaving [result] unchanged.
+///
+/// int QJS_CallArgsInto(JSContext *ctx, JSValueConst *func_obj, JSValueConst *this_obj, int argc, JSValue *result)
+final JS_CallArgsInto = dylib.lookupFunction<
+    Int32 Function(JSContextPointer, Pointer, Pointer, Int32 argc, JSValuePointer),
+    int Function(
+        JSContextPointer ctx,
+        JSValuePointer/* | JSValueConstPointer*/ func_obj,
+        JSValuePointer/* | JSValueConstPointer*/ this_obj,
+        int argc,
+        JSValuePointer result)>("QJS_CallArgsInto");
+
 final JS_ResolveException = dylib.lookupFunction<
     JSValuePointer Function(JSContextPointer, JSValuePointer),
     JSValuePointer Function(JSContextPointer ctx,
         JSValuePointer maybe_exception)>("QJS_ResolveException");
 
-final JS_Dump = dylib.lookupFunction<
-    HeapCharPointer Function(JSContextPointer, Pointer),
-    HeapCharPointer Function(JSContextPointer ctx,
-        JSValuePointer/* | JSValueConstPointer*/ obj)>("QJS_Dump");
+/// Serialize the value graph of [obj] into a buffer allocated with malloc, see `codec.dart` for the format.
+///
+/// Returns `nullptr` on failure with the exception pending in [ctx]. Release the buffer with [JS_FreeBuffer].
+///
+/// uint8_t *QJS_Serialize(JSContext *ctx, JSValueConst *value, int flags, size_t *out_len)
+final JS_Serialize = dylib.lookupFunction<
+    Pointer<Uint8> Function(JSContextPointer, JSValueConstPointer, Int32, Pointer<IntPtr>),
+    Pointer<Uint8> Function(JSContextPointer ctx, JSValueConstPointer obj, int flags, Pointer<IntPtr> outLen)>("QJS_Serialize");
+
+/// Build a value graph from [buf], which is in the format written by [JS_Serialize].
+///
+/// JSValue *QJS_BuildValue(JSContext *ctx, const uint8_t *buf, size_t len)
+final JS_BuildValue = dylib.lookupFunction<
+    JSValuePointer Function(JSContextPointer, Pointer<Uint8>, IntPtr),
+    JSValuePointer Function(JSContextPointer ctx, Pointer<Uint8> buf, int len)>("QJS_BuildValue");
+
+/// Run the operations encoded in [ops] by `JSBatchEncoder`, see `QuickJSBatch`.
+///
+/// Writes a handle, or `nullptr` for `undefined`, for each of the [resultCount] results, and the values read into a
+/// buffer in the [JS_Serialize] format, release it with [JS_FreeBuffer].
+/// Returns -1 with the exception pending in [ctx] on failure, nothing is written then.
+///
+/// int QJS_ExecBatch(JSContext *ctx, const uint8_t *ops, size_t len, JSValueConst **handles, int handle_count, JSValue **results, int result_count, int read_flags, uint8_t **out, size_t *out_len)
+final JS_ExecBatch = dylib.lookupFunction<
+    Int32 Function(JSContextPointer, Pointer<Uint8>, IntPtr, JSValueConstPointerPointer, Int32, JSValuePointerPointer, Int32, Int32, Pointer<Pointer<Uint8>>, Pointer<IntPtr>),
+    int Function(JSContextPointer ctx, Pointer<Uint8> ops, int len, JSValueConstPointerPointer handles, int handleCount, JSValuePointerPointer results, int resultCount, int readFlags, Pointer<Pointer<Uint8>> out, Pointer<IntPtr> outLen)>("QJS_ExecBatch");
+
+/// Allocate a buffer to be released by the native side, e.g. the `buff` of a [QJS_Module_Loader].
+///
+/// uint8_t *QJS_NewBuffer(size_t size)
+final JS_NewBuffer = dylib.lookupFunction<
+    Pointer<Uint8> Function(IntPtr),
+    Pointer<Uint8> Function(int size)>("QJS_NewBuffer");
+
+/// The QuickJS version, bytecode is only valid for the version it was compiled by.
+///
+/// const char *QJS_GetVersion()
+final JS_GetVersion = dylib.lookupFunction<
+    Pointer<Utf8> Function(),
+    Pointer<Utf8> Function()>("QJS_GetVersion");
+
+/// Compile [js_code] without running it, returns its bytecode allocated with malloc or `nullptr` with the exception
+/// pending in [ctx]. Release the buffer with [JS_FreeBuffer]. A module is not kept in [ctx].
+///
+/// uint8_t *QJS_CompileToBytecode(JSContext *ctx, HeapChar *js_code, size_t js_code_len, HeapChar *filename, int eval_flags, size_t *out_len)
+final JS_CompileToBytecode = dylib.lookupFunction<
+    Pointer<Uint8> Function(JSContextPointer, HeapCharPointer, IntPtr, HeapCharPointer, Int32, Pointer<IntPtr>),
+    Pointer<Uint8> Function(JSContextPointer ctx, HeapCharPointer js_code, int js_code_len, HeapCharPointer filename, int eval_flags, Pointer<IntPtr> outLen)>("QJS_CompileToBytecode");
+
+/// Compile the module [module_name] for a module loader returning [JSModuleLoaderResult.COMPILED], its bytecode is
+/// returned like [JS_CompileToBytecode].
+///
+/// uint8_t *QJS_CompileModule(JSContext *ctx, HeapChar *js_code, size_t js_code_len, HeapChar *module_name, size_t *out_len)
+final JS_CompileModule = dylib.lookupFunction<
+    Pointer<Uint8> Function(JSContextPointer, HeapCharPointer, IntPtr, HeapCharPointer, Pointer<IntPtr>),
+    Pointer<Uint8> Function(JSContextPointer ctx, HeapCharPointer js_code, int js_code_len, HeapCharPointer module_name, Pointer<IntPtr> outLen)>("QJS_CompileModule");
+
+/// Evaluate [js_code] like [JS_Eval] and write the bytecode it was compiled to into `outBytecode`, `nullptr` when
+/// the code could not be compiled. Release the buffer with [JS_FreeBuffer].
+///
+/// JSValue *QJS_EvalToBytecode(JSContext *ctx, HeapChar *js_code, size_t js_code_len, HeapChar *filename, int eval_flags, uint8_t **out_bytecode, size_t *out_len)
+final JS_EvalToBytecode = dylib.lookupFunction<
+    JSValuePointer Function(JSContextPointer, HeapCharPointer, IntPtr, HeapCharPointer, Int32, Pointer<Pointer<Uint8>>, Pointer<IntPtr>),
+    JSValuePointer Function(JSContextPointer ctx, HeapCharPointer js_code, int js_code_len, HeapCharPointer filename, int eval_flags, Pointer<Pointer<Uint8>> outBytecode, Pointer<IntPtr> outLen)>("QJS_EvalToBytecode");
+
+/// Evaluate bytecode written by [JS_CompileToBytecode].
+///
+/// JSValue *QJS_EvalBytecode(JSContext *ctx, const uint8_t *buf, size_t len)
+final JS_EvalBytecode = dylib.lookupFunction<
+    JSValuePointer Function(JSContextPointer, Pointer<Uint8>, IntPtr),
+    JSValuePointer Function(JSContextPointer ctx, Pointer<Uint8> buf, int len)>("QJS_EvalBytecode");
+
+/// void QJS_FreeBuffer(void *buf)
+final JS_FreeBuffer = dylib.lookupFunction<
+    Void Function(Pointer),
+    void Function(Pointer buf)>("QJS_FreeBuffer");
 
 /// JSValue *QJS_Eval(JSContext *ctx, HeapChar *js_code, size_t js_code_len, HeapChar *filename, int eval_flags)
 final JS_Eval = dylib.lookupFunction<
@@ -370,6 +698,45 @@ final JS_GetArrayBuffer = dylib.lookupFunction<
   Pointer<Uint8> Function(JSContextPointer ctx, Pointer<IntPtr> psize, JSValuePointer obj)
 >('QJS_GetArrayBuffer');
 
+/// Allocate an uninitialized external buffer of [len] bytes with one reference, `nullptr` when out of memory.
+///
+/// External buffers are reference counted native memory which backs the ArrayBuffers of QuickJS.
+///
+/// uint8_t *QJS_NewExternalBuffer(size_t len)
+final JS_NewExternalBuffer = dylib.lookupFunction<
+  Pointer<Uint8> Function(IntPtr),
+  Pointer<Uint8> Function(int len)
+>('QJS_NewExternalBuffer');
+
+/// Drop a reference of an external buffer, it is freed with the last one.
+///
+/// void QJS_ExternalBufferRelease(void *data)
+final JS_ExternalBufferRelease = dylib.lookupFunction<
+  Void Function(Pointer),
+  void Function(Pointer data)
+>('QJS_ExternalBufferRelease');
+
+/// Native address of [JS_ExternalBufferRelease], for a [NativeFinalizer].
+final JS_ExternalBufferReleasePointer = dylib.lookup<NativeFinalizerFunction>('QJS_ExternalBufferRelease');
+
+/// Create an ArrayBuffer over the [len] first bytes of the external buffer [data], which gains a reference.
+///
+/// JSValue *QJS_NewArrayBufferExternal(JSContext *ctx, uint8_t *data, size_t len)
+final JS_NewArrayBufferExternal = dylib.lookupFunction<
+  JSValuePointer Function(JSContextPointer, Pointer<Uint8>, IntPtr),
+  JSValuePointer Function(JSContextPointer ctx, Pointer<Uint8> data, int len)
+>('QJS_NewArrayBufferExternal');
+
+/// Take a reference of the external buffer holding the data of the ArrayBuffer [obj], return NULL if exception.
+///
+/// Data not held by an external buffer, e.g. of a SharedArrayBuffer, is copied into a new one.
+///
+/// uint8_t *QJS_RetainArrayBuffer(JSContext *ctx, JSValueConst *obj, size_t *psize)
+final JS_RetainArrayBuffer = dylib.lookupFunction<
+  Pointer<Uint8> Function(JSContextPointer, JSValuePointer, Pointer<IntPtr>),
+  Pointer<Uint8> Function(JSContextPointer ctx, JSValuePointer obj, Pointer<IntPtr> psize)
+>('QJS_RetainArrayBuffer');
+
 /// int QJS_ToBool(JSContext *ctx, JSValueConst *val)
 final JS_ToBool = dylib.lookupFunction<
   Uint32 Function(JSContextPointer, JSValueConstPointer),
@@ -452,6 +819,48 @@ final JS_HasProperty = dylib.lookupFunction<
   int Function(JSContextPointer ctx, JSValueConstPointer this_obj, int prop)
 >('QJS_HasProperty');
 
+/// Returns 0 (`JS_ATOM_NULL`) with the exception pending on failure. Release the atom with [JS_FreeAtom].
+///
+/// JSAtom QJS_NewAtomLen(JSContext *ctx, const char *name, size_t len)
+final JS_NewAtomLen = dylib.lookupFunction<
+  JSAtom Function(JSContextPointer, HeapCharPointer, IntPtr),
+  int Function(JSContextPointer ctx, HeapCharPointer name, int len)
+>('QJS_NewAtomLen');
+
+/// JSAtom QJS_DupAtom(JSContext *ctx, JSAtom atom)
+final JS_DupAtom = dylib.lookupFunction<
+  JSAtom Function(JSContextPointer, JSAtom),
+  int Function(JSContextPointer ctx, int atom)
+>('QJS_DupAtom');
+
+/// void QJS_FreeAtom(JSContext *ctx, JSAtom atom)
+final JS_FreeAtom = dylib.lookupFunction<
+  Void Function(JSContextPointer, JSAtom),
+  void Function(JSContextPointer ctx, int atom)
+>('QJS_FreeAtom');
+
+/// Returns -1 with the exception pending on failure.
+///
+/// int QJS_SetProperty(JSContext *ctx, JSValueConst *this_obj, JSAtom prop, JSValueConst *value)
+final JS_SetProperty = dylib.lookupFunction<
+  Int32 Function(JSContextPointer, JSValueConstPointer, JSAtom, JSValueConstPointer),
+  int Function(JSContextPointer ctx, JSValueConstPointer this_obj, int prop, JSValueConstPointer value)
+>('QJS_SetProperty');
+
+const int JS_PROP_CONFIGURABLE = 1 << 0;
+const int JS_PROP_WRITABLE = 1 << 1;
+const int JS_PROP_ENUMERABLE = 1 << 2;
+const int JS_PROP_C_W_E = JS_PROP_CONFIGURABLE | JS_PROP_WRITABLE | JS_PROP_ENUMERABLE;
+
+/// Define a data property, [flags] are the bits of [JS_PROP_CONFIGURABLE], [JS_PROP_WRITABLE] and
+/// [JS_PROP_ENUMERABLE]. Returns -1 with the exception pending on failure.
+///
+/// int QJS_DefinePropertyValue(JSContext *ctx, JSValueConst *this_obj, JSAtom prop, JSValueConst *value, int flags)
+final JS_DefinePropertyValue = dylib.lookupFunction<
+  Int32 Function(JSContextPointer, JSValueConstPointer, JSAtom, JSValueConstPointer, Int32),
+  int Function(JSContextPointer ctx, JSValueConstPointer this_obj, int prop, JSValueConstPointer value, int flags)
+>('QJS_DefinePropertyValue');
+
 abstract class JSHandyType {
   static const int js_unknown = 0/*'unknown'*/;
   static const int js_uninitialized = -1/*'uninitialized'*/;
@@ -484,6 +893,8 @@ abstract class JSHandyType {
   static const int js_Array = 21/*'Array'*/;
   /// all other object values not listed above.
   static const int js_object = 22/*'object'*/;
+  /// Int8Array, Float64Array, ... see [JSTypedArrayType].
+  static const int js_TypedArray = 23/*'TypedArray'*/;
   /// True if a dart `int` is enough to present [type].
   static bool isIntLike(int type) {
     return type == js_int || type == js_BigInt;
@@ -503,11 +914,58 @@ abstract class JSHandyType {
         || type == js_Error
         || type == js_RegExp
         || type == js_Array
-        || type == js_object;
+        || type == js_object
+        || type == js_TypedArray;
 
   }
 }
 
+/// Element types of typed arrays, keep in sync with `QJS_TYPED_ARRAY_*` of `interface.cpp`.
+abstract class JSTypedArrayType {
+  static const int uint8Clamped = 0;
+  static const int int8 = 1;
+  static const int uint8 = 2;
+  static const int int16 = 3;
+  static const int uint16 = 4;
+  static const int int32 = 5;
+  static const int uint32 = 6;
+  static const int bigInt64 = 7;
+  static const int bigUint64 = 8;
+  static const int float32 = 9;
+  static const int float64 = 10;
+
+  /// Size in bytes of the elements of each type.
+  static const List<int> elementSizes = [1, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8];
+}
+
+/// Take a reference of the external buffer holding the ArrayBuffer of the typed array [obj], see
+/// [JS_RetainArrayBuffer]. Its elements are of [JSTypedArrayType] [ptype] and span [pbyteLength] bytes
+/// from [pbyteOffset]. Returns NULL if exception.
+///
+/// uint8_t *QJS_RetainTypedArray(JSContext *ctx, JSValueConst *obj, size_t *psize, size_t *pbyte_offset, size_t *pbyte_length, int32_t *ptype)
+final JS_RetainTypedArray = dylib.lookupFunction<
+  Pointer<Uint8> Function(JSContextPointer, JSValuePointer, Pointer<IntPtr>, Pointer<IntPtr>, Pointer<IntPtr>, Pointer<Int32>),
+  Pointer<Uint8> Function(JSContextPointer ctx, JSValuePointer obj, Pointer<IntPtr> psize, Pointer<IntPtr> pbyteOffset, Pointer<IntPtr> pbyteLength, Pointer<Int32> ptype)
+>('QJS_RetainTypedArray');
+
+/// `new <type>Array(buffer, byteOffset, length)`, [type] is one of [JSTypedArrayType].
+///
+/// JSValue *QJS_NewTypedArray(JSContext *ctx, JSValueConst *buffer, size_t byte_offset, size_t length, int32_t type)
+final JS_NewTypedArray = dylib.lookupFunction<
+  JSValuePointer Function(JSContextPointer, JSValuePointer, IntPtr, IntPtr, Int32),
+  JSValuePointer Function(JSContextPointer ctx, JSValuePointer buffer, int byteOffset, int length, int type)
+>('QJS_NewTypedArray');
+
+/// Write the elements of the fast array [obj] to [out] as doubles when they are all numbers and fit in [capacity].
+///
+/// Returns the number of elements, or -1 if [obj] is not a fast array or holds a value which is not a number.
+///
+/// int64_t QJS_GetFloat64Elements(JSContext *ctx, JSValueConst *obj, double *out, uint32_t capacity)
+final JS_GetFloat64Elements = dylib.lookupFunction<
+  Int64 Function(JSContextPointer, JSValuePointer, Pointer<Double>, Uint32),
+  int Function(JSContextPointer ctx, JSValuePointer obj, Pointer<Double> out, int capacity)
+>('QJS_GetFloat64Elements');
+
 /// int8_t QJS_HandyTypeof(JSContext *ctx, JSValueConst *value)
 final JS_HandyTypeof = dylib.lookupFunction<
   Int8 Function(JSContextPointer, JSValueConstPointer),
@@ -532,6 +990,14 @@ final JS_CallConstructor = dylib.lookupFunction<
   JSValuePointer Function(JSContextPointer ctx, JSValuePointer func_obj, int argc, JSValuePointerPointer argv_ptrs)
 >('QJS_CallConstructor');
 
+/// Call as a constructor with the arguments written in the argument arena.
+///
+/// JSValue* QJS_CallConstructorArgs(JSContext* ctx, JSValueConst *func_obj, int argc)
+final JS_CallConstructorArgs = dylib.lookupFunction<
+  JSValuePointer Function(JSContextPointer, JSValuePointer, Int32),
+  JSValuePointer Function(JSContextPointer ctx, JSValuePointer func_obj, int argc)
+>('QJS_CallConstructorArgs');
+
 /// Get the pending exception.
 ///
 /// Call it only when you pretty sure there is an exception.
@@ -548,11 +1014,24 @@ final JS_JSONStringify = dylib.lookupFunction<
   JSValuePointer Function(JSContextPointer ctx, JSValuePointer obj)
 >('QJS_JSONStringify');
 
+/// Results of a [QJS_Module_Loader].
+abstract class JSModuleLoaderResult {
+  static const NOT_FOUND = 0;
+  /// `buff` holds NUL terminated UTF-8 source.
+  static const SOURCE = 1;
+  /// `buff` holds bytecode written by [JS_CompileToBytecode].
+  static const BYTECODE = 2;
+  /// The module was compiled with [JS_CompileModule], `buff` is not set.
+  static const COMPILED = 3;
+}
+
+/// `buff` must be allocated with [JS_NewBuffer], it is freed by the native loader.
+///
 /// typedef uint8_t QJS_Module_Loader(JSContext* ctx, char** buff, size_t *len, const char* module_name)
 typedef QJS_Module_Loader = Uint8 Function(JSContextPointer ctx, Pointer<Pointer<Utf8>> buffPointer, Pointer<IntPtr> lenPointer, Pointer<Utf8> module_name);
 typedef QJS_Module_Loader_Dart = int Function(JSContextPointer ctx, Pointer<Pointer<Utf8>> buffPointer, Pointer<IntPtr> lenPointer, Pointer<Utf8> module_name);
 
-/// Set a global module handler.
+/// Set the module handler of [rt].
 ///
 /// **Note:** The eval flag must include JS_EVAL_TYPE_MODULE to support JS `import` syntax,
 /// and in this mode the return value is always `undefined`
@@ -7,9 +7,19 @@ import 'package:ffi/ffi.dart';
 import 'package:fjs/vm.dart';
 
 import '../error.dart';
+import 'batch.dart';
+import 'bytecode_cache.dart';
+import 'codec.dart';
+import 'external_buffer.dart';
 import 'qjs_ffi.dart';
 import '../lifetime.dart';
 
+export 'batch.dart';
+export 'bytecode_cache.dart';
+export 'executor.dart';
+export 'external_buffer.dart';
+export 'vm_pool.dart';
+
 /**
  * From https://www.figma.com/blog/how-we-built-the-figma-plugin-system/
  */
@@ -31,6 +41,19 @@ class VmPropertyDescriptor<VmHandle> {
   });
 }
 
+/// A property name interned by [QuickJSVm.atom], valid until the vm is disposed.
+///
+/// Property access with an atom skips creating a key string and looking it up in the atom table.
+class JSAtomHandle {
+  final String name;
+  final int atom;
+
+  JSAtomHandle._(this.name, this.atom);
+
+  @override
+  String toString() => 'JSAtomHandle($name)';
+}
+
 /// @returns 1/0
 typedef CToHostInterruptImplementation = int Function(JSRuntimePointer rt);
 
@@ -43,10 +66,98 @@ typedef CToHostInterruptImplementation = int Function(JSRuntimePointer rt);
  */
 typedef InterruptHandler = bool? Function(QuickJSVm vm);
 
+/// Why the execution of a vm was interrupted.
+enum InterruptReason {
+  none,
+  /// the [InterruptHandler] returned `true`.
+  handler,
+  /// the deadline set with [QuickJSVm.setExecutionTimeout] passed.
+  deadline,
+  /// the budget set with [QuickJSVm.setOpBudget] ran out.
+  opBudget,
+}
+
+/// How the cycle collector of a vm scans the heap, see [QuickJSVm.setGCMode].
+enum GCMode {
+  /// every collection scans all the objects.
+  full,
+  /// collections triggered by allocations only scan the objects allocated since the previous one, survivors are
+  /// only scanned again by a full collection, once the GC threshold is reached.
+  generational,
+}
+
+/// Memory allocator of the runtime of a vm.
+enum RuntimeAllocator {
+  /// malloc of the platform.
+  system,
+  /// size classes of small blocks carved from 64 KiB chunks and recycled per class, so the many small objects of
+  /// the engine are allocated without going through malloc. Chunks are only returned to the system when the vm is
+  /// disposed, all at once, so it suits short-lived vms better than long-running ones.
+  slab,
+  /// blocks bumped from an arena and never reused, freeing is a no-op and the arena is released at once on
+  /// dispose. Automatic garbage collection is disabled. For vms running a script or two before being disposed,
+  /// memory only grows until then, bounded by [QuickJSVm.setMemoryLimit].
+  arena,
+}
+
+/// Counters of a size class of [RuntimeAllocator.slab], see [QuickJSVm.allocatorStats].
+class AllocatorSizeClass {
+  /// Size of the blocks, header included, `0` for the blocks too large for a class, allocated with malloc.
+  final int blockSize;
+  /// Blocks in use.
+  final int live;
+  /// Blocks allocated since the vm was created.
+  final int allocations;
+  /// Blocks carved from chunks, in use or free.
+  final int reserved;
+
+  AllocatorSizeClass(this.blockSize, this.live, this.allocations, this.reserved);
+
+  @override
+  String toString() => 'AllocatorSizeClass(blockSize: $blockSize, live: $live, allocations: $allocations, reserved: $reserved)';
+}
+
+/// Collector stats of a vm since it was created, see [QuickJSVm.gcStats].
+class GCStats {
+  /// Number of minor collections, the ones of [GCMode.generational] that only scan the young objects.
+  final int minorCount;
+  final Duration minorTime;
+  /// Number of collections scanning the whole heap.
+  final int fullCount;
+  final Duration fullTime;
+  /// Longest single collection.
+  final Duration maxPause;
+  final Duration lastPause;
+  /// Decrease of the heap size over the collections.
+  final int freedBytes;
+  final int lastFreedBytes;
+
+  GCStats(this.minorCount, this.minorTime, this.fullCount, this.fullTime, this.maxPause, this.lastPause,
+      this.freedBytes, this.lastFreedBytes);
+
+  @override
+  String toString() => 'GCStats(minor: $minorCount in $minorTime, full: $fullCount in $fullTime, '
+      'max pause: $maxPause, last pause: $lastPause, freed: $freedBytes, last freed: $lastFreedBytes)';
+}
+
 class QuickJSVm extends Vm implements Disposable {
   static final _vmMap = Map<JSContextPointer, QuickJSVm>();
-  static final _rtMap = Map<JSRuntimePointer, QuickJSVm>();
-  static bool _initialized = false;
+  /// vms indexed by the host id of their runtime, native callbacks find their vm without a lookup.
+  static final List<QuickJSVm?> _vms = [];
+  static final List<int> _freeHostIds = [];
+  // statics are per isolate, so is each callback pointer.
+  static final QJS_C_To_HostCallbackFuncPointer _funcCallbackFp = Pointer.fromFunction(
+    _cToHostCallbackFunction,
+  );
+  // final interruptCallbackWasmTypes = [
+  //   intType, // return 0 no interrupt, !=0 interrrupt
+  //   pointerType, // rt_ptr
+  // ];
+  static final QJS_C_To_HostInterruptFuncPointer _interruptCallbackFp = Pointer.fromFunction(
+    _cToHostInterrupt,
+    // failed
+    0,
+  );
 
   late final JSRuntimePointer rt;
   late final JSContextPointer ctx;
@@ -61,16 +172,22 @@ class QuickJSVm extends Vm implements Disposable {
   bool get disposed => _disposed;
   /// heap values created by this vm, and should be freed when this vm is disposed.
   final Set<JSValuePointer> _heapValues = Set();
+  /// heap values created inside each open handle scope, innermost last.
+  final List<Set<JSValuePointer>> _handleScopes = [];
   final List<Completer> _completers = [];
   ES6ModuleLoader? es6ModuleLoader;
+  /// When set, [evalCode] and the ES6 module loader compile each distinct source once and reuse its bytecode.
+  BytecodeCache? bytecodeCache;
 
   QuickJSVm({
+    this.bytecodeCache,
     bool? reserveUndefined,
     bool? jsonSerializeObject,
     bool? constructDate,
     bool? disableConsole,
     bool? hideStack,
     bool? arrayBufferCopy,
+    RuntimeAllocator allocator = RuntimeAllocator.system,
   }) : super(
     reserveUndefined: reserveUndefined,
     jsonSerializeObject: jsonSerializeObject,
@@ -79,42 +196,29 @@ class QuickJSVm extends Vm implements Disposable {
     hideStack: hideStack,
     arrayBufferCopy: arrayBufferCopy,
   ) {
-    if (!_initialized) {
-      final QJS_C_To_HostCallbackFuncPointer funcCallbackFp =
-          Pointer.fromFunction(
-        _cToHostCallbackFunction,
-        // functionCallbackWasmTypes.join('')
-      );
-      JS_SetHostCallback(funcCallbackFp);
-
-      // final interruptCallbackWasmTypes = [
-      //   intType, // return 0 no interrupt, !=0 interrrupt
-      //   pointerType, // rt_ptr
-      // ];
-      final QJS_C_To_HostInterruptFuncPointer interruptCallbackFp =
-          Pointer.fromFunction(
-        _cToHostInterrupt,
-        // failed
-        0,
-        // interruptCallbackWasmTypes.join('')
-      );
-      JS_SetInterruptCallback(interruptCallbackFp);
-      _initialized = true;
+    rt = JS_NewRuntimeWithAllocator(allocator.index);
+    _hostId = _freeHostIds.isNotEmpty ? _freeHostIds.removeLast() : _vms.length;
+    if(_hostId == _vms.length) {
+      _vms.add(this);
+    } else {
+      _vms[_hostId] = this;
     }
-
-    rt = JS_NewRuntime();
+    JS_SetHostId(rt, _hostId);
+    // callbacks are bound to the current isolate, each runtime gets the ones of the isolate that owns it.
+    JS_SetHostCallback(rt, _funcCallbackFp);
+    JS_SetInterruptCallback(rt, _interruptCallbackFp);
     ctx = JS_NewContext(rt);
     _vmMap[ctx] = this;
-    _rtMap[rt] = this;
-    _setupConsole();
-    _setupSetTimeout();
+    // globals are installed with one native call.
+    final batch = QuickJSBatch(this);
+    _setupConsole(batch);
+    _setupSetTimeout(batch);
+    batch.run();
     _setupES6ModuleResolver();
     postConstruct();
   }
 
-  void _setupConsole() {
-    final JSValuePointer console = newObject();
-    setProperty(global, 'console', console);
+  void _setupConsole(QuickJSBatch batch) {
     JSToDartFunction logFn = (List<JSValuePointer> args, {JSValuePointer? thisObj}) {
       if(disableConsole) {
         return;
@@ -131,17 +235,15 @@ class QuickJSVm extends Vm implements Disposable {
       }).join(' ');
       consoleLogFn(msg);
     };
-    final JSValuePointer log = newFunction('log', logFn);
-    setProperty(console, 'log', log);
-    _freeJSValue(log);
+    batch.set(global, 'console', {'log': newFunction('log', logFn)});
   }
 
   int _timeoutNextId = 1;
   Map<int, Future> _timeoutMap = {};
-  void _setupSetTimeout() {
+  void _setupSetTimeout(QuickJSBatch batch) {
     JSToDartFunction setTimeout = (List<JSValuePointer> args, {JSValuePointer? thisObj}) {
       int id = _timeoutNextId++;
-      JSValuePointer fn = _heapValueHandle(JS_DupValuePointer(ctx, args[0]));
+      JSValuePointer fn = escapeHandle(_heapValueHandle(JS_DupValuePointer(ctx, args[0])));
       int ms = getInt(args[1])!;
       _timeoutMap[id] = Future.delayed(Duration(milliseconds: ms), () {
         if(_disposed) {
@@ -156,20 +258,18 @@ class QuickJSVm extends Vm implements Disposable {
       });
       return newNumber(id);
     };
-    final setTimeoutFn = newFunction('setTimeout', setTimeout);
-    setProperty(global, 'setTimeout', setTimeoutFn);
-    _freeJSValue(setTimeoutFn);
+    batch.set(global, 'setTimeout', batch.own(newFunction('setTimeout', setTimeout)));
     JSToDartFunction clearTimeout = (List<JSValuePointer> args, {JSValuePointer? thisObj}) {
       int id = getInt(args[0])!;
       _timeoutMap.remove(id);
     };
-    final clearTimeoutFn = newFunction('clearTimeout', clearTimeout);
-    setProperty(global, 'clearTimeout', clearTimeoutFn);
-    _freeJSValue(clearTimeoutFn);
+    batch.set(global, 'clearTimeout', batch.own(newFunction('clearTimeout', clearTimeout)));
   }
 
+  static final Pointer<NativeFunction<QJS_Module_Loader>> _moduleLoaderFp = Pointer.fromFunction(_ES6ModuleLoader, 0);
+
   void _setupES6ModuleResolver() {
-    JS_SetModuleLoaderFunc(rt, Pointer.fromFunction(_ES6ModuleLoader, 0));
+    JS_SetModuleLoaderFunc(rt, _moduleLoaderFp);
   }
 
   /**
@@ -276,18 +376,65 @@ class QuickJSVm extends Vm implements Disposable {
   }
 
   String getString(JSValuePointer value) {
-    return JS_GetString(ctx, value).toDartString();
-    // Pointer<Utf8> ptr =  jsToCString(context, value);
-    // final str = ptr.toDartString();
-    // JS_JSFreeCString(context, ptr);
-    // return str;
+    final out = _scratch(sizeOf<IntPtr>() + sizeOf<Int32>());
+    final lenPtr = out.cast<IntPtr>();
+    final widePtr = out.elementAt(sizeOf<IntPtr>()).cast<Int32>();
+    // strings are read in place, Latin-1 and UTF-16 are Dart code units already.
+    final buff = JS_GetStringBuffer(value, lenPtr, widePtr);
+    if(buff != nullptr) {
+      return widePtr.value == 0
+          ? String.fromCharCodes(buff.cast<Uint8>().asTypedList(lenPtr.value))
+          : String.fromCharCodes(buff.cast<Uint16>().asTypedList(lenPtr.value));
+    }
+    final str = JS_ToCStringLen(ctx, value, lenPtr);
+    if(str == nullptr) {
+      throw extractError(JS_GetException(ctx));
+    }
+    try {
+      return utf8.decode(str.cast<Uint8>().asTypedList(lenPtr.value), allowMalformed: true);
+    } finally {
+      JS_FreeCString(ctx, str);
+    }
   }
 
   JSValuePointer newString(String value) {
-    final utf8str = value.toNativeUtf8();
-    final ptr = JS_NewString(ctx, utf8str);
-    calloc.free(utf8str);
-    return this._heapValueHandle(ptr);
+    final units = value.codeUnits;
+    final len = units.length;
+    int bits = 0;
+    for(int i = 0;i < len;i++) {
+      bits |= units[i];
+    }
+    final latin1 = bits < 0x100;
+    final size = latin1 ? len : len * 2;
+    // small strings are copied through the scratch buffer of this vm, large ones through a temporary buffer.
+    final buff = size > _scratchSize ? malloc<Uint8>(size) : _scratch(size);
+    try {
+      final JSValuePointer ptr;
+      if(latin1) {
+        buff.asTypedList(len).setAll(0, units);
+        ptr = JS_NewStringLatin1(ctx, buff, len);
+      } else {
+        buff.cast<Uint16>().asTypedList(len).setAll(0, units);
+        ptr = JS_NewStringUTF16(ctx, buff.cast(), len);
+      }
+      return this._heapValueHandle(ptr);
+    } finally {
+      if(buff != _scratchBuff) {
+        malloc.free(buff);
+      }
+    }
+  }
+
+  static const _scratchSize = 64 * 1024;
+  Pointer<Uint8> _scratchBuff = nullptr;
+
+  /// A native buffer of [_scratchSize] bytes for short-lived copies, [size] must not exceed it.
+  Pointer<Uint8> _scratch(int size) {
+    assert(size <= _scratchSize);
+    if(_scratchBuff == nullptr) {
+      _scratchBuff = malloc<Uint8>(_scratchSize);
+    }
+    return _scratchBuff;
   }
 
   JSValuePointer newDate(int timestamp) {
@@ -302,22 +449,42 @@ class QuickJSVm extends Vm implements Disposable {
    */
   JSValuePointer newObject([Map? value]) {
     final ptr = JS_NewObject(ctx);
+    _heapValueHandle(ptr);
     if(value != null) {
+      _defineAll(ptr, value);
+    }
+    return ptr;
+  }
+
+  /// Define the entries of [value] as properties of [obj] with a single native call.
+  void _defineAll(JSValuePointer obj, Map value) {
+    if(value.isEmpty) {
+      return;
+    }
+    // keys are written as strings, other keys are converted by the engine.
+    if(value.keys.any((key) => key is! String && key is! int)) {
       value.forEach((key, value) {
-        consumeAndFree(dartToJS(value), (_) => defineProperty(ptr, key, VmPropertyDescriptor(value: _, enumerable: true, configurable: true, writable: true)));
+        consumeAndFree(dartToJS(value), (_) => defineProperty(obj, key, VmPropertyDescriptor(value: _, enumerable: true, configurable: true, writable: true)));
       });
+      return;
     }
-    return _heapValueHandle(ptr);
+    final batch = QuickJSBatch(this);
+    value.forEach((key, value) {
+      if(value is JSValuePointer) {
+        batch.own(value);
+      }
+      batch.define(obj, key, value);
+    });
+    batch.run();
   }
 
   JSValuePointer newObjectWithPrototype(JSValuePointer prototype, [Map? value]) {
     final ptr = JS_NewObjectProto(ctx, prototype);
+    _heapValueHandle(ptr);
     if(value != null) {
-      value.forEach((key, value) {
-        consumeAndFree(dartToJS(value), (_) => defineProperty(ptr, key, VmPropertyDescriptor(value: _, enumerable: true, configurable: true, writable: true)));
-      });
+      _defineAll(ptr, value);
     }
-    return _heapValueHandle(ptr);
+    return ptr;
   }
 
   /**
@@ -346,15 +513,80 @@ class QuickJSVm extends Vm implements Disposable {
     }
   }
 
+  /// Create an ArrayBuffer holding [value].
+  ///
+  /// When [value] is the [ExternalBuffer.bytes] of an [ExternalBuffer], e.g. an ArrayBuffer returned by [jsToDart],
+  /// the ArrayBuffer shares its memory, otherwise [value] is copied once into a new external buffer.
   JSValuePointer newArrayBuffer(Uint8List value) {
-    final ptr = calloc<Uint8>(value.length);
-    final byteList = ptr.asTypedList(value.length);
-    byteList.setAll(0, value);
-    final ret = JS_NewArrayBuffer(
-        ctx, ptr, value.length, Pointer.fromFunction(_cToHostArrayBufferFreeCallback), nullptr, 0);
+    final external = ExternalBuffer.of(value);
+    if(external != null) {
+      return _heapValueHandle(JS_NewArrayBufferExternal(ctx, external.address, external.length));
+    }
+    final ptr = JS_NewExternalBuffer(value.length);
+    if(ptr == nullptr) {
+      throw OutOfMemoryError();
+    }
+    ptr.asTypedList(value.length).setAll(0, value);
+    final ret = JS_NewArrayBufferExternal(ctx, ptr, value.length);
+    // the ArrayBuffer holds its own reference.
+    JS_ExternalBufferRelease(ptr);
     return _heapValueHandle(ret);
   }
 
+  /// Create a typed array of the type matching [value], e.g. a Float64Array for a Float64List.
+  ///
+  /// Like [newArrayBuffer], a view of an [ExternalBuffer], e.g. a typed array returned by [jsToDart], shares its
+  /// memory, otherwise [value] is copied once into a new external buffer.
+  JSValuePointer newTypedArray(TypedData value) {
+    final type = ExternalBuffer.typeOf(value);
+    if(type == null) {
+      throw ArgumentError.value(value, 'value', 'no typed array for ${value.runtimeType}');
+    }
+    final length = value.lengthInBytes ~/ value.elementSizeInBytes;
+    final external = ExternalBuffer.of(value);
+    int offset = value.offsetInBytes;
+    JSValuePointer buffer;
+    if(external != null) {
+      buffer = JS_NewArrayBufferExternal(ctx, external.address, external.length);
+    } else {
+      final ptr = JS_NewExternalBuffer(value.lengthInBytes);
+      if(ptr == nullptr) {
+        throw OutOfMemoryError();
+      }
+      ptr.asTypedList(value.lengthInBytes).setAll(0, value.buffer.asUint8List(value.offsetInBytes, value.lengthInBytes));
+      buffer = JS_NewArrayBufferExternal(ctx, ptr, value.lengthInBytes);
+      // the ArrayBuffer holds its own reference.
+      JS_ExternalBufferRelease(ptr);
+      offset = 0;
+    }
+    JSError? error = resolveError(buffer);
+    if(error != null) {
+      throw error;
+    }
+    final resultPtr = consumeAndFree(_heapValueHandle(buffer), (_) => JS_NewTypedArray(ctx, _, offset, length, type));
+    error = resolveError(resultPtr);
+    if(error != null) {
+      throw error;
+    }
+    return _heapValueHandle(resultPtr);
+  }
+
+  /// The elements of the plain array of numbers [array] as a Float64List, read with a single native call.
+  ///
+  /// Returns `null` when [array] has holes or an element that is not a number. The list is a view of an
+  /// [ExternalBuffer], so passing it to [dartToJS] creates a Float64Array without copying.
+  Float64List? getFloat64List(JSValuePointer array) {
+    final count = JS_GetFloat64Elements(ctx, array, nullptr, 0);
+    if(count < 0) {
+      return null;
+    }
+    final external = ExternalBuffer(count * sizeOf<Double>());
+    if(JS_GetFloat64Elements(ctx, array, external.address.cast<Double>(), count) < 0) {
+      return null;
+    }
+    return external.typedView(JSTypedArrayType.float64, 0, count) as Float64List;
+  }
+
   JSValuePointer newError(dynamic error) {
     String? name;
     String? message;
@@ -370,24 +602,12 @@ class QuickJSVm extends Vm implements Disposable {
     }
     final ptr = JS_NewError(ctx);
     if (name != null) {
-      final _k = newString('name');
-      final _v = newString(name);
-      JS_SetProp(ctx, ptr, _k, _v);
-      _freeJSValue(_k);
-      _freeJSValue(_v);
+      consumeAndFree(newString(name), (_v) => JS_SetProperty(ctx, ptr, atom('name').atom, _v));
     }
     if (stack != null) {
-      final _k = newString('stack');
-      final _v = newString(stack);
-      JS_SetProp(ctx, ptr, _k, _v);
-      _freeJSValue(_k);
-      _freeJSValue(_v);
-    }
-    final _k = newString('message');
-    final _v = newString(message);
-    JS_SetProp(ctx, ptr, _k, _v);
-    _freeJSValue(_k);
-    _freeJSValue(_v);
+      consumeAndFree(newString(stack), (_v) => JS_SetProperty(ctx, ptr, atom('stack').atom, _v));
+    }
+    consumeAndFree(newString(message), (_v) => JS_SetProperty(ctx, ptr, atom('message').atom, _v));
     return _heapValueHandle(ptr);
   }
 
@@ -397,9 +617,9 @@ class QuickJSVm extends Vm implements Disposable {
     String message;
     final int type = JS_HandyTypeof(ctx, value);
     if(type == JSHandyType.js_Error) {
-      name = jsToDart(getProperty(value, 'name'));
-      stack = jsToDart(getProperty(value, 'stack'));
-      message = jsToDart(getProperty(value, 'message'));
+      name = consumeAndFree(getPropertyAtom(value, atom('name')), jsToDart);
+      stack = consumeAndFree(getPropertyAtom(value, atom('stack')), jsToDart);
+      message = consumeAndFree(getPropertyAtom(value, atom('message')), jsToDart);
     } else {
       message = getString(value);
     }
@@ -480,13 +700,22 @@ class QuickJSVm extends Vm implements Disposable {
    *
    */
   JSValuePointer newFunction(String? name, JSToDartFunction fn) {
-    final fnId = ++_fnNextId;
-    _fnMap[fnId] = fn;
+    final int fnId;
+    if(_freeFnIds.isNotEmpty) {
+      fnId = _freeFnIds.removeLast();
+      _fns[fnId] = fn;
+    } else {
+      fnId = _fns.length;
+      _fns.add(fn);
+      _fnGenerations.add(0);
+    }
+    if(_cleanHandleMark != null) {
+      _sessionFnIds.add(fnId);
+    }
 
-    final fnIdHandle = newNumber(fnId.toDouble());
     HeapCharPointer namePtr = name == null ? nullptr : name.toNativeUtf8();
     final funcHandle = this._heapValueHandle(
-        JS_NewFunction(ctx, fnIdHandle, namePtr));
+        JS_NewFunction(ctx, fnId, _fnGenerations[fnId], namePtr));
     if(name != null) {
       calloc.free(namePtr);
     }
@@ -520,8 +749,12 @@ class QuickJSVm extends Vm implements Disposable {
       JSValuePointer obj, JSValueConstPointer key, JSValuePointer value) {
     JS_SetProp(ctx, obj, key, value);
   }
-  /// [key] is one of String, num or JSValuePointer
+  /// [key] is one of String, num, JSAtomHandle or JSValuePointer
   void setProperty(JSValuePointer obj, dynamic key, JSValuePointer value) {
+    if(key is JSAtomHandle) {
+      setPropertyAtom(obj, key, value);
+      return;
+    }
     if(key is String) {
       consumeAndFree(newString(key), (k) => setProp(obj, k, value));
       return;
@@ -545,8 +778,14 @@ class QuickJSVm extends Vm implements Disposable {
   JSValuePointer getProp(JSValuePointer obj, JSValueConstPointer key) {
     return _heapValueHandle(JS_GetProp(ctx, obj, key));
   }
-  /// [key] is one of String, num or JSValuePointer
+  /// [key] is one of String, num, JSAtomHandle or JSValuePointer
   JSValuePointer getProperty(JSValuePointer obj, dynamic key) {
+    if(key is JSAtomHandle) {
+      return getPropertyAtom(obj, key);
+    }
+    if(key is int && key >= 0 && key < 0xffffffff) {
+      return getIndexed(obj, key);
+    }
     if(key is String) {
       return consumeAndFree(newString(key), (k) => getProp(obj, k));
     }
@@ -559,11 +798,48 @@ class QuickJSVm extends Vm implements Disposable {
     return getProp(obj, key);
   }
 
+  /// `obj.length` as an integer.
+  int getLength(JSValuePointer obj) {
+    final length = JS_GetLength(ctx, obj);
+    if(length < 0) {
+      throw extractError(JS_GetException(ctx));
+    }
+    return length;
+  }
+
+  /// `obj[index]` without creating a key.
+  JSValuePointer getIndexed(JSValuePointer obj, int index) {
+    return _heapValueHandle(JS_GetIndexed(ctx, obj, index));
+  }
+
+  /// Handles of the elements of [array], read with a single native call when it is a plain array without holes.
+  List<JSValuePointer> getArrayElements(JSValuePointer array) {
+    final capacity = _scratchSize ~/ sizeOf<IntPtr>();
+    final out = _scratch(_scratchSize).cast<JSValuePointer>();
+    int count = JS_GetFastArrayElements(ctx, array, out, capacity);
+    if(count < 0) {
+      return List.generate(getLength(array), (i) => getIndexed(array, i));
+    }
+    if(count <= capacity) {
+      return List.generate(count, (i) => _heapValueHandle(out[i]));
+    }
+    final large = malloc<JSValuePointer>(count);
+    try {
+      count = JS_GetFastArrayElements(ctx, array, large, count);
+      return List.generate(count, (i) => _heapValueHandle(large[i]));
+    } finally {
+      malloc.free(large);
+    }
+  }
+
   bool hasProp(JSValuePointer obj, JSValueConstPointer key) {
     return JS_HasProp(ctx, obj, key) == 1;
   }
 
   bool hasProperty(JSValuePointer obj, dynamic key) {
+    if(key is JSAtomHandle) {
+      return hasPropertyAtom(obj, key);
+    }
     if(key is String) {
       return consumeAndFree(newString(key), (k) => hasProp(obj, k));
     }
@@ -576,6 +852,54 @@ class QuickJSVm extends Vm implements Disposable {
     return hasProp(obj, key);
   }
 
+  final Map<String, JSAtomHandle> _atoms = {};
+
+  /// The atom of the property [name], created on first use and kept until this vm is disposed.
+  ///
+  /// Meant for the names a hot path accesses over and over, e.g. `length` or `then`.
+  JSAtomHandle atom(String name) {
+    JSAtomHandle? result = _atoms[name];
+    if(result == null) {
+      final namePtr = name.toNativeUtf8();
+      final atom = JS_NewAtomLen(ctx, namePtr, namePtr.length);
+      calloc.free(namePtr);
+      if(atom == 0) {
+        throw extractError(JS_GetException(ctx));
+      }
+      result = _atoms[name] = JSAtomHandle._(name, atom);
+    }
+    return result;
+  }
+
+  /// `obj[key]` with an interned [key], see [atom].
+  JSValuePointer getPropertyAtom(JSValuePointer obj, JSAtomHandle key) {
+    return _heapValueHandle(JS_GetProperty(ctx, obj, key.atom));
+  }
+
+  /// `obj[key] = value` with an interned [key], see [atom].
+  void setPropertyAtom(JSValuePointer obj, JSAtomHandle key, JSValuePointer value) {
+    if(JS_SetProperty(ctx, obj, key.atom, value) < 0) {
+      throw extractError(JS_GetException(ctx));
+    }
+  }
+
+  /// `key in obj` with an interned [key], see [atom].
+  bool hasPropertyAtom(JSValuePointer obj, JSAtomHandle key) {
+    return JS_HasProperty(ctx, obj, key.atom) == 1;
+  }
+
+  /// Define a data property of [obj] with an interned [key], see [atom].
+  void definePropertyAtom(JSValuePointer obj, JSAtomHandle key, JSValuePointer value, {
+    bool configurable = true,
+    bool enumerable = true,
+    bool writable = true,
+  }) {
+    final flags = (configurable ? JS_PROP_CONFIGURABLE : 0) | (enumerable ? JS_PROP_ENUMERABLE : 0) | (writable ? JS_PROP_WRITABLE : 0);
+    if(JS_DefinePropertyValue(ctx, obj, key.atom, value, flags) < 0) {
+      throw extractError(JS_GetException(ctx));
+    }
+  }
+
   /**
    * [`Object.defineProperty(handle, key, descriptor)`](https://developer.mozilla.org/en-US/docs/Web/JavaScript/Reference/Global_Objects/Object/defineProperty).
    *
@@ -645,20 +969,8 @@ class QuickJSVm extends Vm implements Disposable {
     [JSValuePointer? thisVal,
       List<JSValuePointer>? args]
   ) {
-    Lifetime<JSValueConstPointerPointer>? argv;
-    int argc;
-    if(args?.isNotEmpty != true) {
-      argc = 0;
-    } else {
-      argc = args!.length;
-      argv = _toPointerArray(args);
-    }
-    final resultPtr;
-    try {
-      resultPtr = JS_Call(ctx, func, thisVal??$undefined, argc, argv?.value??nullptr);
-    } finally {
-      argv?.dispose();
-    }
+    final argc = _writeArgs(args);
+    final resultPtr = JS_CallArgs(ctx, func, thisVal??$undefined, argc);
 
     JSError? error = resolveError(resultPtr);
     if(error != null) {
@@ -667,6 +979,24 @@ class QuickJSVm extends Vm implements Disposable {
     return _heapValueHandle(resultPtr);
   }
 
+  /// Like [callFunction], but store the returned value in [result], replacing (and freeing) its previous value.
+  ///
+  /// Calling a function in a loop this way creates no handle per call.
+  void callFunctionInto(
+    JSValuePointer result,
+    JSValuePointer func,
+    [JSValuePointer? thisVal,
+      List<JSValuePointer>? args]
+  ) {
+    if(!_heapValues.contains(result)) {
+      throw ArgumentError.value(result, 'result', 'not a live handle of this vm');
+    }
+    final argc = _writeArgs(args);
+    if(JS_CallArgsInto(ctx, func, thisVal??$undefined, argc, result) != 0) {
+      throw extractError(JS_GetException(ctx));
+    }
+  }
+
   void callVoidFunction(JSValuePointer func,
       [JSValuePointer? thisVal,
         List<JSValuePointer>? args]) {
@@ -674,20 +1004,8 @@ class QuickJSVm extends Vm implements Disposable {
   }
 
   JSValuePointer callConstructor(JSValuePointer constructor, [List<JSValuePointer>? args]) {
-    Lifetime<JSValueConstPointerPointer>? argv;
-    int argc;
-    if(args?.isNotEmpty != true) {
-      argc = 0;
-    } else {
-      argc = args!.length;
-      argv = _toPointerArray(args);
-    }
-    final resultPtr;
-    try {
-      resultPtr = JS_CallConstructor(ctx, constructor, argc, argv?.value??nullptr);
-    } finally {
-      argv?.dispose();
-    }
+    final argc = _writeArgs(args);
+    final resultPtr = JS_CallConstructorArgs(ctx, constructor, argc);
 
     JSError? error = resolveError(resultPtr);
     if(error != null) {
@@ -705,9 +1023,8 @@ class QuickJSVm extends Vm implements Disposable {
    * See [[unwrapResult]], which will throw if the function returned an error, or
    * return the result handle directly.
    *
-   * *Note*: to protect against infinite loops, provide an interrupt handler to
-   * [[setInterruptHandler]]. You can use [[shouldInterruptAfterDeadline]] to
-   * create a time-based deadline.
+   * *Note*: to protect against infinite loops, use [[setExecutionTimeout]] or
+   * [[setOpBudget]], or provide an interrupt handler to [[setInterruptHandler]].
    *
    *
    * @returns The last statement's value. If the code threw, result `error` will be
@@ -715,16 +1032,96 @@ class QuickJSVm extends Vm implements Disposable {
    * have name `InternalError` and message `interrupted`.
    */
   JSValuePointer evalCode(String code, {String? filename, bool module = false}) {
+    final evalFlags = module ? JSEvalFlag.MODULE : JSEvalFlag.GLOBAL;
+    if(bytecodeCache != null) {
+      return _evalCached(code, filename??'<eval.js>', evalFlags);
+    }
     HeapCharPointer codeHandle = code.toNativeUtf8();
     HeapCharPointer filenameHandle = (filename??'<eval.js>').toNativeUtf8();
     late final resultPtr;
     try {
-      resultPtr = JS_Eval(ctx, codeHandle, codeHandle.length, filenameHandle, module ? JSEvalFlag.MODULE : JSEvalFlag.GLOBAL);
+      resultPtr = JS_Eval(ctx, codeHandle, codeHandle.length, filenameHandle, evalFlags);
+    } finally {
+      malloc.free(codeHandle);
+      malloc.free(filenameHandle);
+    }
+
+    JSError? error = resolveError(resultPtr);
+    if(error != null) {
+      throw error;
+    }
+    return _heapValueHandle(resultPtr);
+  }
+
+  /// Compile [code] without running it, the returned bytecode can be run by [evalBytecode] in any vm.
+  ///
+  /// Throws a [JSError] if [code] has a syntax error.
+  Uint8List compile(String code, {String? filename, bool module = false}) {
+    HeapCharPointer codeHandle = code.toNativeUtf8();
+    HeapCharPointer filenameHandle = (filename??'<eval.js>').toNativeUtf8();
+    final plen = calloc<IntPtr>();
+    try {
+      final buff = JS_CompileToBytecode(ctx, codeHandle, codeHandle.length, filenameHandle, module ? JSEvalFlag.MODULE : JSEvalFlag.GLOBAL, plen);
+      if(buff == nullptr) {
+        throw extractError(JS_GetException(ctx));
+      }
+      final result = Uint8List.fromList(buff.asTypedList(plen.value));
+      JS_FreeBuffer(buff);
+      return result;
     } finally {
       malloc.free(codeHandle);
       malloc.free(filenameHandle);
+      calloc.free(plen);
+    }
+  }
+
+  /// Run [bytecode] produced by [compile], like [evalCode] does for source.
+  JSValuePointer evalBytecode(Uint8List bytecode) {
+    final buff = calloc<Uint8>(bytecode.length);
+    late final JSValuePointer resultPtr;
+    try {
+      buff.asTypedList(bytecode.length).setAll(0, bytecode);
+      resultPtr = JS_EvalBytecode(ctx, buff, bytecode.length);
+    } finally {
+      calloc.free(buff);
+    }
+    JSError? error = resolveError(resultPtr);
+    if(error != null) {
+      throw error;
     }
+    return _heapValueHandle(resultPtr);
+  }
 
+  static String? _version;
+  /// QuickJS version, bytecode is only valid for the version it was compiled by.
+  static String get version => _version ??= JS_GetVersion().toDartString();
+
+  /// Evaluate [code] from its cached bytecode, on a miss it is compiled and evaluated in one pass.
+  JSValuePointer _evalCached(String code, String filename, int evalFlags) {
+    final cache = bytecodeCache!;
+    final key = BytecodeCache.keyOf(version, filename, evalFlags, code);
+    final bytecode = cache.get(key);
+    if(bytecode != null) {
+      return evalBytecode(bytecode);
+    }
+    HeapCharPointer codeHandle = code.toNativeUtf8();
+    HeapCharPointer filenameHandle = filename.toNativeUtf8();
+    final pbuff = calloc<Pointer<Uint8>>();
+    final plen = calloc<IntPtr>();
+    late final JSValuePointer resultPtr;
+    try {
+      resultPtr = JS_EvalToBytecode(ctx, codeHandle, codeHandle.length, filenameHandle, evalFlags, pbuff, plen);
+      final buff = pbuff.value;
+      if(buff != nullptr) {
+        cache.put(key, Uint8List.fromList(buff.asTypedList(plen.value)));
+        JS_FreeBuffer(buff);
+      }
+    } finally {
+      malloc.free(codeHandle);
+      malloc.free(filenameHandle);
+      calloc.free(pbuff);
+      calloc.free(plen);
+    }
     JSError? error = resolveError(resultPtr);
     if(error != null) {
       throw error;
@@ -732,6 +1129,38 @@ class QuickJSVm extends Vm implements Disposable {
     return _heapValueHandle(resultPtr);
   }
 
+  /// Load the module [moduleName] for [_ES6ModuleLoader] from its cached bytecode. On a miss the module is compiled
+  /// straight into this vm and its bytecode cached, returns [JSModuleLoaderResult.COMPILED].
+  int _loadCachedModule(String source, String moduleName, Pointer<Pointer<Utf8>> buffPointer, Pointer<IntPtr> lenPointer) {
+    final cache = bytecodeCache!;
+    final key = BytecodeCache.keyOf(version, moduleName, JSEvalFlag.MODULE, source);
+    final bytecode = cache.get(key);
+    if(bytecode != null) {
+      final buff = JS_NewBuffer(bytecode.length);
+      buff.asTypedList(bytecode.length).setAll(0, bytecode);
+      buffPointer[0] = buff.cast();
+      lenPointer.value = bytecode.length;
+      return JSModuleLoaderResult.BYTECODE;
+    }
+    HeapCharPointer codeHandle = source.toNativeUtf8();
+    HeapCharPointer nameHandle = moduleName.toNativeUtf8();
+    final plen = calloc<IntPtr>();
+    try {
+      final buff = JS_CompileModule(ctx, codeHandle, codeHandle.length, nameHandle, plen);
+      if(buff == nullptr) {
+        // let the native loader compile the source again, so the error is reported to the importer.
+        return JSModuleLoaderResult.NOT_FOUND;
+      }
+      cache.put(key, Uint8List.fromList(buff.asTypedList(plen.value)));
+      JS_FreeBuffer(buff);
+      return JSModuleLoaderResult.COMPILED;
+    } finally {
+      malloc.free(codeHandle);
+      malloc.free(nameHandle);
+      calloc.free(plen);
+    }
+  }
+
   T evalAndConsume<T>(String code, T map(JSValuePointer ptr)) {
     return consumeAndFree(evalCode(code), map);
   }
@@ -751,7 +1180,7 @@ class QuickJSVm extends Vm implements Disposable {
    * that stopped execution.
    */
   int executePendingJobs([int maxJobsToExecute = -1]) {
-    final resultValue = JS_ExecutePendingJob(rt, maxJobsToExecute);
+    final resultValue = JS_ExecutePendingJob(rt, ctx, maxJobsToExecute);
     final typeOfRet = this.typeof(resultValue);
     if (typeOfRet == 'number') {
       final executedJobs = this.getNumber(resultValue)!.toInt();
@@ -786,18 +1215,23 @@ class QuickJSVm extends Vm implements Disposable {
       return null /*undefined*/;
     }
 
-    final str = JS_Dump(ctx, value);
+    if (type == 'function') {
+      return getString(value);
+    }
     try {
-      return jsonDecode(str.toDartString());
-    } catch (err) {
-      return str;
+      return _deserialize(value, JS_SERIALIZE_JSON | JS_SERIALIZE_DUMP);
+    } on JSError {
+      // e.g. a cycle
+      return getString(value);
     }
   }
 
   /// Convert JS [value] to Dart value.
   ///
-  /// **Note:** For `ArrayBuffer` value, the return value is just pointed to the uint8_t* data hold by the js value.
-  /// The returned value need to be copied(`Uint8List.fromList(..)`) to be available after this js value is freed.
+  /// Arrays and objects are converted with a single native call, see [JSValueDecoder].
+  ///
+  /// **Note:** An `ArrayBuffer` or typed array is returned as a view of its memory, shared with the js value and
+  /// kept alive after it is freed, see [ExternalBuffer]. `ArrayBuffer`s nested in arrays or objects are always copied.
   dynamic jsToDart(JSValuePointer value) {
     if(value == $undefined) {
       return reserveUndefined ? DART_UNDEFINED : null;
@@ -840,28 +1274,42 @@ class QuickJSVm extends Vm implements Disposable {
       };
     }
     if(type == JSHandyType.js_Date) {
-      int timestamp = getInt(value)!;
-      return constructDate ? DateTime.fromMillisecondsSinceEpoch(timestamp) : timestamp;
+      final time = getNumber(value)!;
+      // an invalid date has no timestamp.
+      if(time.isNaN) {
+        return null;
+      }
+      return constructDate ? DateTime.fromMillisecondsSinceEpoch(time.toInt()) : time.toInt();
     }
     if(type == JSHandyType.js_ArrayBuffer || type == JSHandyType.js_SharedArrayBuffer) {
-      final psize = calloc<IntPtr>();
-      final buff = JS_GetArrayBuffer(ctx, psize, value);
-      Uint8List result = buff.asTypedList(psize.value);
-      calloc.free(psize);
-      // Note: this value will be unavailable when the binding ArrayBuffer is freed.
-      return result;
+      final psize = _scratch(sizeOf<IntPtr>()).cast<IntPtr>();
+      final buff = JS_RetainArrayBuffer(ctx, value, psize);
+      if(buff == nullptr) {
+        throw extractError(JS_GetException(ctx));
+      }
+      // the view keeps the memory alive after the ArrayBuffer is freed, and shares it with the ArrayBuffer.
+      return ExternalBuffer.adopt(buff, psize.value).bytes;
+    }
+    if(type == JSHandyType.js_TypedArray) {
+      final intSize = sizeOf<IntPtr>();
+      final out = _scratch(intSize * 3 + sizeOf<Int32>());
+      final psize = out.cast<IntPtr>();
+      final ptype = out.elementAt(intSize * 3).cast<Int32>();
+      final buff = JS_RetainTypedArray(ctx, value, psize, psize.elementAt(1), psize.elementAt(2), ptype);
+      if(buff == nullptr) {
+        throw extractError(JS_GetException(ctx));
+      }
+      final elementType = ptype.value;
+      final length = psize[2] ~/ JSTypedArrayType.elementSizes[elementType];
+      // a view of the ArrayBuffer of the typed array, sharing its memory like ArrayBuffers do.
+      return ExternalBuffer.adopt(buff, psize[0]).typedView(elementType, psize[1], length);
     }
     if(type == JSHandyType.js_Array) {
-      int length = consumeAndFree(getProperty(value, 'length'), (_) => getNumber(_)!.toInt());
-      List result = [];
-      for (int i = 0; i < length; i++) {
-        result.add(consumeAndFree(getProperty(value, i), (_) => jsToDart(_)));
-      }
-      return result;
+      return _deserialize(value);
     }
     if(type == JSHandyType.js_Promise) {
       Completer completer = Completer();
-      final thenPtr = getProperty(value, 'then');
+      final thenPtr = getPropertyAtom(value, atom('then'));
       final onFulfilled = newFunction('promise_onFulfilled', (args, {thisObj}) {
         _completers.remove(completer);
         completer.complete(args.isEmpty ? null : jsToDart(args[0]));
@@ -877,6 +1325,7 @@ class QuickJSVm extends Vm implements Disposable {
         // complete when the promise is resolved/rejected.
         return completer.future;
       } finally {
+        _freeJSValue(thenPtr);
         _freeJSValue(onFulfilled);
         _freeJSValue(onError);
       }
@@ -912,31 +1361,8 @@ class QuickJSVm extends Vm implements Disposable {
     //   malloc.free(ptab);
     //   return result;
     // }
-    if (type == JSHandyType.js_object && !jsonSerializeObject) {
-      final atomsPtrRec = calloc<IntPtr>();
-      final length = JS_GetOwnPropertyNameAtoms(ctx, atomsPtrRec, value, JS_GPN_COPYABLE);
-      if(length <= 0) {
-        calloc.free(atomsPtrRec);
-        if(length < 0) {
-          throw JSError('"Could not get object properties');
-        }
-        return {};
-      }
-      final Map<String, dynamic> result = {};
-      Pointer<Uint32> atomsPtr = Pointer<Uint32>.fromAddress(atomsPtrRec.value);
-      calloc.free(atomsPtrRec);
-      final atoms = atomsPtr.asTypedList(length);
-      for(int i = 0;i < length;i++) {
-        int atom = atoms[i];
-        final atomStr = JS_AtomToString(ctx, atom);
-        String key = getString(atomStr);
-        JS_FreeValuePointer(ctx, atomStr);
-        final propValue = JS_GetProperty(ctx, value, atom);
-        result[key] = jsToDart(propValue);
-        JS_FreeValuePointer(ctx, propValue);
-      }
-      calloc.free(atomsPtr);
-      return result;
+    if (type == JSHandyType.js_object) {
+      return _deserialize(value, jsonSerializeObject ? JS_SERIALIZE_JSON : null);
     }
     // fallback
     String str = JSONStringify(value);
@@ -950,6 +1376,39 @@ class QuickJSVm extends Vm implements Disposable {
     }
   }
 
+  /// Convert the whole value graph of an array or object [value] with a single native call.
+  ///
+  /// Values the serializer does not handle itself (functions, promises, errors, ...) are passed back as handles
+  /// and converted by [jsToDart]. With [JS_SERIALIZE_JSON] in [flags], the result is what `jsonDecode` returns for
+  /// `JSON.stringify(value)`, without the JSON string in between.
+  dynamic _deserialize(JSValuePointer value, [int? flags]) {
+    flags ??= jsonSerializeObject ? JS_SERIALIZE_OBJECT_AS_HANDLE : 0;
+    final plen = calloc<IntPtr>();
+    final buff = JS_Serialize(ctx, value, flags, plen);
+    final length = plen.value;
+    calloc.free(plen);
+    if(buff == nullptr) {
+      throw extractError(JS_GetException(ctx));
+    }
+    try {
+      return JSValueDecoder(
+        buff.asTypedList(length),
+        undefinedValue: reserveUndefined ? DART_UNDEFINED : null,
+        constructDate: constructDate,
+        jsonNumbers: flags & JS_SERIALIZE_JSON != 0,
+        resolveHandle: (handle) {
+          try {
+            return jsToDart(handle);
+          } finally {
+            JS_FreeValuePointer(ctx, handle);
+          }
+        },
+      ).decode();
+    } finally {
+      JS_FreeBuffer(buff);
+    }
+  }
+
   /// If [value] is dart function, it must be able to cast to [JSToDartFunction].
   ///
   /// [value] must be able to be serialize to JSON through `jsonEncode` if it is not one of the supported types.
@@ -988,27 +1447,122 @@ class QuickJSVm extends Vm implements Disposable {
       }
       return newNumber(value.millisecondsSinceEpoch);
     }
+    if(value is TypedData && value is! Uint8List && ExternalBuffer.typeOf(value) != null) {
+      return newTypedArray(value);
+    }
     if(value is TypedData && value is List<int>) {
-      Uint8List list = value is Uint8List ? value : value.buffer.asUint8List();
+      // a Uint8List is passed as is: ExternalBuffer.of finds the views of external buffers by identity.
+      Uint8List list = value is Uint8List ? value : value.buffer.asUint8List(value.offsetInBytes, value.lengthInBytes);
       return arrayBufferCopy ? newArrayBufferCopy(list) : newArrayBuffer(list);
     }
     if(value is List) {
-      List<JSValuePointer> elements = value.map((e) => dartToJS(e)).toList();
-      final result = newArray(elements);
-      elements.forEach((element) => _freeJSValue(element));
-      return result;
+      return _buildValue(value);
     }
     if(value is Future) {
       return newPromise(value).promise.value;
     }
     if(value is Map) {
-      return newObject(value);
+      return _buildValue(value);
     }
     // fallback
     String json = jsonEncode(value);
     return evalCode('($json)');
   }
 
+  /// Build a List or Map [value] with a single native call, see [JSValueEncoder].
+  ///
+  /// Like [newArray] and [newObject], the handles of nested values which are not encoded directly are freed
+  /// once they are copied into the result.
+  JSValuePointer _buildValue(dynamic value) {
+    final List<JSValuePointer> handles = [];
+    final encoder = JSValueEncoder(
+      constructDate: constructDate,
+      toHandle: (v) {
+        final handle = v is Map ? newObject(v) : dartToJS(v);
+        handles.add(handle);
+        return handle;
+      },
+    );
+    late final JSValuePointer resultPtr;
+    try {
+      encoder.encode(value);
+      final bytes = encoder.bytes;
+      final buff = calloc<Uint8>(bytes.length);
+      try {
+        buff.asTypedList(bytes.length).setAll(0, bytes);
+        resultPtr = JS_BuildValue(ctx, buff, bytes.length);
+      } finally {
+        calloc.free(buff);
+      }
+    } finally {
+      handles.forEach((handle) => _freeJSValue(handle));
+    }
+    JSError? error = resolveError(resultPtr);
+    if(error != null) {
+      throw error;
+    }
+    return _heapValueHandle(resultPtr);
+  }
+
+  /// Run the operations of [batch] with a single native call, see [QuickJSBatch].
+  QuickJSBatchResult execBatch(QuickJSBatch batch) {
+    final bytes = batch.bytes;
+    final handles = batch.handles;
+    final resultCount = batch.resultCount;
+    // not the scratch buffer, host functions called by the batch may use it.
+    final ops = malloc<Uint8>(bytes.length == 0 ? 1 : bytes.length);
+    final handlesPtr = calloc<JSValueConstPointer>(handles.length == 0 ? 1 : handles.length);
+    final resultsPtr = calloc<JSValuePointer>(resultCount == 0 ? 1 : resultCount);
+    final out = calloc<Pointer<Uint8>>();
+    final outLen = calloc<IntPtr>();
+    try {
+      ops.asTypedList(bytes.length).setAll(0, bytes);
+      for(int i = 0; i < handles.length; i++) {
+        handlesPtr[i] = handles[i];
+      }
+      final status = JS_ExecBatch(ctx, ops, bytes.length, handlesPtr, handles.length, resultsPtr, resultCount,
+          jsonSerializeObject ? JS_SERIALIZE_OBJECT_AS_HANDLE : 0, out, outLen);
+      if(status != 0) {
+        throw extractError(JS_GetException(ctx));
+      }
+      final results = List<JSValuePointer>.generate(resultCount, (i) {
+        final ptr = resultsPtr[i];
+        return ptr == nullptr ? $undefined : _heapValueHandle(ptr);
+      });
+      final reads = [];
+      if(out.value != nullptr) {
+        try {
+          final decoder = JSValueDecoder(
+            out.value.asTypedList(outLen.value),
+            undefinedValue: reserveUndefined ? DART_UNDEFINED : null,
+            constructDate: constructDate,
+            resolveHandle: (handle) {
+              try {
+                return jsToDart(handle);
+              } finally {
+                JS_FreeValuePointer(ctx, handle);
+              }
+            },
+          );
+          for(int i = 0; i < batch.readCount; i++) {
+            reads.add(decoder.decode());
+          }
+        } finally {
+          JS_FreeBuffer(out.value);
+        }
+      }
+      return QuickJSBatchResult(results, reads);
+    } finally {
+      malloc.free(ops);
+      calloc.free(handlesPtr);
+      calloc.free(resultsPtr);
+      calloc.free(out);
+      calloc.free(outLen);
+      batch.ownedHandles.forEach(_freeJSValue);
+      batch.ownedHandles.clear();
+    }
+  }
+
   InterruptHandler? _interruptHandler;
 
   /**
@@ -1026,6 +1580,29 @@ class QuickJSVm extends Vm implements Disposable {
     }
   }
 
+  /// Interrupt execution once [timeout] has elapsed from now, `null` to remove the deadline.
+  ///
+  /// The deadline is checked natively on each interrupt poll, nothing is called on the Dart side.
+  void setExecutionTimeout(Duration? timeout) {
+    JS_RuntimeSetDeadline(rt, timeout == null ? 0 : JS_GetMonotonicTime() + timeout.inMicroseconds * 1000);
+  }
+
+  /// Interrupt execution after about [ops] more ops, `null` to remove the budget.
+  ///
+  /// Ops are counted natively at the granularity of the interrupt polls, every 10000 ops or so. The budget is
+  /// shared by everything executed until it is set again.
+  void setOpBudget(int? ops) {
+    if(ops != null && ops < 0) {
+      throw JSError('Cannot set op budget to negative number. To unset, pass null');
+    }
+    JS_RuntimeSetOpBudget(rt, ops ?? -1);
+  }
+
+  /// Why execution was last interrupted, reading it resets it to [InterruptReason.none].
+  InterruptReason takeInterruptReason() {
+    return InterruptReason.values[JS_RuntimeTakeInterruptReason(rt)];
+  }
+
   /// Set the max stack [size] this runtime allows.
   ///
   /// Set to `0` to remove the limit.
@@ -1037,7 +1614,7 @@ class QuickJSVm extends Vm implements Disposable {
   }
 
   /**
-   * Set the max memory this runtime can allocate.
+   * Set the max memory this runtime can allocate, the data of its ArrayBuffers included.
    * To remove the limit, set to `-1`.
    */
   void setMemoryLimit(int limitBytes) {
@@ -1049,6 +1626,66 @@ class QuickJSVm extends Vm implements Disposable {
     JS_RuntimeSetMemoryLimit(rt, limitBytes);
   }
 
+  /// Select how the cycle collector scans the heap.
+  ///
+  /// In [GCMode.generational], a minor collection runs every [youngThreshold] objects allocated and only scans
+  /// those, so the pauses no longer grow with the objects kept alive. Cycles reaching objects that survived a
+  /// collection are only freed by a full collection.
+  void setGCMode(GCMode mode, {int youngThreshold = 8192}) {
+    if(youngThreshold < 1) {
+      throw JSError('Cannot set young threshold to $youngThreshold, it must be positive.');
+    }
+    JS_RuntimeSetGCMode(rt, mode.index, youngThreshold);
+  }
+
+  /// Run an automatic collection once the heap reaches [thresholdBytes], `-1` to only collect with [runGC].
+  ///
+  /// After each automatic collection, the threshold is set [growthPercent] % above the heap size left. A large
+  /// threshold suits throughput-oriented jobs, a small one with a small growth gives frequent short collections.
+  void setGCThreshold(int thresholdBytes, {int growthPercent = 50}) {
+    if(thresholdBytes < 0 && thresholdBytes != -1) {
+      throw JSError('Cannot set GC threshold to negative number. To disable automatic collections, pass -1');
+    }
+    if(growthPercent < 0) {
+      throw JSError('Cannot set GC threshold growth to negative number.');
+    }
+    JS_RuntimeSetGCThreshold(rt, thresholdBytes, growthPercent);
+  }
+
+  /// Run a full collection, or a minor one of [GCMode.generational]. Returns the stats, with the time spent and
+  /// bytes freed by this collection in [GCStats.lastPause] and [GCStats.lastFreedBytes].
+  GCStats runGC({bool minor = false}) {
+    JS_RuntimeRunGC(rt, minor ? JSGCKind.minor : JSGCKind.full);
+    return gcStats;
+  }
+
+  /// Collect when the event loop finds no pending job, once per idle period, see [startEventLoop].
+  bool gcOnIdle = false;
+
+  /// Counters of each size class when the vm uses [RuntimeAllocator.slab], empty otherwise.
+  List<AllocatorSizeClass> get allocatorStats {
+    // 16 size classes and the large blocks.
+    final out = _scratch(17 * 4 * sizeOf<Int64>()).cast<Int64>();
+    final count = JS_RuntimeGetAllocatorStats(rt, out);
+    return List.generate(count, (i) => AllocatorSizeClass(out[i * 4], out[i * 4 + 1], out[i * 4 + 2], out[i * 4 + 3]));
+  }
+
+  /// Collector stats since the vm was created.
+  GCStats get gcStats {
+    final out = _scratch(8 * sizeOf<Int64>()).cast<Int64>();
+    JS_RuntimeGetGCStats(rt, out);
+    return GCStats(
+      out[0],
+      Duration(microseconds: out[1]),
+      out[2],
+      Duration(microseconds: out[3]),
+      Duration(microseconds: out[4]),
+      Duration(microseconds: out[5]),
+      out[6],
+      out[7],
+    );
+  }
+
   /**
    * Compute memory usage for this runtime. Returns the result as a handle to a
    * JSValue object. Use [[dump]] to convert to a native object.
@@ -1103,21 +1740,26 @@ class QuickJSVm extends Vm implements Disposable {
     _disposed = true;
     super.dispose();
     _eventLoop?.cancel();
-    this._heapValues.forEach((val) {
-      // String dp = JS_Dump(ctx, val).toDartString();
-      // print('Pointer:${val.address} $dp');
-      // if(dp == '[unsupported type]') {
-      //   print('unsupported type: ${JS_HandyTypeof(ctx, val)}');
-      // }
-      JS_FreeValuePointer(ctx, val);
-    });
+    // handles still alive are released in bulk by JS_FreeContext.
+    this._heapValues.clear();
+    this._handleScopes.clear();
     this._scope.dispose();
     this._timeoutMap.clear();
-    this._fnMap.clear();
+    this._fns.clear();
+    this._fnGenerations.clear();
+    this._freeFnIds.clear();
+    this._sessionFnIds.clear();
+    if(_scratchBuff != nullptr) {
+      malloc.free(_scratchBuff);
+      _scratchBuff = nullptr;
+    }
     _vmMap.remove(ctx);
+    _atoms.values.forEach((_) => JS_FreeAtom(ctx, _.atom));
+    _atoms.clear();
     JS_FreeContext(ctx);
-    _rtMap.remove(rt);
     JS_FreeRuntime(rt);
+    _vms[_hostId] = null;
+    _freeHostIds.add(_hostId);
     this._completers.forEach((_) {
       _.completeError(JSError('Vm disposed!'));
     });
@@ -1130,7 +1772,11 @@ class QuickJSVm extends Vm implements Disposable {
   Timer? _eventLoop;
   void startEventLoop([int ms = 50]) {
     if(_eventLoop == null) {
-      _eventLoop = Timer.periodic(Duration(milliseconds: ms), (timer) => executePendingJobs());
+      _eventLoop = Timer.periodic(Duration(milliseconds: ms), (timer) {
+        if(executePendingJobs() == 0 && gcOnIdle) {
+          JS_RuntimeRunGC(rt, JSGCKind.idle);
+        }
+      });
     }
   }
 
@@ -1141,8 +1787,16 @@ class QuickJSVm extends Vm implements Disposable {
     }
   }
 
-  var _fnNextId = 0;
-  var _fnMap = new Map<int, JSToDartFunction>();
+  late final int _hostId;
+  /// functions created by [newFunction], indexed by the id carried in the `magic` of their JS function.
+  final List<JSToDartFunction?> _fns = [];
+  /// generation of each id of [_fns], bumped when [reset] frees the id. A JS function only dispatches to the
+  /// callback of its id while the generation it was created with is the current one.
+  final List<int> _fnGenerations = [];
+  /// ids freed by [reset], reused by [newFunction].
+  final List<int> _freeFnIds = [];
+  /// ids given out since [markClean].
+  final List<int> _sessionFnIds = [];
 
   /**
    * @hidden
@@ -1151,20 +1805,20 @@ class QuickJSVm extends Vm implements Disposable {
   /// CToHostCallbackFunctionImplementation
   JSValuePointer cToHostCallbackFunction(
     ctx,
+    fnId,
+    fnGeneration,
     this_ptr,
     argc,
     argv,
-    fn_data,
   ) {
     if (ctx != ctx) {
       throw JSError(
           'QuickJSVm instance received C -> JS call with mismatched ctx');
     }
 
-    final fnId = JS_GetFloat64(ctx, fn_data).toInt();
-    final fn = _fnMap[fnId];
+    final fn = fnId < _fns.length && _fnGenerations[fnId] == fnGeneration ? _fns[fnId] : null;
     if (fn == null) {
-      throw JSError('QuickJSVm had no callback with id $fnId');
+      throw JSError('QuickJSVm had no callback with id $fnId (generation $fnGeneration)');
     }
 
     final thisHandle = this_ptr;
@@ -1223,6 +1877,9 @@ class QuickJSVm extends Vm implements Disposable {
     if(!removed) {
       throw 'freeing ptr not hold!';
     }
+    for(final scoped in _handleScopes) {
+      scoped.remove(ptr);
+    }
     JS_FreeValuePointer(ctx, ptr);
   }
 
@@ -1231,9 +1888,96 @@ class QuickJSVm extends Vm implements Disposable {
       return ptr;
     }
     _heapValues.add(ptr);
+    if(_handleScopes.isNotEmpty) {
+      _handleScopes.last.add(ptr);
+    }
+    return ptr;
+  }
+
+  /// Run [fn] inside a handle scope.
+  ///
+  /// Every handle created while [fn] runs is freed in a single native call when [fn] returns,
+  /// unless it was passed to [escapeHandle]. Handles created outside the scope are not affected.
+  T withHandleScope<T>(T fn()) {
+    final mark = JS_OpenHandleScope(ctx);
+    _handleScopes.add(Set());
+    try {
+      return fn();
+    } finally {
+      final scoped = _handleScopes.removeLast();
+      _heapValues.removeAll(scoped);
+      JS_CloseHandleScope(ctx, mark);
+    }
+  }
+
+  /// Keep [ptr] alive after the enclosing handle scopes are closed, it must then be freed explicitly.
+  JSValuePointer escapeHandle(JSValuePointer ptr) {
+    if(_handleScopes.isEmpty) {
+      return ptr;
+    }
+    for(final scoped in _handleScopes) {
+      scoped.remove(ptr);
+    }
+    JS_EscapeHandle(ctx, ptr);
     return ptr;
   }
 
+  /// Number of handles currently held by this vm on the native side.
+  int get liveHandleCount => JS_GetLiveHandleCount(ctx);
+
+  /// Number of ids given to the functions created by [newFunction], the ids freed by [reset] are reused.
+  int get functionIdCount => _fns.length;
+
+  int? _cleanHandleMark;
+
+  /// Capture the current state of this vm as the one [reset] returns to.
+  ///
+  /// Handles created before this call are kept by [reset], handles created after are freed.
+  void markClean() {
+    if(JS_SnapshotGlobals(ctx) < 0) {
+      throw extractError(JS_GetException(ctx));
+    }
+    if(_cleanHandleMark != null) {
+      // handles of the previous clean state become part of the new one.
+      _handleScopes.removeAt(0).toList().forEach(escapeHandle);
+    }
+    _cleanHandleMark = JS_OpenHandleScope(ctx);
+    _handleScopes.insert(0, Set());
+    // functions created so far belong to the clean state.
+    _sessionFnIds.clear();
+  }
+
+  /// Put this vm back to the state captured by [markClean], so it can be reused instead of disposed.
+  ///
+  /// Globals are restored, pending jobs and timers are dropped, pending futures complete with an error, and
+  /// every handle and function created since [markClean] is freed. Objects reachable from the globals, such as
+  /// builtin prototypes, are not reverted: the freed functions they still hold return `undefined` when called.
+  void reset() {
+    final mark = _cleanHandleMark;
+    if(mark == null) {
+      throw JSError('markClean must be called before reset');
+    }
+    _timeoutMap.clear();
+    final completers = List<Completer>.from(_completers);
+    _completers.clear();
+    completers.forEach((_) => _.completeError(JSError('Vm recycled!')));
+    final failed = JS_ResetGlobals(ctx) < 0;
+    _heapValues.removeAll(_handleScopes.first);
+    _handleScopes.first.clear();
+    JS_CloseHandleScope(ctx, mark);
+    // a function of this session kept by an object that survives the reset must not call the one registered by
+    // the next session under the same id, its generation no longer matches.
+    for(final id in _sessionFnIds) {
+      _fns[id] = null;
+      _fnGenerations[id] = (_fnGenerations[id] + 1) & 0x7fffffff;
+      _freeFnIds.add(id);
+    }
+    _sessionFnIds.clear();
+    if(failed) {
+      throw extractError(JS_GetException(ctx));
+    }
+  }
+
   T consumeAndFree<T>(JSValuePointer ptr, T map(JSValuePointer ptr)) {
     try {
       return map(ptr);
@@ -1242,14 +1986,36 @@ class QuickJSVm extends Vm implements Disposable {
     }
   }
 
-  Lifetime<JSValueConstPointerPointer> _toPointerArray(
-      List<JSValuePointer> array) {
-    final JSValueConstPointerPointer ptr =
-    calloc.call<JSValueConstPointer>(array.length);
-    for (int i = 0; i < array.length; i++) {
-      ptr[i] = array[i];
+  static final int _jsValueWords = JS_SizeOfJSValue() ~/ sizeOf<Uint64>();
+  Pointer<Uint64> _argArena = nullptr;
+  int _argArenaCapacity = 0;
+
+  /// Copy the values of [args] into the argument arena of the context and return their count.
+  ///
+  /// The arena is only asked for again when it must grow, so a call allocates nothing, the values stay owned by
+  /// their handles.
+  int _writeArgs(List<JSValuePointer>? args) {
+    if(args == null || args.isEmpty) {
+      return 0;
+    }
+    final argc = args.length;
+    if(argc > _argArenaCapacity) {
+      final arena = JS_GetArgArena(ctx, argc);
+      if(arena == nullptr) {
+        throw JSError('Out of memory for $argc arguments');
+      }
+      _argArena = arena.cast<Uint64>();
+      _argArenaCapacity = argc;
+    }
+    final words = _jsValueWords;
+    int offset = 0;
+    for(int i = 0; i < argc; i++) {
+      final value = args[i].cast<Uint64>();
+      for(int w = 0; w < words; w++) {
+        _argArena[offset++] = value[w];
+      }
     }
-    return _scope.manage(Lifetime(ptr, (ptr) => calloc.free(ptr)));
+    return argc;
   }
 
   Lifetime<JSValuePointerPointer> _newMutablePointerArray(int length) {
@@ -1261,17 +2027,19 @@ class QuickJSVm extends Vm implements Disposable {
   /// CToHostCallbackFunctionImplementation
   static JSValuePointer? _cToHostCallbackFunction(
       JSContextPointer ctx,
+      int hostId,
+      int fnId,
+      int fnGeneration,
       JSValuePointer this_ptr,
       int argc,
-      JSValuePointer argv,
-      JSValuePointer fn_data_ptr) {
+      JSValuePointer argv) {
     try {
-      final vm = _vmMap[ctx];
+      final vm = _vms[hostId];
       if (vm == null) {
         throw JSError(
-            'QuickJSVm(ctx = ${ctx}) not found for C function call "${fn_data_ptr}"');
+            'QuickJSVm(ctx = ${ctx}) not found for C function call "${fnId}"');
       }
-      return vm.cToHostCallbackFunction(ctx, this_ptr, argc, argv, fn_data_ptr);
+      return vm.cToHostCallbackFunction(ctx, fnId, fnGeneration, this_ptr, argc, argv);
     } catch (error) {
       print('[C to host error: returning null]\n$error');
       return nullptr;
@@ -1279,9 +2047,9 @@ class QuickJSVm extends Vm implements Disposable {
   }
 
   /// CToHostInterruptImplementation
-  static int _cToHostInterrupt(JSRuntimePointer rt) {
+  static int _cToHostInterrupt(JSRuntimePointer rt, int hostId) {
     try {
-      final vm = _rtMap[rt];
+      final vm = _vms[hostId];
       if (vm == null) {
         throw JSError('QuickJSVm(rt = ${rt}) not found for C interrupt');
       }
@@ -1294,6 +2062,7 @@ class QuickJSVm extends Vm implements Disposable {
 
   /**
    * Returns an interrupt handler that interrupts Javascript execution after a deadline time.
+   * [[setExecutionTimeout]] does the same without calling into Dart on every poll.
    *
    * @param deadline - Interrupt execution if it's still running after this time.
    *   Number values are compared against `Date.now()`
@@ -1302,11 +2071,6 @@ class QuickJSVm extends Vm implements Disposable {
     return (vm) => DateTime.now().millisecondsSinceEpoch > deadline;
   }
 
-  /// JSFreeArrayBufferDataFunc
-  static void _cToHostArrayBufferFreeCallback(JSRuntimePointer rt, Pointer opaque, Pointer<Uint8> ptr) {
-    malloc.free(ptr);
-  }
-
   static int _ES6ModuleLoader(JSContextPointer ctx, Pointer<Pointer<Utf8>> buffPointer, Pointer<IntPtr> lenPointer, Pointer<Utf8> module_name) {
     String moduleName = module_name.toDartString();
     final vm = _vmMap[ctx];
@@ -1315,11 +2079,22 @@ class QuickJSVm extends Vm implements Disposable {
     }
     String? source = vm.es6ModuleLoader!(moduleName);
     if(source == null) {
-      return 0;
+      return JSModuleLoaderResult.NOT_FOUND;
     }
-    final buff = source.toNativeUtf8();
-    buffPointer[0] = buff;
-    lenPointer.value = buff.length;
-    return 1;
+    if(vm.bytecodeCache != null) {
+      final result = vm._loadCachedModule(source, moduleName, buffPointer, lenPointer);
+      if(result != JSModuleLoaderResult.NOT_FOUND) {
+        return result;
+      }
+      // fall through, compiling the source reports the error to the importer.
+    }
+    final bytes = utf8.encode(source);
+    final buff = JS_NewBuffer(bytes.length + 1);
+    final list = buff.asTypedList(bytes.length + 1);
+    list.setAll(0, bytes);
+    list[bytes.length] = 0;
+    buffPointer[0] = buff.cast();
+    lenPointer.value = bytes.length;
+    return JSModuleLoaderResult.SOURCE;
   }
 }
@@ -0,0 +1,112 @@
+import 'dart:async';
+import 'dart:collection';
+
+import 'vm.dart';
+
+/// Prepares a freshly created vm before it enters the pool, e.g. by evaluating shared modules or installing globals.
+///
+/// Everything set up here survives [QuickJSVmPool.release].
+typedef QuickJSVmPreload = void Function(QuickJSVm vm);
+
+/// A pool of pre-warmed [QuickJSVm]s for short-lived scripts.
+///
+/// Creating a runtime and context and running the same setup for every script is the main cost of a short run.
+/// A pooled vm is created and preloaded once, and reset to that clean state with [QuickJSVm.reset] when it is
+/// released, so the next user gets it without paying the setup again.
+class QuickJSVmPool {
+  /// Max number of idle vms kept by this pool, vms released while the pool is full are disposed.
+  final int size;
+  /// Memory limit in bytes of each vm runtime, `null` for no limit.
+  final int? memoryLimit;
+  final QuickJSVmPreload? preload;
+  final QuickJSVm Function() _create;
+  final Queue<QuickJSVm> _idle = Queue();
+  final Set<QuickJSVm> _busy = Set();
+  bool _disposed = false;
+
+  QuickJSVmPool({
+    this.size = 4,
+    this.memoryLimit,
+    this.preload,
+    QuickJSVm Function()? create,
+    bool prewarm = true,
+  }) : _create = create ?? (() => QuickJSVm()) {
+    if (prewarm) {
+      for (int i = 0; i < size; i++) {
+        _idle.add(_newVm());
+      }
+    }
+  }
+
+  /// Number of vms ready to be acquired without creating a new one.
+  int get idleCount => _idle.length;
+
+  /// Number of vms acquired and not released yet.
+  int get busyCount => _busy.length;
+
+  QuickJSVm _newVm() {
+    final vm = _create();
+    try {
+      if (memoryLimit != null) {
+        vm.setMemoryLimit(memoryLimit!);
+      }
+      preload?.call(vm);
+      vm.markClean();
+    } catch (e) {
+      vm.dispose();
+      rethrow;
+    }
+    return vm;
+  }
+
+  /// Take a vm from this pool, a new one is created when no vm is idle.
+  ///
+  /// The vm must be given back with [release], not disposed.
+  QuickJSVm acquire() {
+    if (_disposed) {
+      throw StateError('QuickJSVmPool disposed');
+    }
+    final vm = _idle.isNotEmpty ? _idle.removeFirst() : _newVm();
+    _busy.add(vm);
+    return vm;
+  }
+
+  /// Give [vm] back to this pool, it is reset to its preloaded state before it can be acquired again.
+  void release(QuickJSVm vm) {
+    if (!_busy.remove(vm)) {
+      throw ArgumentError('vm was not acquired from this pool');
+    }
+    if (_disposed || vm.disposed || _idle.length >= size) {
+      vm.dispose();
+      return;
+    }
+    try {
+      vm.reset();
+    } catch (e) {
+      // a vm that cannot be put back to a clean state is not reused.
+      vm.dispose();
+      return;
+    }
+    _idle.add(vm);
+  }
+
+  /// Run [fn] with a vm from this pool, the vm is released when [fn] completes.
+  Future<T> use<T>(FutureOr<T> fn(QuickJSVm vm)) async {
+    final vm = acquire();
+    try {
+      return await fn(vm);
+    } finally {
+      release(vm);
+    }
+  }
+
+  /// Dispose of every idle vm, busy vms are disposed when they are released.
+  void dispose() {
+    if (_disposed) {
+      return;
+    }
+    _disposed = true;
+    _idle.forEach((vm) => vm.dispose());
+    _idle.clear();
+  }
+}
@@ -52,5 +52,8 @@ void main() {
     test('promise in map', () async {
       await testPromiseInMap(vm);
     });
+    test('large object values', () {
+      testLargeObjectValues(vm);
+    });
   });
 }
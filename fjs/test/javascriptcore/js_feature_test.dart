@@ -17,6 +17,9 @@ void main() {
     test('JSONStringify', () async {
       testJSONStringify(vm);
     });
+    test('JSONStringify objects', () {
+      testJSONStringifyObjects(vm);
+    });
   });
   group('ES6', () {
     late JavaScriptCoreVm vm;
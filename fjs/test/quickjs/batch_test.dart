@@ -0,0 +1,67 @@
+import 'package:fjs/error.dart';
+import 'package:fjs/quickjs/vm.dart';
+import 'package:test/test.dart';
+
+void main() {
+  group('QuickJSBatch', () {
+    late QuickJSVm vm;
+    setUp(() {
+      vm = QuickJSVm();
+    });
+    tearDown(() {
+      vm.dispose();
+    });
+
+    test('get, set and read', () {
+      vm.evalCode('var request = {headers: {accept: "*/*"}, url: "https://example.com"};');
+      final batch = QuickJSBatch(vm);
+      final headers = batch.get(vm.global, ['request', 'headers']);
+      batch.set(headers, 'x-count', 3);
+      batch.define(headers, 'hidden', true, enumerable: false);
+      final url = batch.read(batch.get(vm.global, ['request', 'url']));
+      final missing = batch.read(batch.get(vm.global, ['request', 'body', 'length']));
+      final all = batch.read(headers);
+      final result = batch.run();
+      expect(result.reads[url], 'https://example.com');
+      expect(result.reads[missing], isNull);
+      expect(result.reads[all], {'accept': '*/*', 'x-count': 3});
+      expect(vm.jsToDart(vm.getProperty(result[headers], 'hidden')), true);
+    });
+
+    test('call with inline values and results', () {
+      final batch = QuickJSBatch(vm);
+      final fn = batch.value(vm.newFunction('join', (args, {thisObj}) => vm.newString(args.map(vm.jsToDart).join('-'))));
+      final joined = batch.call(fn, null, ['a', 1, batch.call(vm.evalCode('() => "b"'))]);
+      final read = batch.read(joined);
+      batch.free(fn);
+      final result = batch.run();
+      expect(result.reads[read], 'a-1-b');
+      expect(vm.jsToDart(result[joined]), 'a-1-b');
+      expect(result[fn], vm.$undefined);
+    });
+
+    test('no handle leak', () {
+      vm.evalCode('var target = {};');
+      final before = vm.liveHandleCount;
+      for (int i = 0; i < 100; i++) {
+        final batch = QuickJSBatch(vm);
+        final target = batch.get(vm.global, 'target');
+        batch.set(target, 'value', {'i': i, 'fn': (args, {thisObj}) => null});
+        batch.free(target);
+        batch.run();
+      }
+      expect(vm.liveHandleCount, before);
+      expect(vm.jsToDart(vm.evalCode('target.value.i')), 99);
+    });
+
+    test('throws', () {
+      final batch = QuickJSBatch(vm);
+      batch.value([1, 2]);
+      batch.call(vm.evalCode('() => {throw new Error("oops")}'));
+      expect(() => batch.run(), throwsA(isA<JSError>().having((e) => e.message, 'message', 'oops')));
+      final next = QuickJSBatch(vm);
+      final read = next.read(next.value([1, 2]));
+      expect(next.run().reads[read], [1, 2]);
+    });
+  });
+}
@@ -1,12 +1,69 @@
+import 'dart:io';
+import 'dart:isolate';
+
+import 'package:fjs/error.dart';
 import 'package:fjs/quickjs/vm.dart';
 import 'package:test/test.dart';
 
 import '../tests/concurrent_tests.dart';
 
+void _preloadCrypto(QuickJSVm vm) {
+  vm.evalCode(File('test/crypto-js-3.3.0.js').readAsStringSync());
+}
+
+void _failingSetup(QuickJSVm vm) {
+  vm.evalCode('throw new Error("setup failed")');
+}
+
+void _exitingSetup(QuickJSVm vm) {
+  vm.setProperty(vm.global, 'exitWorker', vm.newFunction('exitWorker', (args, {thisObj}) => Isolate.exit()));
+}
+
 void main() {
   group('QuickJS', () {
     test('QuickJS concurrent', () async {
       await testConcurrent(() => QuickJSVm());
     });
+    test('QuickJS concurrent with bytecode cache', () async {
+      final cache = BytecodeCache();
+      await testConcurrent(() => QuickJSVm(bytecodeCache: cache));
+    });
+    test('QuickJS concurrent on isolates', () async {
+      final executor = await QuickJSExecutor.spawn(setup: _preloadCrypto);
+      final json = File('test/json-generator-dot-com-128-rows.json').readAsStringSync();
+      try {
+        final results = await Future.wait(List.generate(500, (i) {
+          switch (i % 3) {
+            case 0:
+              return executor.evalCode('''
+              var i = 'Hello World! Hello Flutter! 世界你好！弗勒特你好！$i';
+              var ciphertext = CryptoJS.AES.encrypt(i, 'secret key 123').toString();
+              CryptoJS.AES.decrypt(ciphertext, 'secret key 123').toString(CryptoJS.enc.Utf8) === i;
+              ''');
+            case 1:
+              return executor.evalCode('throw "An error."').then((_) => false, onError: (e) => e is JSError);
+            default:
+              return executor.evalCode(json).then((_) => _ is List && _.length == 128);
+          }
+        }));
+        expect(results, everyElement(true));
+      } finally {
+        await executor.close();
+      }
+    });
+    test('QuickJS executor fails to spawn when setup throws', () async {
+      await expectLater(QuickJSExecutor.spawn(concurrency: 2, setup: _failingSetup), throwsA(isA<JSError>()));
+    });
+    test('QuickJS executor fails pending scripts of a dead worker', () async {
+      final executor = await QuickJSExecutor.spawn(concurrency: 1, setup: _exitingSetup);
+      try {
+        final pending = executor.evalCode('new Promise(() => {})');
+        await expectLater(executor.evalCode('exitWorker()'), throwsA(isA<JSError>()));
+        await expectLater(pending, throwsA(isA<JSError>()));
+        await expectLater(executor.evalCode('1'), throwsA(isA<JSError>()));
+      } finally {
+        await executor.close();
+      }
+    });
   });
 }
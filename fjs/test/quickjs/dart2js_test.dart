@@ -45,5 +45,8 @@ void main() {
     test('object values', () {
       testObjectValues(vm);
     });
+    test('large object values', () {
+      testLargeObjectValues(vm);
+    });
   });
 }
@@ -1,3 +1,7 @@
+import 'dart:convert';
+import 'dart:io';
+
+import 'package:fjs/error.dart';
 import 'package:fjs/quickjs/vm.dart';
 import 'package:test/test.dart';
 import '../tests/js_feature_tests.dart';
@@ -17,6 +21,96 @@ void main() {
     test('JSONStringify', () async {
       testJSONStringify(vm);
     });
+    test('JSONStringify objects', () {
+      testJSONStringifyObjects(vm);
+    });
+    test('JSONStringify objects changed while serialized', () {
+      final result = vm.evalCode(r'''
+        const o = {x: 0, a: {toJSON() { o.c = 1; return 1; }}, b: 2};
+        delete o.x;
+        const p = {x: 1, y: {toJSON() { Object.defineProperty(p, 'z', {get() { return 'g'; }, enumerable: true}); return 2; }}, z: 3};
+        [JSON.stringify(o), JSON.stringify(o), JSON.stringify(p)]
+      ''');
+      expect(vm.jsToDart(result), ['{"a":1,"b":2}', '{"a":1,"b":2,"c":1}', '{"x":1,"y":2,"z":"g"}']);
+    });
+    test('property access caches follow shape changes', () {
+      final result = vm.evalCode(r'''
+        'use strict';
+        class Point { constructor(x, y) { this.x = x; this.y = y; } norm() { return this.x + this.y; } }
+        const read = (o) => o.x;
+        const write = (o, v) => { o.x = v; };
+        const call = (o) => o.norm();
+        const out = [];
+        const points = [new Point(1, 2), {x: 'a'}, {y: 0, x: 'b'}, Object.create({x: 'proto'})];
+        for (let i = 0; i < 3; i++) out.push(points.map(read).join());
+        const p = new Point(3, 4);
+        for (let i = 0; i < 3; i++) write(p, i);
+        out.push(call(p));
+        Point.prototype.norm = function () { return -1; };
+        out.push(call(p));
+        Object.defineProperty(p, 'x', {writable: false});
+        try { write(p, 9); out.push('written'); } catch (e) { out.push(e instanceof TypeError); }
+        delete p.x;
+        out.push(read(p));
+        Object.defineProperty(p, 'x', {get() { return 'getter'; }});
+        out.push(read(p));
+        out
+      ''');
+      expect(vm.jsToDart(result), ['1,a,b,proto', '1,a,b,proto', '1,a,b,proto', 6, -1, true, null, 'getter']);
+    });
+    test('objects built with the same keys stay independent', () {
+      final result = vm.evalCode(r'''
+        const rows = JSON.parse('[{"b":1,"a":2,"1":3},{"b":4,"a":5,"1":6},{"b":7,"a":8,"b":9},{"b":0,"a":0,"1":0}]');
+        rows[1].c = true;
+        delete rows[3].a;
+        const literals = [];
+        for (let i = 0; i < 3; i++) literals.push({x: i, y: -i});
+        literals[0].z = 1;
+        Object.freeze(literals[1]);
+        literals[2].x = 'x';
+        [rows.map((r) => Object.keys(r).join() + '=' + Object.values(r).join()), literals.map((o) => JSON.stringify(o))]
+      ''');
+      expect(vm.jsToDart(result), [
+        ['1,b,a=3,1,2', '1,b,a,c=6,4,5,true', 'b,a=9,8', '1,b=0,0'],
+        ['{"x":0,"y":0,"z":1}', '{"x":1,"y":-1}', '{"x":"x","y":-2}'],
+      ]);
+    });
+    test('objects built key by key grow in place', () {
+      final stopwatch = Stopwatch()..start();
+      final result = vm.evalCode(r'''
+        const sizes = [];
+        for (let n = 0; n < 2; n++) {
+          const m = {};
+          for (let i = 0; i < 100000; i++) m['k' + i] = i;
+          sizes.push(Object.keys(m).length + m.k99999);
+        }
+        sizes
+      ''');
+      expect(vm.jsToDart(result), [199999, 199999]);
+      // a clone of the shape on each add takes minutes.
+      expect(stopwatch.elapsed, lessThan(Duration(seconds: 10)));
+    });
+    test('JSONParse', () {
+      final jsonString = File('test/json-generator-dot-com-2048-rows.json').readAsStringSync();
+      vm.setProperty(vm.global, 'jsonString', vm.dartToJS(jsonString));
+      final parsed = vm.evalCode('JSON.parse(jsonString)');
+      expect(vm.jsToDart(parsed), jsonDecode(jsonString));
+      final values = vm.jsToDart(vm.evalCode(r'''JSON.parse('{"a": [0, -0, 1.5e3, 123456789, 1234567890, -12, 1.], "\\u00e9\\n": "café \\"x\\"", "0": null, "t": [true, false]}')'''));
+      expect(values, {'0': null, 'a': [0, -0.0, 1500, 123456789, 1234567890, -12, 1], 'é\n': 'café "x"', 't': [true, false]});
+      expect(vm.jsToDart(vm.evalCode('Object.is(JSON.parse("-0"), -0)')), true);
+      for (final invalid in {
+        '[1,]': "unexpected token: ']'",
+        '{"a" 1}': "expecting ':'",
+        '[01]': "unexpected token: '0'",
+        'truex': "unexpected token: 'truex'",
+        '"\t"': 'invalid character in a JSON string',
+        '[1] 2': 'unexpected data at the end',
+        '': 'unexpected end of input',
+      }.entries) {
+        vm.setProperty(vm.global, 'input', vm.dartToJS(invalid.key));
+        expect(() => vm.evalCode('JSON.parse(input)'), throwsA(isA<JSError>().having((e) => e.message, 'message', invalid.value)));
+      }
+    });
   });
   group('ES6', () {
     late QuickJSVm vm;
@@ -94,6 +94,23 @@ void main() {
       print(actual);
       expect(actual, data);
     });
+    test('external ArrayBuffer', () {
+      final handle = vm.evalCode('var buf = new Uint8Array([1, 2, 3, 4]).buffer; buf');
+      final Uint8List bytes = vm.jsToDart(handle);
+      expect(ExternalBuffer.of(bytes), isNotNull);
+      // the view shares the memory of the ArrayBuffer.
+      vm.evalCode('new Uint8Array(buf)[0] = 42');
+      expect(bytes, [42, 2, 3, 4]);
+      // and passes it back without a copy.
+      vm.setProperty(vm.global, 'back', vm.dartToJS(bytes));
+      bytes[1] = 43;
+      expect(vm.jsToDart(vm.evalCode('Array.from(new Uint8Array(back))')), [42, 43, 3, 4]);
+      // the view outlives the ArrayBuffer.
+      vm.evalCode('buf = null; back = null');
+      vm.dispose();
+      expect(bytes, [42, 43, 3, 4]);
+      vm = QuickJSVm();
+    });
     test('get function from eval and invoke', () {
       final codePtr = '(function(){return 1024;})'.toNativeUtf8();
       final filenamePtr = '<eval.js>'.toNativeUtf8();
@@ -129,6 +146,87 @@ void main() {
       expect(vm.jsToDart(vm.getProperty(obj, 'a')), 1024);
       expect(vm.jsToDart(vm.getProperty(obj, 'b')), isNull);
     });
+    test('atom keyed properties', () {
+      final length = vm.atom('length');
+      expect(vm.atom('length'), same(length));
+      final obj = vm.newObject();
+      vm.setPropertyAtom(obj, length, vm.newNumber(3));
+      vm.definePropertyAtom(obj, vm.atom('1'), vm.newString('b'), enumerable: false);
+      expect(vm.hasPropertyAtom(obj, length), isTrue);
+      expect(vm.hasProperty(obj, vm.atom('missing')), isFalse);
+      expect(vm.jsToDart(vm.getPropertyAtom(obj, length)), 3);
+      expect(vm.jsToDart(vm.getProperty(obj, 1)), 'b');
+      expect(vm.jsToDart(vm.getPropertyAtom(vm.evalCode('[1, 2]'), length)), 2);
+      vm.setProperty(vm.global, 'frozen', vm.evalCode('Object.freeze({length: 0})'));
+      expect(() => vm.definePropertyAtom(vm.getProperty(vm.global, 'frozen'), length, vm.$null), throwsA(isA<JSError>()));
+    });
+    test('array length and elements', () {
+      final array = vm.evalCode('[1, "two", {three: 3}]');
+      expect(vm.getLength(array), 3);
+      expect(vm.jsToDart(vm.getIndexed(array, 1)), 'two');
+      expect(vm.jsToDart(vm.getProperty(array, 0)), 1);
+      expect(vm.jsToDart(vm.getIndexed(array, 3)), isNull);
+      expect(vm.getArrayElements(array).map(vm.jsToDart).toList(), [1, 'two', {'three': 3}]);
+      // not a fast array
+      final holes = vm.evalCode('var holes = [1, , 3]; holes[100] = 101; holes');
+      final elements = vm.getArrayElements(holes);
+      expect(elements.length, 101);
+      expect(vm.jsToDart(elements[100]), 101);
+      expect(vm.getLength(vm.evalCode('({length: "42"})')), 42);
+      // more elements than the scratch buffer holds
+      final large = vm.evalCode('Array.from({length: 20000}, (_, i) => i)');
+      expect(vm.jsToDart(vm.getArrayElements(large).last), 19999);
+      expect(vm.jsToDart(large), List.generate(20000, (i) => i));
+    });
+    test('typed arrays', () {
+      final floats = vm.jsToDart(vm.evalCode('var floats = new Float64Array([0.5, 1.5, 2.5]); floats'));
+      expect(floats, isA<Float64List>());
+      expect(floats, [0.5, 1.5, 2.5]);
+      // shares the memory of the Float64Array
+      floats[0] = 4.5;
+      expect(vm.jsToDart(vm.evalCode('floats[0]')), 4.5);
+      vm.setProperty(vm.global, 'copy', vm.dartToJS(floats));
+      expect(vm.jsToDart(vm.evalCode('copy instanceof Float64Array && copy.buffer === floats.buffer')), true);
+      final ints = Int32List.fromList([1, 2, 3, 4]).sublist(1);
+      vm.setProperty(vm.global, 'ints', vm.dartToJS(Int32List.sublistView(Int32List.fromList([1, 2, 3, 4]), 1)));
+      expect(vm.jsToDart(vm.evalCode('ints instanceof Int32Array && Array.from(ints)')), ints);
+      final view = vm.jsToDart(vm.evalCode('new Int16Array(new ArrayBuffer(16), 4, 2).fill(-1)'));
+      expect(view, isA<Int16List>());
+      expect(view, [-1, -1]);
+      expect((view as Int16List).offsetInBytes, 4);
+      // nested typed lists become typed arrays like top level ones, views only carry their own bytes.
+      vm.setProperty(vm.global, 'lists', vm.dartToJS([
+        Int32List(3),
+        {'floats': Float64List.fromList([0.5])},
+        Uint8List.sublistView(Uint8List.fromList([1, 2, 3, 4]), 1, 3),
+        Int32List.sublistView(Int32List.fromList([1, 2, 3, 4]), 1, 3),
+      ]));
+      expect(vm.jsToDart(vm.evalCode('lists[0] instanceof Int32Array && lists[0].length')), 3);
+      expect(vm.jsToDart(vm.evalCode('lists[1].floats instanceof Float64Array && lists[1].floats[0]')), 0.5);
+      expect(vm.jsToDart(vm.evalCode('lists[2] instanceof ArrayBuffer && Array.from(new Uint8Array(lists[2]))')), [2, 3]);
+      expect(vm.jsToDart(vm.evalCode('lists[3] instanceof Int32Array && Array.from(lists[3])')), [2, 3]);
+      final nested = vm.jsToDart(vm.evalCode('({values: new Uint16Array([1, 65535])})'));
+      expect(nested['values'], isA<Uint16List>());
+      expect(nested['values'], [1, 65535]);
+      expect(vm.getFloat64List(vm.evalCode('[1, 2.5, -3]')), [1, 2.5, -3]);
+      expect(vm.getFloat64List(vm.evalCode('[]')), isEmpty);
+      expect(vm.getFloat64List(vm.evalCode('[1, "2"]')), isNull);
+      expect(vm.getFloat64List(vm.evalCode('[1, , 3]')), isNull);
+    });
+    test('typed arrays ignore replaced globals', () {
+      final otherVm = QuickJSVm();
+      try {
+        otherVm.evalCode('var Int32Array = function() { throw new Error("replaced"); }; var Float64Array = Object;');
+        otherVm.setProperty(otherVm.global, 'ints', otherVm.dartToJS(Int32List.fromList([1, 2, 3])));
+        otherVm.setProperty(otherVm.global, 'floats', otherVm.dartToJS(Float64List.fromList([0.5])));
+        expect(
+            otherVm.jsToDart(otherVm.evalCode(
+                '[Object.prototype.toString.call(ints), Array.prototype.slice.call(ints), Object.prototype.toString.call(floats)]')),
+            ['[object Int32Array]', [1, 2, 3], '[object Float64Array]']);
+      } finally {
+        otherVm.dispose();
+      }
+    });
     test('set prop to args', () {
       final fn = vm.newFunction(null, (args, {thisObj}) {
         vm.setProperty(args[0], 'msg', vm.dartToJS('Hello World!'));
@@ -146,5 +244,59 @@ void main() {
       expect(vm.jsToDart(vm.getProperty(obj, 'msg')), 'Hello World!');
       expect(vm.jsToDart(vm.getProperty(obj, 'ov')), 'Greeting!');
     });
+    test('handle scope', () {
+      final before = vm.liveHandleCount;
+      final kept = vm.withHandleScope(() {
+        for (int i = 0; i < 1000; i++) {
+          vm.newObject({'i': i});
+        }
+        final obj = vm.escapeHandle(vm.newObject({'a': 1024}));
+        expect(vm.liveHandleCount, greaterThan(before + 1000));
+        return obj;
+      });
+      expect(vm.liveHandleCount, before + 1);
+      expect(vm.jsToDart(vm.getProperty(kept, 'a')), 1024);
+    });
+    test('string round trip', () {
+      final samples = [
+        '',
+        'Hello World!',
+        'Latin-1 caf\u00e9 \u00ff',
+        '世界你好！弗勒特你好！',
+        // surrogate pair and a lone surrogate
+        '\u{1F600} \ud800',
+        // larger than the scratch buffer of the vm
+        'x' * 100000 + '世界',
+      ];
+      for (final expected in samples) {
+        final ptr = vm.newString(expected);
+        expect(vm.getString(ptr), expected);
+        expect(vm.jsToDart(vm.callFunction(vm.evalCode('(s) => s.length'), vm.nullThis, [ptr])), expected.length);
+      }
+      final built = vm.evalCode('"caf\u00e9 " + "世界".repeat(3)');
+      expect(vm.getString(built), 'caf\u00e9 世界世界世界');
+      expect(vm.getString(vm.newNumber(1024)), '1024');
+    });
+    test('call with argument arena', () {
+      final add = vm.evalCode('(a, b) => a + b');
+      final construct = vm.evalCode('(function Point(x, y) {this.x = x; this.y = y;})');
+      final one = vm.newNumber(1);
+      final result = vm.newNumber(0);
+      final before = vm.liveHandleCount;
+      for (int i = 0; i < 1000; i++) {
+        vm.callFunctionInto(result, add, vm.nullThis, [result, one]);
+      }
+      expect(vm.liveHandleCount, before);
+      expect(vm.jsToDart(result), 1000);
+      // more arguments than the first arena, and calls nested in a host function
+      final sum = vm.evalCode('(...args) => args.reduce((a, b) => a + b, 0)');
+      final args = List.generate(100, (i) => vm.newNumber(i));
+      expect(vm.jsToDart(vm.callFunction(sum, vm.nullThis, args)), 4950);
+      final nested = vm.newFunction('nested', (args, {thisObj}) => vm.callFunction(add, vm.nullThis, [args[1], args[0]]));
+      expect(vm.jsToDart(vm.callFunction(add, vm.nullThis, [vm.callFunction(nested, vm.nullThis, [one, result]), one])), 1002);
+      expect(vm.jsToDart(vm.getProperty(vm.callConstructor(construct, [one, result]), 'y')), 1000);
+      expect(() => vm.callFunctionInto(result, vm.evalCode('() => {throw new Error("oops")}')), throwsA(isA<JSError>()));
+      expect(vm.jsToDart(result), 1000);
+    });
   });
 }
\ No newline at end of file
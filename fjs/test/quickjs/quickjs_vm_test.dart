@@ -252,6 +252,68 @@ void main() {
       });
     });
 
+    group('bytecode cache', () {
+      test('compiles each source once', () {
+        final cache = BytecodeCache();
+        final code = File('test/crypto-js-3.3.0.js').readAsStringSync();
+        for (int i = 0; i < 3; i++) {
+          final cachedVm = QuickJSVm(bytecodeCache: cache);
+          try {
+            cachedVm.evalCode(code);
+            expect(cachedVm.jsToDart(cachedVm.evalCode('typeof CryptoJS.AES')), 'object');
+          } finally {
+            cachedVm.dispose();
+          }
+        }
+        // crypto-js and the typeof expression.
+        expect(cache.length, 2);
+      });
+
+      test('is persisted to disk', () {
+        final dir = Directory.systemTemp.createTempSync('fjs_bytecode_cache');
+        try {
+          final code = 'var answer = 6 * 7; answer';
+          final cachedVm = QuickJSVm(bytecodeCache: BytecodeCache(directory: dir));
+          expect(cachedVm.jsToDart(cachedVm.evalCode(code)), 42);
+          cachedVm.dispose();
+          final restoredVm = QuickJSVm(bytecodeCache: BytecodeCache(directory: dir));
+          expect(restoredVm.bytecodeCache!.get(BytecodeCache.keyOf(QuickJSVm.version, '<eval.js>', 0, code)), isNotNull);
+          expect(restoredVm.jsToDart(restoredVm.evalCode(code)), 42);
+          restoredVm.dispose();
+        } finally {
+          dir.deleteSync(recursive: true);
+        }
+      });
+
+      test('is used by the module loader', () {
+        final cache = BytecodeCache();
+        vm.bytecodeCache = cache;
+        vm.es6ModuleLoader = (name) => 'export const greeting = "Hello " + "$name";';
+        vm.evalCode('import {greeting} from "world"; globalThis.greeting = greeting;', module: true);
+        expect(vm.jsToDart(vm.getProperty(vm.global, 'greeting')), 'Hello world');
+        expect(cache.length, 2);
+      });
+
+      test('runs a module imported twice once', () {
+        vm.bytecodeCache = BytecodeCache();
+        vm.es6ModuleLoader = (name) {
+          switch (name) {
+            case 'counter':
+              return 'globalThis.runs = (globalThis.runs || 0) + 1; export const state = {n: 0};';
+            case 'a':
+              return 'import {state} from "counter"; state.n++;';
+            case 'b':
+              return 'import {state} from "counter"; state.n++; globalThis.n = state.n;';
+          }
+          return null;
+        };
+        vm.evalCode('import "a";', filename: 'main_a', module: true);
+        vm.evalCode('import "b";', filename: 'main_b', module: true);
+        expect(vm.jsToDart(vm.getProperty(vm.global, 'runs')), 1);
+        expect(vm.jsToDart(vm.getProperty(vm.global, 'n')), 2);
+      });
+    });
+
     group('.executePendingJobs', () {
       test('runs pending jobs', () {
         int i = 0;
@@ -306,6 +368,46 @@ void main() {
       dumpTestExample(null);
       dumpTestExample({'cow': true});
       dumpTestExample([1, 2, 3]);
+
+      test('supports errors', () {
+        final handle = vm.evalCode('new TypeError("x")');
+        expect(vm.dump(handle), allOf(
+          containsPair('name', 'TypeError'),
+          containsPair('message', 'x'),
+          contains('stack'),
+        ));
+      });
+    });
+
+    group('jsonSerializeObject', () {
+      setUp(() {
+        vm.jsonSerializeObject = true;
+      });
+
+      test('converts like JSON.stringify', () {
+        final handle = vm.evalCode(r'''({
+          date: new Date(0),
+          fn() {},
+          nan: NaN,
+          wrapped: [new Boolean(false), new String("s")],
+          time: 1600000000000,
+          custom: {toJSON(key) {return key + '!';}},
+          list: [undefined, () => 1],
+        })''');
+        expect(vm.jsToDart(handle), {
+          'date': '1970-01-01T00:00:00.000Z',
+          'nan': null,
+          'wrapped': [false, 's'],
+          'time': 1600000000000,
+          'custom': 'custom!',
+          'list': [null, null],
+        });
+      });
+
+      test('throws on circular references', () {
+        final handle = vm.evalCode('var a = {}; a.self = a; a');
+        expect(() => vm.jsToDart(handle), throwsA(isA<JSError>()));
+      });
     });
 
     group('.typeof', () {
@@ -374,6 +476,27 @@ void main() {
         } on JSError catch(e) {
           expect(e.toMap(), allOf(containsPair('name', 'InternalError'), containsPair('message', 'interrupted')));
         }
+        expect(vm.takeInterruptReason(), InterruptReason.handler);
+      });
+
+      test('execution timeout interrupts infinite loop execution', () {
+        vm.setExecutionTimeout(Duration(milliseconds: 100));
+        final start = DateTime.now();
+        expect(() => vm.evalCode('while (1) {}'), throwsA(isA<JSError>().having((e) => e.message, 'message', 'interrupted')));
+        expect(DateTime.now().difference(start).inMilliseconds, greaterThanOrEqualTo(100));
+        expect(vm.takeInterruptReason(), InterruptReason.deadline);
+        expect(vm.takeInterruptReason(), InterruptReason.none);
+        vm.setExecutionTimeout(null);
+        expect(vm.jsToDart(vm.evalCode('1 + 1')), 2);
+      });
+
+      test('op budget interrupts infinite loop execution', () {
+        vm.setOpBudget(100000);
+        expect(() => vm.evalCode('i = 0; while (1) { i++ }'), throwsA(isA<JSError>()));
+        expect(vm.takeInterruptReason(), InterruptReason.opBudget);
+        expect(vm.jsToDart(vm.getProperty(vm.global, 'i')), greaterThan(0));
+        vm.setOpBudget(null);
+        expect(vm.jsToDart(vm.evalCode('1 + 1')), 2);
       });
     });
 
@@ -426,6 +549,16 @@ void main() {
         }
       });
 
+      test('bounds the memory of ArrayBuffers', () {
+        vm.setMemoryLimit(64 * 1024 * 1024);
+        expect(() => vm.evalCode('const buffers = []; for (;;) buffers.push(new ArrayBuffer(1 << 24));'),
+            throwsA(isA<JSError>()));
+        vm.evalCode('buffers.length = 0;');
+        // the memory of the freed ArrayBuffers is given back to the limit.
+        final result = vm.evalCode('let n = 0; for (let i = 0; i < 16; i++) n += new Uint8Array(1 << 24).length; n');
+        expect(vm.jsToDart(result), 16 << 24);
+      });
+
       test('removes limit when set to -1', () {
         vm.setMemoryLimit(100);
         vm.setMemoryLimit(-1);
@@ -435,6 +568,143 @@ void main() {
       });
     });
 
+    group('.setGCMode()', () {
+      test('generational mode frees young cycles and keeps survivors', () {
+        vm.setGCMode(GCMode.generational, youngThreshold: 1000);
+        final result = vm.evalCode('''
+          var keep = [];
+          for (let i = 0; i < 100000; i++) {
+            const a = {i}, b = {a};
+            a.b = b;
+            if (i % 1000 == 0) {
+              const kept = {i};
+              kept.self = kept;
+              keep.push(kept);
+            }
+          }
+          keep.length + ':' + keep[99].self.i;
+        ''');
+        expect(vm.jsToDart(result), '100:99000');
+        final stats = vm.gcStats;
+        expect(stats.minorCount, greaterThan(0));
+        expect(stats.maxPause, greaterThanOrEqualTo(stats.lastPause));
+        vm.setGCMode(GCMode.full);
+        expect(vm.jsToDart(vm.evalCode('keep.map((_) => _.self.i).reduce((a, b) => a + b)')), 4950000);
+      });
+
+      group('without full collections', () {
+        int usedSize() => vm.jsToDart(vm.computeMemoryUsage())['memory_used_size'];
+
+        setUp(() {
+          vm.setGCMode(GCMode.generational, youngThreshold: 1000);
+          // -1 would disable minor collections as well.
+          vm.setGCThreshold(1 << 40);
+        });
+
+        test('minor collections bound the memory of young cycles', () {
+          final fullCount = vm.gcStats.fullCount;
+          vm.evalCode('for (let i = 0; i < 10000; i++) { const a = {i}, b = {a}; a.b = b; }');
+          final size = usedSize();
+          vm.evalCode('for (let i = 0; i < 200000; i++) { const a = {i}, b = {a}; a.b = b; }');
+          expect(vm.gcStats.fullCount, fullCount);
+          expect(vm.gcStats.minorCount, greaterThan(0));
+          expect(usedSize(), lessThan(size + 256 * 1024));
+        });
+
+        test('frees old objects only reachable from young cycles', () {
+          final fullCount = vm.gcStats.fullCount;
+          vm.evalCode('''
+            var old = [];
+            for (let i = 0; i < 1000; i++) old.push({i, payload: new Array(100).fill(i)});
+            // promoted by the minor collections these allocations trigger
+            for (let i = 0; i < 10000; i++) { const a = {i}, b = {a}; a.b = b; }
+          ''');
+          final size = usedSize();
+          vm.evalCode('''
+            for (let i = 0; i < old.length; i++) { const a = {old: old[i]}, b = {a}; a.b = b; }
+            old = null;
+            for (let i = 0; i < 10000; i++) { const a = {i}, b = {a}; a.b = b; }
+          ''');
+          expect(vm.gcStats.fullCount, fullCount);
+          // the payloads alone hold 1000 * 100 values.
+          expect(usedSize(), lessThan(size - 1000 * 100 * 8));
+        });
+      });
+    });
+
+    group('GC policy', () {
+      const garbage = 'for (let i = 0; i < 20000; i++) { const o = {i}; o.self = o; }';
+
+      test('runGC reports bytes freed', () {
+        vm.setGCThreshold(-1);
+        final before = vm.gcStats.fullCount;
+        vm.evalCode(garbage);
+        final stats = vm.runGC();
+        expect(stats.fullCount, before + 1);
+        expect(stats.lastFreedBytes, greaterThan(0));
+        expect(stats.freedBytes, greaterThanOrEqualTo(stats.lastFreedBytes));
+      });
+
+      test('setGCThreshold', () {
+        vm.setGCThreshold(-1);
+        final before = vm.gcStats.fullCount;
+        vm.evalCode(garbage);
+        expect(vm.gcStats.fullCount, before);
+        vm.setGCThreshold(64 * 1024, growthPercent: 10);
+        vm.evalCode(garbage);
+        expect(vm.gcStats.fullCount, greaterThan(before));
+      });
+
+      test('collects on idle', () async {
+        vm.setGCThreshold(-1);
+        vm.gcOnIdle = true;
+        final before = vm.gcStats.fullCount;
+        vm.evalCode(garbage);
+        vm.startEventLoop(10);
+        await Future.delayed(Duration(milliseconds: 100));
+        vm.stopEventLoop();
+        expect(vm.gcStats.fullCount, greaterThan(before));
+      });
+    });
+
+    group('RuntimeAllocator.slab', () {
+      test('runs scripts and counts size classes', () {
+        final slabVm = QuickJSVm(allocator: RuntimeAllocator.slab);
+        try {
+          final result = slabVm.evalCode(
+              'JSON.stringify(Array.from({length: 1000}, (_, i) => ({i, s: "x".repeat(i % 400)}))).length');
+          expect(slabVm.jsToDart(result), greaterThan(200000));
+          final stats = slabVm.allocatorStats;
+          expect(stats.length, 17);
+          expect(stats.first.blockSize, 32);
+          expect(stats.last.blockSize, 0);
+          expect(stats.map((_) => _.live).reduce((a, b) => a + b), greaterThan(0));
+          expect(stats.last.allocations, greaterThan(0));
+          for (final it in stats.take(16)) {
+            expect(it.live, lessThanOrEqualTo(it.reserved));
+          }
+        } finally {
+          slabVm.dispose();
+        }
+        expect(vm.allocatorStats, isEmpty);
+      });
+    });
+
+    group('RuntimeAllocator.arena', () {
+      test('runs scripts within the memory limit', () {
+        final arenaVm = QuickJSVm(allocator: RuntimeAllocator.arena);
+        try {
+          final result = arenaVm.evalCode('let s = ""; for (let i = 0; i < 1000; i++) { s += i; } s.length');
+          expect(arenaVm.jsToDart(result), 2890);
+          expect(arenaVm.gcStats.fullCount, 0);
+          arenaVm.setMemoryLimit(4 * 1024 * 1024);
+          expect(() => arenaVm.evalCode('const a = []; for (;;) { a.push({}); }'), throwsA(isA<JSError>()));
+        } finally {
+          arenaVm.dispose();
+        }
+      });
+    });
+
     group('.dumpMemoryUsage()', () {
       test('logs memory usage', () {
         expect(vm.dumpMemoryUsage(), endsWith('per fast array)\n'),
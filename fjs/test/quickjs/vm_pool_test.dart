@@ -0,0 +1,102 @@
+import 'package:fjs/quickjs/vm.dart';
+import 'package:test/test.dart';
+
+void main() {
+  group('QuickJSVmPool', () {
+    late QuickJSVmPool pool;
+    setUp(() {
+      pool = QuickJSVmPool(
+        size: 2,
+        memoryLimit: 16 * 1024 * 1024,
+        preload: (vm) => vm.evalCode('var greeting = "hello"; function greet(name) {return greeting + " " + name;}'),
+      );
+    });
+    tearDown(() {
+      pool.dispose();
+    });
+
+    test('is pre-warmed', () {
+      expect(pool.idleCount, 2);
+      final vm = pool.acquire();
+      expect(pool.idleCount, 1);
+      expect(pool.busyCount, 1);
+      pool.release(vm);
+      expect(pool.idleCount, 2);
+      expect(pool.busyCount, 0);
+    });
+
+    test('resets globals on release', () {
+      final vm = pool.acquire();
+      vm.evalCode('var leaked = 1; let scoped = 2; globalThis.assigned = 3; greeting = "bye"; greet = null;');
+      expect(vm.jsToDart(vm.evalCode('typeof greet')), 'object');
+      pool.release(vm);
+      final reused = pool.acquire();
+      final again = pool.acquire();
+      for (final it in [reused, again]) {
+        expect(it.jsToDart(it.evalCode('typeof leaked')), 'undefined');
+        expect(it.jsToDart(it.evalCode('typeof scoped')), 'undefined');
+        expect(it.jsToDart(it.evalCode('typeof assigned')), 'undefined');
+        expect(it.jsToDart(it.evalCode('greet("world")')), 'hello world');
+        // `let` bindings can be declared again once reset.
+        it.evalCode('let scoped = 4;');
+      }
+      expect([reused, again], contains(vm));
+      pool.release(reused);
+      pool.release(again);
+    });
+
+    test('does not dispatch to functions of a previous session', () {
+      final vm = pool.acquire();
+      final stale = vm.newFunction('stale', (args, {thisObj}) => vm.newString('first session'));
+      final arrayProto = vm.getProperty(vm.evalCode('Array'), 'prototype');
+      vm.setProperty(arrayProto, 'stale', stale);
+      pool.release(vm);
+      final vms = [pool.acquire(), pool.acquire()];
+      final reused = vms.firstWhere((it) => it == vm);
+      reused.setProperty(reused.global, 'fresh', reused.newFunction('fresh', (args, {thisObj}) => reused.newString('second session')));
+      expect(reused.jsToDart(reused.evalCode('fresh()')), 'second session');
+      // a released function is no longer dispatched, the call returns undefined.
+      expect(reused.jsToDart(reused.evalCode('[].stale()')), isNull);
+      vms.forEach(pool.release);
+    });
+
+    test('reuses the function ids of previous sessions', () {
+      final vm = pool.acquire();
+      pool.release(vm);
+      final count = vm.functionIdCount;
+      for (int i = 0; i < 100; i++) {
+        final it = pool.acquire();
+        for (int j = 0; j < 10; j++) {
+          it.setProperty(it.global, 'f$j', it.newFunction('f$j', (args, {thisObj}) => it.newNumber(j)));
+        }
+        expect(it.jsToDart(it.evalCode('f9()')), 9);
+        pool.release(it);
+      }
+      expect(vm.functionIdCount, lessThanOrEqualTo(count + 10));
+    });
+
+    test('frees handles on release', () {
+      final vm = pool.acquire();
+      final count = vm.liveHandleCount;
+      for (int i = 0; i < 100; i++) {
+        vm.newString('leaked $i');
+      }
+      expect(vm.liveHandleCount, greaterThan(count));
+      pool.release(vm);
+      expect(vm.liveHandleCount, count);
+    });
+
+    test('use', () async {
+      final result = await pool.use((vm) => vm.jsToDart(vm.evalCode('greet("pool")')));
+      expect(result, 'hello pool');
+      expect(pool.busyCount, 0);
+    });
+
+    test('disposes vms released while full', () {
+      final vms = [pool.acquire(), pool.acquire(), pool.acquire()];
+      vms.forEach(pool.release);
+      expect(pool.idleCount, 2);
+      expect(vms.where((vm) => vm.disposed).length, 1);
+    });
+  });
+}
@@ -1,3 +1,5 @@
+import 'dart:convert';
+import 'dart:io';
 import 'dart:typed_data';
 
 import 'package:fjs/vm.dart';
@@ -144,3 +146,15 @@ testObjectValues(Vm vm) {
         if(!test.c[2].hasOwnProperty("Symbol")) throw "expected: test.c[2] hasOwnProperty 'Symbol'";
         ''');
 }
+
+testLargeObjectValues(Vm vm) {
+  final jsonString = File('${Directory.current.path}/test/json-generator-dot-com-2048-rows.json').readAsStringSync();
+  final value = jsonDecode(jsonString);
+  final _ = vm.dartToJS(value);
+  vm.setProperty(vm.global, 'test', _);
+  vm.setProperty(vm.global, 'expected', vm.dartToJS(jsonString));
+  vm.evalCode(r'''
+        if(!(test instanceof Array)) throw "expected: test instanceof Array";
+        if(JSON.stringify(test) !== JSON.stringify(JSON.parse(expected))) throw "expected: test equals expected";
+        ''');
+}
@@ -66,6 +66,25 @@ void testJSONStringify(Vm vm) {
   }
 }
 
+/// Objects sharing their keys, escapes and objects modified while they are stringified.
+void testJSONStringifyObjects(Vm vm) {
+  List<List<String>> tests = [
+    [r'''JSON.stringify([{a: 1, b: "x"}, {a: 2, b: "y"}])''', r'''[{"a":1,"b":"x"},{"a":2,"b":"y"}]'''],
+    [r'''JSON.stringify([{a: undefined, b: () => 1, c: null}, {a: 1, b: 2, c: 3}])''', r'''[{"c":null},{"a":1,"b":2,"c":3}]'''],
+    [r'''JSON.stringify({b: 1, 2: "two", a: [-5, 2147483647, -2147483648, 0.5], 1: true})''', r'''{"1":true,"2":"two","b":1,"a":[-5,2147483647,-2147483648,0.5]}'''],
+    [r'''JSON.stringify({"quote\"": "tab\t\u0001", "é": "\ud800 ü 😀"})''', r'''{"quote\"":"tab\t\u0001","é":"\ud800 ü 😀"}'''],
+    [r'''JSON.stringify("x".repeat(40) + "\\" + "y".repeat(40))''', '"${'x' * 40}\\\\${'y' * 40}"'],
+    [r'''(() => {const o = {a: 1}; Object.defineProperty(o, "h", {value: 2}); Object.defineProperty(o, "g", {get() {return 3}, enumerable: true}); o[Symbol()] = 4; return JSON.stringify(o);})()''', r'''{"a":1,"g":3}'''],
+    [r'''(() => {const o = {a: {toJSON() {delete o.b; o.c = 1; return "A";}}, b: 2, d: 3}; return JSON.stringify(o);})()''', r'''{"a":"A","d":3}'''],
+    [r'''JSON.stringify([{a: 1, b: [2]}, {a: 3, b: [4]}], (k, v) => k === "a" ? v * 10 : v)''', r'''[{"a":10,"b":[2]},{"a":30,"b":[4]}]'''],
+    [r'''JSON.stringify([{a: 1, b: 2}, {a: 3, b: 4}], ["b"])''', r'''[{"b":2},{"b":4}]'''],
+    [r'''JSON.stringify({a: [1, {b: 2}]}, null, 2)''', '{\n  "a": [\n    1,\n    {\n      "b": 2\n    }\n  ]\n}'],
+  ];
+  for(var t in tests) {
+    expect(vm.jsToDart(vm.evalCode(t[0])), t[1], reason: t[0]);
+  }
+}
+
 const String JS_EXPECT = r'''
 function _compare(a, b, msg) {
   if(Object.is(a, b)) {
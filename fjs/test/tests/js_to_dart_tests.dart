@@ -1,4 +1,5 @@
 import 'dart:convert';
+import 'dart:io';
 import 'dart:typed_data';
 
 import 'package:fjs/error.dart';
@@ -79,6 +80,13 @@ testDateValues(Vm vm) {
   vm.constructDate = true;
   expect(vm.jsToDart(vm.evalCode('new Date(1622470242901)')),
       DateTime.fromMillisecondsSinceEpoch(1622470242901));
+  // invalid dates
+  for (final constructDate in [false, true]) {
+    vm.constructDate = constructDate;
+    expect(vm.jsToDart(vm.evalCode('new Date(NaN)')), isNull);
+    expect(vm.jsToDart(vm.evalCode('({d: new Date(NaN)})')), {'d': null});
+    expect(vm.jsToDart(vm.evalCode('[new Date(NaN), 1]')), [null, 1]);
+  }
 }
 
 testPromiseValues(Vm vm) async {
@@ -157,4 +165,11 @@ testPromiseInMap(Vm vm) async {
   var promise = map['promise'] as Future;
   var value = await promise;
   expect(value, 'Hello World!');
-}
\ No newline at end of file
+}
+
+testLargeObjectValues(Vm vm) {
+  final jsonString = File('${Directory.current.path}/test/json-generator-dot-com-2048-rows.json').readAsStringSync();
+  final expected = jsonDecode(jsonString);
+  final actual = vm.jsToDart(vm.evalCode(jsonString));
+  expect(actual, expected);
+}
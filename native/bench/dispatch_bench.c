@@ -0,0 +1,98 @@
+/*
+ * Interpreter dispatch microbenchmark.
+ *
+ * Built twice by native/android/CMakeLists.txt with
+ * -DQJS_BUILD_BENCHMARKS=ON: dispatch_bench_switch (switch dispatch) and
+ * dispatch_bench_goto (computed goto). Run them on the same device and
+ * compare the times of each case.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "quickjs.h"
+
+#define RUNS 5
+
+typedef struct {
+    const char *name;
+    const char *source;
+} BenchCase;
+
+static const BenchCase cases[] = {
+    /* push_i8 + add, get_loc + get_field */
+    { "int_add",
+      "let s = 0;"
+      "for (let i = 0; i < 3000000; i = i + 1) { s = s + 3; s = s + 100; }"
+      "s" },
+    { "field_get",
+      "function f(p) { let s = 0;"
+      "  for (let i = 0; i < 3000000; i++) s += p.x + p.y;"
+      "  return s; }"
+      "f({x: 1, y: 2})" },
+    { "method_call",
+      "class Point { constructor(x) { this.x = x; } get2() { return this.x * 2; } }"
+      "function f(p) { let s = 0;"
+      "  for (let i = 0; i < 1000000; i++) s += p.get2();"
+      "  return s; }"
+      "f(new Point(3))" },
+    { "object_mapping",
+      "const rows = [];"
+      "for (let i = 0; i < 1000; i++) rows.push({id: i, name: 'n' + i, score: i % 7});"
+      "function map(r) { return {key: r.id, label: r.name, high: r.score > 3}; }"
+      "let n = 0;"
+      "for (let k = 0; k < 300; k++) for (let i = 0; i < rows.length; i++) n += map(rows[i]).key;"
+      "n" },
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int run_case(JSContext *ctx, const BenchCase *c, double *ms)
+{
+    JSValue val;
+    double start;
+
+    start = now_ms();
+    val = JS_Eval(ctx, c->source, strlen(c->source), c->name,
+                  JS_EVAL_TYPE_GLOBAL);
+    *ms = now_ms() - start;
+    if (JS_IsException(val)) {
+        JSValue exception = JS_GetException(ctx);
+        const char *error = JS_ToCString(ctx, exception);
+        fprintf(stderr, "%s: %s\n", c->name, error);
+        JS_FreeCString(ctx, error);
+        JS_FreeValue(ctx, exception);
+        return -1;
+    }
+    JS_FreeValue(ctx, val);
+    return 0;
+}
+
+int main(void)
+{
+    size_t i;
+    int run;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        double best = -1, ms;
+        for (run = 0; run < RUNS; run++) {
+            /* a fresh runtime per run: the lexical declarations are global */
+            JSRuntime *rt = JS_NewRuntime();
+            JSContext *ctx = JS_NewContext(rt);
+            int ret = run_case(ctx, &cases[i], &ms);
+            JS_FreeContext(ctx);
+            JS_FreeRuntime(rt);
+            if (ret)
+                return 1;
+            if (best < 0 || ms < best)
+                best = ms;
+        }
+        printf("%-16s %8.1f ms\n", cases[i].name, best);
+    }
+    return 0;
+}
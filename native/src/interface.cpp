@@ -13,13 +13,17 @@
  * - interface.h for native C code.
  * - ffi.ts for emscripten.
  */
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <new>
 #include <stdlib.h>
 
 #include <string.h>
 #include <stdio.h>
 #include <math.h>  // For NAN
 #include <stdbool.h>
+#include <stdint.h>
 #include "quickjs.h"
 // #include "quickjs-libc.h"
 
@@ -60,110 +64,366 @@ void qts_dump(JSContext *ctx, JSValueConst value) {
   putchar('\n');
 }
 
-void copy_prop_if_needed(JSContext* ctx, JSValueConst dest, JSValueConst src, const char* prop_name) {
-  JSAtom prop_atom = JS_NewAtom(ctx, prop_name);
-  JSValue dest_prop = JS_GetProperty(ctx, dest, prop_atom);
-  if (JS_IsUndefined(dest_prop)) {
-    JSValue src_prop = JS_GetProperty(ctx, src, prop_atom);
-    if (!JS_IsUndefined(src_prop) && !JS_IsException(src_prop)) {
-      JS_SetProperty(ctx, dest, prop_atom, src_prop);
+/**
+ * Handle arena
+ *
+ * Every JSValue* handed to the host lives in a slot of a per-context arena instead of
+ * its own malloc block. Slots are carved out of fixed-size slabs that never move, so a
+ * slot pointer is stable for as long as the slot is live and can be used by the host
+ * exactly like the old heap JSValue*.
+ *
+ * Released slots go back to a free list. Each slot carries a generation counter which is
+ * odd while the slot is live, so freeing a dead slot is detected instead of corrupting
+ * the free list.
+ *
+ * Live slots are also linked in allocation order, which lets a handle scope release every
+ * slot allocated after it was opened, and lets QJS_FreeContext release all remaining
+ * handles in bulk.
+ */
+#define QJS_HANDLE_SLAB_SIZE 512
+
+typedef struct QJS_HandleSlot {
+  // must be the first member, the host reads the JSValue through the slot pointer.
+  JSValue value;
+  uint32_t generation;
+  uint64_t serial;
+  struct QJS_HandleSlot *prev;
+  // next live slot, or next free slot when the slot is on the free list.
+  struct QJS_HandleSlot *next;
+} QJS_HandleSlot;
+
+typedef struct QJS_HandleSlab {
+  struct QJS_HandleSlab *next;
+  QJS_HandleSlot slots[QJS_HANDLE_SLAB_SIZE];
+} QJS_HandleSlab;
+
+typedef struct QJS_HandleArena {
+  QJS_HandleSlab *slabs;
+  QJS_HandleSlot *free_list;
+  // sentinel of the live list, `live.next` is the oldest live slot and `live.prev` the newest.
+  QJS_HandleSlot live;
+  size_t live_count;
+  uint64_t next_serial;
+} QJS_HandleArena;
+
+/**
+ * Own properties of an object, captured by QJS_SnapshotGlobals and sorted by atom.
+ */
+typedef struct QJS_PropertySnapshot {
+  JSAtom atom;
+  JSPropertyDescriptor desc;
+} QJS_PropertySnapshot;
+
+typedef struct QJS_ObjectSnapshot {
+  QJS_PropertySnapshot *props;
+  uint32_t count;
+} QJS_ObjectSnapshot;
+
+/**
+ * Per-context bridge state, stored as the context opaque.
+ */
+typedef struct QJS_ContextState {
+  QJS_HandleArena arena;
+  // the global object and the global let/const definitions
+  QJS_ObjectSnapshot globals;
+  QJS_ObjectSnapshot global_vars;
+  // arguments written by the host for the next QJS_CallArgs, see QJS_GetArgArena
+  JSValue *args;
+  int args_capacity;
+} QJS_ContextState;
+
+static inline QJS_ContextState *qjs_get_context_state(JSContext *ctx) {
+  return static_cast<QJS_ContextState *>(JS_GetContextOpaque(ctx));
+}
+
+typedef JSValue* QJS_C_To_HostCallbackFunc(JSContext *ctx, int32_t host_id, int32_t fn_id, int32_t fn_generation, JSValueConst *this_ptr, int argc, JSValueConst *argv);
+typedef int QJS_C_To_HostInterruptFunc(JSRuntime *rt, int32_t host_id);
+typedef uint8_t QJS_Module_Loader(JSContext* ctx, char **buff, size_t *len, const char* module_name);
+
+/**
+ * Per-runtime bridge state, stored as the runtime opaque.
+ *
+ * Host callbacks are bound to the thread (Dart isolate) that owns the runtime, so they are kept
+ * per runtime rather than in globals: runtimes owned by different threads never share dispatch.
+ * `host_id` is passed back to every callback, so the host finds its own object by index instead
+ * of looking the runtime or context up.
+ */
+typedef struct QJS_RuntimeState {
+  int32_t host_id;
+  QJS_C_To_HostCallbackFunc *callback;
+  QJS_C_To_HostInterruptFunc *interrupt;
+  QJS_Module_Loader *module_loader;
+  // whether `interrupt` is polled, see QJS_RuntimeEnableInterruptHandler
+  bool host_interrupt;
+  // QJS_GetMonotonicTime after which execution is interrupted, 0 for none
+  int64_t deadline_ns;
+  // interrupt polls left before execution is interrupted, -1 for no budget
+  int64_t polls_left;
+  // QJS_INTERRUPT_*, why the last interrupt happened
+  int32_t interrupt_reason;
+  // allocator of a QJS_ALLOCATOR_SLAB runtime
+  struct QJS_SlabAllocator *slab;
+  // allocator of a QJS_ALLOCATOR_ARENA runtime
+  struct QJS_BumpArena *arena;
+} QJS_RuntimeState;
+
+static inline QJS_RuntimeState *qjs_get_runtime_state(JSRuntime *rt) {
+  return static_cast<QJS_RuntimeState *>(JS_GetRuntimeOpaque(rt));
+}
+
+void qjs_arena_init(QJS_HandleArena *arena) {
+  arena->slabs = NULL;
+  arena->free_list = NULL;
+  arena->live.prev = &arena->live;
+  arena->live.next = &arena->live;
+  arena->live_count = 0;
+  arena->next_serial = 1;
+}
+
+QJS_HandleSlot *qjs_arena_alloc(QJS_HandleArena *arena) {
+  if (arena->free_list == NULL) {
+    QJS_HandleSlab *slab = static_cast<QJS_HandleSlab *>(malloc(sizeof(QJS_HandleSlab)));
+    if (slab == NULL) {
+      return NULL;
+    }
+    slab->next = arena->slabs;
+    arena->slabs = slab;
+    // chain in reverse so that slots are handed out in address order.
+    for (int i = QJS_HANDLE_SLAB_SIZE - 1; i >= 0; i--) {
+      QJS_HandleSlot *slot = &slab->slots[i];
+      slot->generation = 0;
+      slot->next = arena->free_list;
+      arena->free_list = slot;
     }
-  } else {
-    JS_FreeValue(ctx, dest_prop);
   }
-  JS_FreeAtom(ctx, prop_atom);
+  QJS_HandleSlot *slot = arena->free_list;
+  arena->free_list = slot->next;
+  slot->generation++;
+  slot->serial = arena->next_serial++;
+  slot->prev = arena->live.prev;
+  slot->next = &arena->live;
+  arena->live.prev->next = slot;
+  arena->live.prev = slot;
+  arena->live_count++;
+  return slot;
+}
+
+/**
+ * Return [slot] to the free list without touching the value it holds.
+ */
+void qjs_arena_release(QJS_HandleArena *arena, QJS_HandleSlot *slot) {
+  slot->prev->next = slot->next;
+  slot->next->prev = slot->prev;
+  slot->generation++;
+  slot->prev = NULL;
+  slot->next = arena->free_list;
+  arena->free_list = slot;
+  arena->live_count--;
+}
+
+/**
+ * Free the values of all live slots allocated at or after [serial].
+ */
+void qjs_arena_release_since(JSContext *ctx, QJS_HandleArena *arena, uint64_t serial) {
+  while (arena->live.prev != &arena->live && arena->live.prev->serial >= serial) {
+    QJS_HandleSlot *slot = arena->live.prev;
+    JSValue value = slot->value;
+    qjs_arena_release(arena, slot);
+    JS_FreeValue(ctx, value);
+  }
 }
 
-JSValue *jsvalue_to_heap(JSValueConst value) {
-  JSValue* result = static_cast<JSValue *>(malloc(sizeof(JSValue)));
-  if (result) {
-    memcpy(result, &value, sizeof(JSValue));
+void qjs_arena_destroy(JSContext *ctx, QJS_HandleArena *arena) {
+  qjs_arena_release_since(ctx, arena, 0);
+  QJS_HandleSlab *slab = arena->slabs;
+  while (slab != NULL) {
+    QJS_HandleSlab *next = slab->next;
+    free(slab);
+    slab = next;
   }
-  return result;
+  qjs_arena_init(arena);
+}
+
+static inline bool qjs_slot_is_live(QJS_HandleSlot *slot) {
+  return (slot->generation & 1) == 1;
+}
+
+JSValue *jsvalue_to_heap(JSContext *ctx, JSValueConst value) {
+  QJS_HandleSlot *slot = qjs_arena_alloc(&qjs_get_context_state(ctx)->arena);
+  if (slot == NULL) {
+    JS_FreeValue(ctx, value);
+    return NULL;
+  }
+  slot->value = value;
+  return &slot->value;
+}
+
+/**
+ * Move the value out of a handle and release the handle, the caller owns the returned value.
+ */
+JSValue jsvalue_take_from_heap(JSContext *ctx, JSValue *ptr) {
+  QJS_HandleSlot *slot = reinterpret_cast<QJS_HandleSlot *>(ptr);
+  JSValue value = slot->value;
+  qjs_arena_release(&qjs_get_context_state(ctx)->arena, slot);
+  return value;
 }
 
 /**
  * C -> Host JS calls support
  */
 
-// When host javascript loads this Emscripten module, it should set `bound_callback` to a dispatcher function.
-typedef JSValue* QJS_C_To_HostCallbackFunc(JSContext *ctx, JSValueConst *this_ptr, int argc, JSValueConst *argv, JSValueConst *fn_data_ptr);
-QJS_C_To_HostCallbackFunc* bound_callback = NULL;
+// The host should set the callback of each runtime to a dispatcher function with QJS_SetHostCallback.
+
+void QJS_SetHostCallback(JSRuntime *rt, QJS_C_To_HostCallbackFunc* fp) {
+  qjs_get_runtime_state(rt)->callback = fp;
+}
 
-void QJS_SetHostCallback(QJS_C_To_HostCallbackFunc* fp) {
-  bound_callback = fp;
+/**
+ * Set the id passed back to the host callbacks of `rt`.
+ */
+void QJS_SetHostId(JSRuntime *rt, int32_t host_id) {
+  qjs_get_runtime_state(rt)->host_id = host_id;
 }
 
 // We always use a pointer to this function with NewCFunctionData.
-// The host JS should do it's own dispatch based on the value of *func_data.
+// The host should do it's own dispatch based on the function id carried in `magic`, and the generation of the id
+// carried in `func_data[0]`.
 JSValue qts_quickjs_to_c_callback(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic, JSValue *func_data) {
-  if (bound_callback == NULL) {
+  QJS_RuntimeState *state = qjs_get_runtime_state(JS_GetRuntime(ctx));
+  if (state->callback == NULL) {
     printf(PKG "callback from C, but no QJS_C_To_HostCallback set");
     abort();
   }
 
-  JSValue* result_ptr = (*bound_callback)(ctx, &this_val, argc, argv, func_data);
+  JSValue* result_ptr = (*state->callback)(ctx, state->host_id, magic, JS_VALUE_GET_INT(func_data[0]), &this_val, argc, argv);
   if (result_ptr == NULL) {
     return JS_UNDEFINED;
   }
-  JSValue result = *result_ptr;
-  free(result_ptr);
-  return result;
+  return jsvalue_take_from_heap(ctx, result_ptr);
 }
 
 JSValueConst *QJS_ArgvGetJSValueConstPointer(JSValueConst *argv, int index) {
   return &argv[index];
 }
 
-JSValue *QJS_NewFunction(JSContext *ctx, JSValueConst *func_data, const char* name) {
-  JSValue func_obj = JS_NewCFunctionData(ctx, &qts_quickjs_to_c_callback, /* min argc */0, /* unused magic */0, /* func_data len */1, func_data);
+/**
+ * A function calling the host callback with [fn_id]. The host may reuse the id once the function is released, and
+ * bumps [fn_generation] when it does, so the calls of functions holding an older generation can be rejected.
+ */
+JSValue *QJS_NewFunction(JSContext *ctx, int32_t fn_id, int32_t fn_generation, const char* name) {
+  JSValue generation = JS_NewInt32(ctx, fn_generation);
+  JSValue func_obj = JS_NewCFunctionData(ctx, &qts_quickjs_to_c_callback, /* min argc */0, /* magic */fn_id, /* func_data len */1, &generation);
   if (name != NULL) {
     JS_DefinePropertyValueStr(ctx, func_obj, "name", JS_NewString(ctx, name), JS_PROP_CONFIGURABLE);
   }
-  return jsvalue_to_heap(func_obj);
+  return jsvalue_to_heap(ctx, func_obj);
 }
 
 JSValue *QJS_Throw(JSContext *ctx, JSValueConst* error) {
   JSValue copy = JS_DupValue(ctx, *error);
-  return jsvalue_to_heap(JS_Throw(ctx, copy));
+  return jsvalue_to_heap(ctx, JS_Throw(ctx, copy));
 }
 
 JSValue *QJS_NewError(JSContext *ctx) {
-  return jsvalue_to_heap(JS_NewError(ctx));
+  return jsvalue_to_heap(ctx, JS_NewError(ctx));
 }
 
 
 /**
  * Interrupt handler - called regularly from QuickJS. Return !=0 to interrupt.
- * TODO: because this is perf critical, really send a new func pointer for each
- * call to QJS_RuntimeEnableInterruptHandler instead of using dispatch.
+ *
+ * The deadline and the op budget are checked here without calling into the host, the host
+ * callback is only polled when it was enabled with QJS_RuntimeEnableInterruptHandler.
  */
-typedef int QJS_C_To_HostInterruptFunc(JSRuntime *rt);
-QJS_C_To_HostInterruptFunc *bound_interrupt = NULL;
+#define QJS_INTERRUPT_NONE 0
+#define QJS_INTERRUPT_HOST 1
+#define QJS_INTERRUPT_DEADLINE 2
+#define QJS_INTERRUPT_OP_BUDGET 3
 
-int qts_interrupt_handler(JSRuntime *rt, void *_unused) {
-  if (bound_interrupt == NULL) {
-    printf(PKG "cannot call interrupt handler because no QJS_C_To_HostInterruptFunc set");
-    abort();
+// ops QuickJS runs between two interrupt polls, JS_INTERRUPT_COUNTER_INIT in quickjs.c
+#define QJS_INTERRUPT_POLL_OPS 10000
+
+int64_t QJS_GetMonotonicTime() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int qts_interrupt_handler(JSRuntime *rt, void *opaque) {
+  QJS_RuntimeState *state = static_cast<QJS_RuntimeState *>(opaque);
+  if (state->polls_left >= 0) {
+    if (state->polls_left == 0) {
+      state->interrupt_reason = QJS_INTERRUPT_OP_BUDGET;
+      return 1;
+    }
+    state->polls_left--;
+  }
+  if (state->deadline_ns != 0 && QJS_GetMonotonicTime() >= state->deadline_ns) {
+    state->interrupt_reason = QJS_INTERRUPT_DEADLINE;
+    return 1;
+  }
+  if (state->host_interrupt && (*state->interrupt)(rt, state->host_id)) {
+    state->interrupt_reason = QJS_INTERRUPT_HOST;
+    return 1;
+  }
+  return 0;
+}
+
+static void qjs_update_interrupt_handler(JSRuntime *rt, QJS_RuntimeState *state) {
+  if (state->host_interrupt || state->deadline_ns != 0 || state->polls_left >= 0) {
+    JS_SetInterruptHandler(rt, &qts_interrupt_handler, state);
+  } else {
+    JS_SetInterruptHandler(rt, NULL, NULL);
   }
-  return (*bound_interrupt)(rt);
 }
 
-void QJS_SetInterruptCallback(QJS_C_To_HostInterruptFunc *cb) {
-  bound_interrupt = cb;
+void QJS_SetInterruptCallback(JSRuntime *rt, QJS_C_To_HostInterruptFunc *cb) {
+  qjs_get_runtime_state(rt)->interrupt = cb;
 }
 
 void QJS_RuntimeEnableInterruptHandler(JSRuntime *rt) {
-  if (bound_interrupt == NULL) {
+  QJS_RuntimeState *state = qjs_get_runtime_state(rt);
+  if (state->interrupt == NULL) {
     printf(PKG "cannot enable interrupt handler because no QJS_C_To_HostInterruptFunc set");
     abort();
   }
 
-  JS_SetInterruptHandler(rt, &qts_interrupt_handler, NULL);
+  state->host_interrupt = true;
+  qjs_update_interrupt_handler(rt, state);
 }
 
 void QJS_RuntimeDisableInterruptHandler(JSRuntime *rt) {
-  JS_SetInterruptHandler(rt, NULL, NULL);
+  QJS_RuntimeState *state = qjs_get_runtime_state(rt);
+  state->host_interrupt = false;
+  qjs_update_interrupt_handler(rt, state);
+}
+
+/**
+ * Interrupt execution once QJS_GetMonotonicTime reaches `deadline_ns`. Set to 0 to remove the deadline.
+ */
+void QJS_RuntimeSetDeadline(JSRuntime *rt, int64_t deadline_ns) {
+  QJS_RuntimeState *state = qjs_get_runtime_state(rt);
+  state->deadline_ns = deadline_ns;
+  qjs_update_interrupt_handler(rt, state);
+}
+
+/**
+ * Interrupt execution after about `ops` more ops, counted at the granularity of the interrupt
+ * polls. Set to -1 to remove the budget.
+ */
+void QJS_RuntimeSetOpBudget(JSRuntime *rt, int64_t ops) {
+  QJS_RuntimeState *state = qjs_get_runtime_state(rt);
+  state->polls_left = ops < 0 ? -1 : ops / QJS_INTERRUPT_POLL_OPS;
+  qjs_update_interrupt_handler(rt, state);
+}
+
+/**
+ * Why execution was last interrupted, one of QJS_INTERRUPT_*. Reading it clears it.
+ */
+int32_t QJS_RuntimeTakeInterruptReason(JSRuntime *rt) {
+  QJS_RuntimeState *state = qjs_get_runtime_state(rt);
+  int32_t reason = state->interrupt_reason;
+  state->interrupt_reason = QJS_INTERRUPT_NONE;
+  return reason;
 }
 
 /**
@@ -184,6 +444,66 @@ void QJS_RuntimeSetMemoryLimit(JSRuntime *rt, size_t limit) {
   JS_SetMemoryLimit(rt, limit);
 }
 
+/**
+ * Garbage collection
+ */
+
+/**
+ * Run an automatic collection once the heap reaches `threshold` bytes, -1 to disable them. After each one, the
+ * threshold is set `growth_percent` % above the heap size.
+ */
+void QJS_RuntimeSetGCThreshold(JSRuntime *rt, size_t threshold, int32_t growth_percent) {
+  JS_SetGCThreshold(rt, threshold);
+  JS_SetGCThresholdGrowth(rt, growth_percent);
+}
+
+#define QJS_GC_FULL 0
+#define QJS_GC_MINOR 1
+// full collection, only if something was allocated since the last one
+#define QJS_GC_IDLE 2
+
+/**
+ * Run a collection of `kind`, one of QJS_GC_*. Return 1 if it ran, see QJS_RuntimeGetGCStats for its time and the
+ * bytes it freed.
+ */
+int32_t QJS_RuntimeRunGC(JSRuntime *rt, int32_t kind) {
+  switch (kind) {
+    case QJS_GC_MINOR:
+      JS_RunMinorGC(rt);
+      return 1;
+    case QJS_GC_IDLE:
+      return JS_RunIdleGC(rt);
+    default:
+      JS_RunGC(rt);
+      return 1;
+  }
+}
+
+/**
+ * Collector mode, one of JS_GC_MODE_*. In JS_GC_MODE_GENERATIONAL, a minor collection scanning only the GC objects
+ * allocated since the previous collection runs every `young_threshold` of them.
+ */
+void QJS_RuntimeSetGCMode(JSRuntime *rt, int32_t mode, int32_t young_threshold) {
+  JS_SetGCMode(rt, (JSGCModeEnum)mode);
+  JS_SetGCYoungThreshold(rt, young_threshold);
+}
+
+/**
+ * Write the fields of JSGCStats to `out`, in order.
+ */
+void QJS_RuntimeGetGCStats(JSRuntime *rt, int64_t *out) {
+  JSGCStats s;
+  JS_GetGCStats(rt, &s);
+  out[0] = s.minor_count;
+  out[1] = s.minor_time_us;
+  out[2] = s.full_count;
+  out[3] = s.full_time_us;
+  out[4] = s.max_pause_us;
+  out[5] = s.last_pause_us;
+  out[6] = s.freed_bytes;
+  out[7] = s.last_freed_bytes;
+}
+
 /**
  * Memory diagnostics
  */
@@ -224,7 +544,7 @@ JSValue *QJS_RuntimeComputeMemoryUsage(JSRuntime *rt, JSContext *ctx) {
   JS_SetPropertyStr(ctx, result, "binary_object_count", JS_NewInt64(ctx, s.binary_object_count));
   JS_SetPropertyStr(ctx, result, "binary_object_size", JS_NewInt64(ctx, s.binary_object_size));
 
-  return jsvalue_to_heap(result);
+  return jsvalue_to_heap(ctx, result);
 }
 
 char* QJS_RuntimeDumpMemoryUsage(JSRuntime *rt, int size) {
@@ -261,227 +581,1148 @@ JSValueConst *QJS_GetTrue() {
   return &QJS_True;
 }
 
+static inline bool qjs_is_constant_pointer(JSValueConst *value) {
+  return value == &QJS_Undefined || value == &QJS_Null || value == &QJS_False || value == &QJS_True;
+}
+
 JSValue *QJS_NewBool(JSContext *ctx, int32_t val) {
-  return jsvalue_to_heap(JS_NewBool(ctx, val));
+  return jsvalue_to_heap(ctx, JS_NewBool(ctx, val));
 }
 
 /**
  * Standard FFI functions
  */
 
-JSRuntime *QJS_NewRuntime() {
-  return JS_NewRuntime();
-}
+/**
+ * External buffers
+ *
+ * Reference counted blocks holding the data of ArrayBuffers. Every ArrayBuffer of a runtime is
+ * backed by one, so the host can keep a view of its bytes alive after the ArrayBuffer is freed,
+ * and can create ArrayBuffers over memory it filled itself, without copying in either direction.
+ * The count is atomic: the host may release its references from any thread.
+ */
+typedef struct QJS_ExternalBuffer {
+  std::atomic<int32_t> ref_count;
+  size_t len;
+} QJS_ExternalBuffer;
 
-void QJS_FreeRuntime(JSRuntime *rt) {
-  JS_FreeRuntime(rt);
+// keeps the data aligned for any element type
+#define QJS_EXTERNAL_BUFFER_HEADER_SIZE 16
+static_assert(sizeof(QJS_ExternalBuffer) <= QJS_EXTERNAL_BUFFER_HEADER_SIZE, "external buffer header too large");
+
+static inline QJS_ExternalBuffer *qjs_external_buffer_of(void *data) {
+  return reinterpret_cast<QJS_ExternalBuffer *>(static_cast<uint8_t *>(data) - QJS_EXTERNAL_BUFFER_HEADER_SIZE);
 }
 
-JSContext *QJS_NewContext(JSRuntime *rt) {
-  return JS_NewContext(rt);
+/**
+ * Allocate an uninitialized external buffer of `len` bytes with one reference, NULL when out of memory.
+ */
+uint8_t *QJS_NewExternalBuffer(size_t len) {
+  void *block = malloc(QJS_EXTERNAL_BUFFER_HEADER_SIZE + len);
+  if (block == NULL) {
+    return NULL;
+  }
+  QJS_ExternalBuffer *buffer = new (block) QJS_ExternalBuffer;
+  buffer->ref_count.store(1, std::memory_order_relaxed);
+  buffer->len = len;
+  return static_cast<uint8_t *>(block) + QJS_EXTERNAL_BUFFER_HEADER_SIZE;
 }
 
-void QJS_FreeContext(JSContext *ctx) {
-  JS_FreeContext(ctx);
+void QJS_ExternalBufferRetain(void *data) {
+  qjs_external_buffer_of(data)->ref_count.fetch_add(1, std::memory_order_relaxed);
 }
 
-void QJS_FreeValuePointer(JSContext *ctx, JSValue *value) {
-  JS_FreeValue(ctx, *value);
-  free(value);
+/**
+ * Drop a reference of an external buffer, it is freed with the last one.
+ * Can be used as a Dart NativeFinalizer callback.
+ */
+void QJS_ExternalBufferRelease(void *data) {
+  QJS_ExternalBuffer *buffer = qjs_external_buffer_of(data);
+  if (buffer->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    buffer->~QJS_ExternalBuffer();
+    free(buffer);
+  }
 }
 
-JSValue *QJS_DupValuePointer(JSContext* ctx, JSValueConst *val) {
-  return jsvalue_to_heap(JS_DupValue(ctx, *val));
+/**
+ * The bytes of the external buffers held by the ArrayBuffers of a runtime are counted in its memory usage, so
+ * they are bounded by its memory limit and their garbage triggers collections like any other allocation.
+ */
+static bool qjs_external_buffer_account(JSRuntime *rt, size_t size) {
+  if (JS_AddExternalMemory(rt, size) == 0) {
+    return true;
+  }
+  // the garbage may hold enough external buffers.
+  JS_RunGC(rt);
+  return JS_AddExternalMemory(rt, size) == 0;
 }
 
-JSValue *QJS_NewObject(JSContext *ctx) {
-  return jsvalue_to_heap(JS_NewObject(ctx));
+static void *qjs_external_buffer_alloc(void *opaque, size_t size) {
+  JSRuntime *rt = static_cast<JSRuntime *>(opaque);
+  if (!qjs_external_buffer_account(rt, size)) {
+    return NULL;
+  }
+  uint8_t *data = QJS_NewExternalBuffer(size);
+  if (data == NULL) {
+    JS_RemoveExternalMemory(rt, size);
+  }
+  return data;
 }
 
-JSValue *QJS_NewObjectProto(JSContext *ctx, JSValueConst *proto) {
-  return jsvalue_to_heap(JS_NewObjectProto(ctx, *proto));
+static void qjs_external_buffer_free(JSRuntime *rt, void *opaque, void *ptr) {
+  JS_RemoveExternalMemory(rt, qjs_external_buffer_of(ptr)->len);
+  QJS_ExternalBufferRelease(ptr);
 }
 
-JSValue *QJS_NewArray(JSContext *ctx) {
-  return jsvalue_to_heap(JS_NewArray(ctx));
+/**
+ * Create an ArrayBuffer over the `len` first bytes of the external buffer `data`, which gains a reference.
+ */
+JSValue *QJS_NewArrayBufferExternal(JSContext *ctx, uint8_t *data, size_t len) {
+  if (len > qjs_external_buffer_of(data)->len) {
+    return jsvalue_to_heap(ctx, JS_ThrowRangeError(ctx, "invalid array buffer length"));
+  }
+  JSRuntime *rt = JS_GetRuntime(ctx);
+  size_t size = qjs_external_buffer_of(data)->len;
+  if (!qjs_external_buffer_account(rt, size)) {
+    return jsvalue_to_heap(ctx, JS_ThrowOutOfMemory(ctx));
+  }
+  QJS_ExternalBufferRetain(data);
+  JSValue value = JS_NewArrayBuffer(ctx, data, len, &qjs_external_buffer_free, NULL, 0);
+  if (JS_IsException(value)) {
+    JS_RemoveExternalMemory(rt, size);
+    QJS_ExternalBufferRelease(data);
+  }
+  return jsvalue_to_heap(ctx, value);
 }
 
-JSValue *QJS_NewFloat64(JSContext *ctx, double num) {
-  return jsvalue_to_heap(JS_NewFloat64(ctx, num));
+/**
+ * Take a reference of the external buffer holding the data of the ArrayBuffer `obj`.
+ *
+ * When the data is not held by an external buffer (e.g. a SharedArrayBuffer), it is copied into a
+ * new one. Returns NULL with an exception pending when `obj` is not an ArrayBuffer or is detached.
+ */
+uint8_t *QJS_RetainArrayBuffer(JSContext *ctx, JSValueConst *obj, size_t *psize) {
+  JSFreeArrayBufferDataFunc *free_func = NULL;
+  void *opaque = NULL;
+  uint8_t *data = JS_GetArrayBufferInfo(ctx, psize, &free_func, &opaque, *obj);
+  if (data == NULL) {
+    return NULL;
+  }
+  if (free_func == &qjs_external_buffer_free) {
+    QJS_ExternalBufferRetain(data);
+    return data;
+  }
+  uint8_t *copy = QJS_NewExternalBuffer(*psize);
+  if (copy == NULL) {
+    JS_ThrowOutOfMemory(ctx);
+    return NULL;
+  }
+  memcpy(copy, data, *psize);
+  return copy;
 }
 
-double QJS_GetFloat64(JSContext *ctx, JSValueConst *value) {
-  double result = NAN;
-  JS_ToFloat64(ctx, &result, *value);
-  return result;
+/**
+ * Size-class allocator
+ *
+ * Blocks of up to QJS_SLAB_MAX_SIZE bytes, header included, are carved from chunks and recycled through a free
+ * list per size class. Larger blocks come from malloc and are linked in a list. Each block is preceded by a tag
+ * telling its class, padded so blocks keep the 16 bytes alignment of malloc. Chunks and large blocks are released
+ * in bulk with the runtime, JS_FreeRuntime still frees every object before since finalizers have to run. A runtime
+ * is only used by one thread at a time, so the allocator has no locking.
+ */
+
+#define QJS_SLAB_CHUNK_SIZE (64 * 1024)
+#define QJS_SLAB_GRANULE 16
+#define QJS_SLAB_CLASS_COUNT 16
+#define QJS_SLAB_MAX_SIZE (QJS_SLAB_GRANULE * (QJS_SLAB_CLASS_COUNT + 1))
+// tag of the large blocks, also the index of their counters
+#define QJS_SLAB_LARGE QJS_SLAB_CLASS_COUNT
+// the tag of a block is the first 8 bytes of the 16 before it
+#define QJS_SLAB_TAG_SIZE QJS_SLAB_GRANULE
+#define QJS_SLAB_LARGE_HEADER_SIZE 48
+// keeps the blocks of a chunk aligned like its start
+#define QJS_SLAB_CHUNK_HEADER_SIZE QJS_SLAB_GRANULE
+
+typedef struct QJS_SlabLarge {
+  struct QJS_SlabLarge *prev;
+  struct QJS_SlabLarge *next;
+  size_t size;
+} QJS_SlabLarge;
+static_assert(sizeof(QJS_SlabLarge) + QJS_SLAB_TAG_SIZE <= QJS_SLAB_LARGE_HEADER_SIZE, "large block header too large");
+static_assert(QJS_SLAB_LARGE_HEADER_SIZE % QJS_SLAB_GRANULE == 0, "large blocks misaligned");
+
+typedef struct QJS_SlabAllocator {
+  void *free_lists[QJS_SLAB_CLASS_COUNT];
+  // unused part of the last chunk
+  uint8_t *cur;
+  uint8_t *end;
+  // chunks linked through their first word
+  void *chunks;
+  QJS_SlabLarge large;
+  // per class, QJS_SLAB_LARGE last: blocks in use, blocks allocated overall, blocks carved from chunks
+  int64_t live[QJS_SLAB_CLASS_COUNT + 1];
+  int64_t allocs[QJS_SLAB_CLASS_COUNT + 1];
+  int64_t reserved[QJS_SLAB_CLASS_COUNT + 1];
+} QJS_SlabAllocator;
+
+static inline uint64_t qjs_slab_tag(const void *ptr) {
+  uint64_t tag;
+  memcpy(&tag, static_cast<const uint8_t *>(ptr) - QJS_SLAB_TAG_SIZE, sizeof(tag));
+  return tag;
 }
 
-JSValue *QJS_NewString(JSContext *ctx, HeapChar *string) {
-  return jsvalue_to_heap(JS_NewString(ctx, string));
+static inline size_t qjs_slab_block_size(int size_class) {
+  return (size_class + 2) * QJS_SLAB_GRANULE;
 }
 
-char* QJS_GetString(JSContext *ctx, JSValueConst *value) {
-  const char* owned = JS_ToCString(ctx, *value);
-  if(owned == NULL) {
-    return NULL;
+// class of a request of `size` bytes, QJS_SLAB_LARGE when too large
+static inline int qjs_slab_class(size_t size) {
+  if (size > QJS_SLAB_MAX_SIZE - QJS_SLAB_TAG_SIZE) {
+    return QJS_SLAB_LARGE;
   }
-  char* result = strdup(owned);
-  JS_FreeCString(ctx, owned);
-  return result;
+  // a freed block holds the free list link, even one of 0 bytes
+  return size == 0 ? 0 : (int)((size - 1) / QJS_SLAB_GRANULE);
 }
 
-int QJS_IsJobPending(JSRuntime *rt) {
-  return JS_IsJobPending(rt);
+static inline QJS_SlabLarge *qjs_slab_large_of(void *ptr) {
+  return reinterpret_cast<QJS_SlabLarge *>(static_cast<uint8_t *>(ptr) - QJS_SLAB_LARGE_HEADER_SIZE);
 }
 
-/*
-  runs pending jobs (Promises/async functions) until it encounters
-  an exception or it executed the passed maxJobsToExecute jobs.
-
-  Passing a negative value will run the loop until there are no more
-  pending jobs or an exception happened
-
-  Returns the executed number of jobs or the exception encountered
-*/
-JSValue *QJS_ExecutePendingJob(JSRuntime *rt, int maxJobsToExecute) {
-  JSContext *pctx;
-  int status = 1;
-  int executed = 0;
-  while (executed != maxJobsToExecute && status == 1) {
-    status = JS_ExecutePendingJob(rt, &pctx);
-    if (status == -1) {
-      return jsvalue_to_heap(JS_GetException(pctx));
-    } else if (status == 1) {
-      executed++;
-    }
+static size_t qjs_slab_usable_size(const void *ptr) {
+  uint64_t tag = qjs_slab_tag(ptr);
+  if (tag == QJS_SLAB_LARGE) {
+    return qjs_slab_large_of(const_cast<void *>(ptr))->size;
   }
-  return jsvalue_to_heap(JS_NewFloat64(pctx, executed));
+  return qjs_slab_block_size((int)tag) - QJS_SLAB_TAG_SIZE;
 }
 
-JSValue *QJS_GetProp(JSContext *ctx, JSValueConst *this_val, JSValueConst *prop_name) {
-  JSAtom prop_atom = JS_ValueToAtom(ctx, *prop_name);
-  JSValue prop_val = JS_GetProperty(ctx, *this_val, prop_atom);
-  JS_FreeAtom(ctx, prop_atom);
-  return jsvalue_to_heap(prop_val);
+static void *qjs_slab_malloc(JSMallocState *s, size_t size) {
+  QJS_SlabAllocator *a = static_cast<QJS_SlabAllocator *>(s->opaque);
+  int size_class = qjs_slab_class(size);
+  uint8_t *ptr;
+  size_t block_size;
+  if (size_class == QJS_SLAB_LARGE) {
+    block_size = QJS_SLAB_LARGE_HEADER_SIZE + size;
+    if (s->malloc_size + block_size > s->malloc_limit) {
+      return NULL;
+    }
+    QJS_SlabLarge *large = static_cast<QJS_SlabLarge *>(malloc(block_size));
+    if (large == NULL) {
+      return NULL;
+    }
+    large->size = size;
+    large->prev = &a->large;
+    large->next = a->large.next;
+    a->large.next->prev = large;
+    a->large.next = large;
+    ptr = reinterpret_cast<uint8_t *>(large) + QJS_SLAB_LARGE_HEADER_SIZE;
+  } else {
+    block_size = qjs_slab_block_size(size_class);
+    if (s->malloc_size + block_size > s->malloc_limit) {
+      return NULL;
+    }
+    ptr = static_cast<uint8_t *>(a->free_lists[size_class]);
+    if (ptr != NULL) {
+      memcpy(&a->free_lists[size_class], ptr, sizeof(void *));
+    } else {
+      if (a->cur + block_size > a->end) {
+        uint8_t *chunk = static_cast<uint8_t *>(malloc(QJS_SLAB_CHUNK_SIZE));
+        if (chunk == NULL) {
+          return NULL;
+        }
+        memcpy(chunk, &a->chunks, sizeof(void *));
+        a->chunks = chunk;
+        a->cur = chunk + QJS_SLAB_CHUNK_HEADER_SIZE;
+        a->end = chunk + QJS_SLAB_CHUNK_SIZE;
+      }
+      ptr = a->cur + QJS_SLAB_TAG_SIZE;
+      a->cur += block_size;
+      a->reserved[size_class]++;
+    }
+  }
+  uint64_t tag = size_class;
+  memcpy(ptr - QJS_SLAB_TAG_SIZE, &tag, sizeof(tag));
+  a->live[size_class]++;
+  a->allocs[size_class]++;
+  s->malloc_count++;
+  s->malloc_size += block_size;
+  return ptr;
 }
 
-void QJS_SetProp(JSContext *ctx, JSValueConst *this_val, JSValueConst *prop_name, JSValueConst *prop_value) {
-  JSAtom prop_atom = JS_ValueToAtom(ctx, *prop_name);
-  JSValue extra_prop_value = JS_DupValue(ctx, *prop_value);
-  // TODO: should we use DefineProperty internally if this object doesn't have the property yet?
-  JS_SetProperty(ctx, *this_val, prop_atom, extra_prop_value); // consumes extra_prop_value
-  JS_FreeAtom(ctx, prop_atom);
+static void qjs_slab_free(JSMallocState *s, void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  QJS_SlabAllocator *a = static_cast<QJS_SlabAllocator *>(s->opaque);
+  int size_class = (int)qjs_slab_tag(ptr);
+  s->malloc_count--;
+  a->live[size_class]--;
+  if (size_class == QJS_SLAB_LARGE) {
+    QJS_SlabLarge *large = qjs_slab_large_of(ptr);
+    s->malloc_size -= QJS_SLAB_LARGE_HEADER_SIZE + large->size;
+    large->prev->next = large->next;
+    large->next->prev = large->prev;
+    free(large);
+  } else {
+    s->malloc_size -= qjs_slab_block_size(size_class);
+    memcpy(ptr, &a->free_lists[size_class], sizeof(void *));
+    a->free_lists[size_class] = ptr;
+  }
 }
 
-void QJS_DefineProp(JSContext *ctx, JSValueConst *this_val, JSValueConst *prop_name, JSValueConst *prop_value, JSValueConst *get, JSValueConst *set, bool configurable, bool enumerable, bool writable, bool has_value) {
-  JSAtom prop_atom = JS_ValueToAtom(ctx, *prop_name);
-
-  int flags = 0;
-  if (configurable) {
-    flags = flags | JS_PROP_CONFIGURABLE;
-    if (has_value) {
-      flags = flags | JS_PROP_HAS_CONFIGURABLE;
-    }
-  }
-  if (enumerable) {
-    flags = flags | JS_PROP_ENUMERABLE;
-    if (has_value) {
-      flags = flags | JS_PROP_HAS_ENUMERABLE;
-    }
+static void *qjs_slab_realloc(JSMallocState *s, void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return size == 0 ? NULL : qjs_slab_malloc(s, size);
   }
-  if (writable) {
-      flags = flags | JS_PROP_WRITABLE;
-      if (has_value) {
-          flags = flags | JS_PROP_HAS_WRITABLE;
-      }
+  if (size == 0) {
+    qjs_slab_free(s, ptr);
+    return NULL;
   }
-  if (!JS_IsUndefined(*get)) {
-    flags = flags | JS_PROP_HAS_GET;
+  int size_class = (int)qjs_slab_tag(ptr);
+  int new_class = qjs_slab_class(size);
+  if (new_class == size_class && size_class != QJS_SLAB_LARGE) {
+    return ptr;
   }
-  if (!JS_IsUndefined(*set)) {
-    flags = flags | JS_PROP_HAS_SET;
+  if (new_class == QJS_SLAB_LARGE && size_class == QJS_SLAB_LARGE) {
+    QJS_SlabLarge *large = qjs_slab_large_of(ptr);
+    size_t old_size = large->size;
+    if (size > old_size && s->malloc_size + (size - old_size) > s->malloc_limit) {
+      return NULL;
+    }
+    QJS_SlabLarge *prev = large->prev;
+    QJS_SlabLarge *next = large->next;
+    large = static_cast<QJS_SlabLarge *>(realloc(large, QJS_SLAB_LARGE_HEADER_SIZE + size));
+    if (large == NULL) {
+      return NULL;
+    }
+    large->size = size;
+    prev->next = large;
+    next->prev = large;
+    s->malloc_size += size - old_size;
+    return reinterpret_cast<uint8_t *>(large) + QJS_SLAB_LARGE_HEADER_SIZE;
   }
-  if (has_value) {
-    flags = flags | JS_PROP_HAS_VALUE;
+  void *moved = qjs_slab_malloc(s, size);
+  if (moved == NULL) {
+    return NULL;
   }
-
-  JS_DefineProperty(ctx, *this_val, prop_atom, *prop_value, *get, *set, flags);
-  JS_FreeAtom(ctx, prop_atom);
+  size_t old_size = qjs_slab_usable_size(ptr);
+  memcpy(moved, ptr, old_size < size ? old_size : size);
+  qjs_slab_free(s, ptr);
+  return moved;
 }
 
-
-JSValue *QJS_Call(JSContext *ctx, JSValueConst *func_obj, JSValueConst *this_obj, int argc, JSValueConst **argv_ptrs) {
-  // convert array of pointers to array of values
-  JSValueConst *argv = new JSValueConst[argc];
-  int i;
-  for (i=0; i<argc; i++) {
-    argv[i] = *(argv_ptrs[i]);
+static const JSMallocFunctions qjs_slab_malloc_funcs = {
+  &qjs_slab_malloc,
+  &qjs_slab_free,
+  &qjs_slab_realloc,
+  &qjs_slab_usable_size,
+};
+
+static QJS_SlabAllocator *qjs_slab_new() {
+  QJS_SlabAllocator *a = static_cast<QJS_SlabAllocator *>(calloc(1, sizeof(QJS_SlabAllocator)));
+  if (a != NULL) {
+    a->large.prev = &a->large;
+    a->large.next = &a->large;
   }
-
-  return jsvalue_to_heap(JS_Call(ctx, *func_obj, *this_obj, argc, argv));
+  return a;
 }
 
-void QJS_CallVoid(JSContext *ctx, JSValueConst *func_obj, JSValueConst *this_obj, int argc, JSValueConst **argv_ptrs) {
-  // convert array of pointers to array of values
-  JSValueConst *argv = new JSValueConst[argc];
-  int i;
-  for (i=0; i<argc; i++) {
-    argv[i] = *(argv_ptrs[i]);
+// release every chunk and large block, including the ones the runtime did not free
+static void qjs_slab_release(QJS_SlabAllocator *a) {
+  while (a->chunks != NULL) {
+    void *chunk = a->chunks;
+    memcpy(&a->chunks, chunk, sizeof(void *));
+    free(chunk);
   }
-
-  JSValue res = JS_Call(ctx, *func_obj, *this_obj, argc, argv);
-  JS_FreeValue(ctx, res);
+  QJS_SlabLarge *large = a->large.next;
+  while (large != &a->large) {
+    QJS_SlabLarge *next = large->next;
+    free(large);
+    large = next;
+  }
+  free(a);
 }
 
 /**
- * If maybe_exception is an exception, get the error.
- * Otherwise, return NULL.
+ * Arena allocator
+ *
+ * For runtimes running a script or two before being freed: blocks are bumped from chunks and never reused, free
+ * only updates the block count. The memory limit applies to the bytes bumped, and the whole arena is released at
+ * once with the runtime.
  */
-JSValue *QJS_ResolveException(JSContext *ctx, JSValue *maybe_exception) {
-  if (JS_IsException(*maybe_exception)) {
-    return jsvalue_to_heap(JS_GetException(ctx));
-  }
 
-  return NULL;
+#define QJS_BUMP_MIN_CHUNK_SIZE (64 * 1024)
+#define QJS_BUMP_MAX_CHUNK_SIZE (1024 * 1024)
+// the size of a block is the 8 bytes before it, blocks are 8 bytes aligned
+#define QJS_BUMP_HEADER_SIZE 8
+#define QJS_BUMP_CHUNK_HEADER_SIZE 16
+
+typedef struct QJS_BumpArena {
+  uint8_t *cur;
+  uint8_t *end;
+  // chunks linked through their first word
+  void *chunks;
+  size_t next_chunk_size;
+} QJS_BumpArena;
+
+static inline size_t qjs_bump_align(size_t size) {
+  return (size + 7) & ~(size_t)7;
 }
 
-char *QJS_Dump(JSContext *ctx, JSValueConst *obj) {
-  JSValue obj_json_value = JS_JSONStringify(ctx, *obj, JS_UNDEFINED, JS_UNDEFINED);
-  if (!JS_IsException(obj_json_value)) {
-    const char* obj_json_chars = JS_ToCString(ctx, obj_json_value);
-    JS_FreeValue(ctx, obj_json_value);
-    if (obj_json_chars != NULL) {
-      JSValue enumerable_props = JS_ParseJSON(ctx, obj_json_chars, strlen(obj_json_chars), "<dump>");
-      JS_FreeCString(ctx, obj_json_chars);
-      if (!JS_IsException(enumerable_props)) {
-        // Copy common non-enumerable props for different object types.
-        // Errors:
-        copy_prop_if_needed(ctx, enumerable_props, *obj, "name");
-        copy_prop_if_needed(ctx, enumerable_props, *obj, "message");
-        copy_prop_if_needed(ctx, enumerable_props, *obj, "stack");
+static size_t qjs_bump_usable_size(const void *ptr) {
+  uint64_t size;
+  memcpy(&size, static_cast<const uint8_t *>(ptr) - QJS_BUMP_HEADER_SIZE, sizeof(size));
+  return (size_t)size;
+}
 
-        // Serialize again.
-        JSValue enumerable_json = JS_JSONStringify(ctx, enumerable_props, JS_UNDEFINED, JS_UNDEFINED);
-        JS_FreeValue(ctx, enumerable_props);
+static inline void qjs_bump_set_size(void *ptr, size_t size) {
+  uint64_t value = size;
+  memcpy(static_cast<uint8_t *>(ptr) - QJS_BUMP_HEADER_SIZE, &value, sizeof(value));
+}
 
-        char * result = QJS_GetString(ctx, &enumerable_json);
-        JS_FreeValue(ctx, enumerable_json);
-        return result;
-      }
-    }
+static void *qjs_bump_malloc(JSMallocState *s, size_t size) {
+  QJS_BumpArena *a = static_cast<QJS_BumpArena *>(s->opaque);
+  size = qjs_bump_align(size);
+  size_t block_size = QJS_BUMP_HEADER_SIZE + size;
+  if (s->malloc_size + block_size > s->malloc_limit) {
+    return NULL;
   }
+  if (block_size > (size_t)(a->end - a->cur)) {
+    size_t chunk_size = a->next_chunk_size;
+    if (chunk_size < QJS_BUMP_MAX_CHUNK_SIZE) {
+      a->next_chunk_size = chunk_size * 2;
+    }
+    if (chunk_size < QJS_BUMP_CHUNK_HEADER_SIZE + block_size) {
+      chunk_size = QJS_BUMP_CHUNK_HEADER_SIZE + block_size;
+    }
+    uint8_t *chunk = static_cast<uint8_t *>(malloc(chunk_size));
+    if (chunk == NULL) {
+      return NULL;
+    }
+    memcpy(chunk, &a->chunks, sizeof(void *));
+    a->chunks = chunk;
+    // a block too large for the chunk size gets its own chunk and the current one is kept.
+    if (chunk_size - (QJS_BUMP_CHUNK_HEADER_SIZE + block_size) < (size_t)(a->end - a->cur)) {
+      uint8_t *ptr = chunk + QJS_BUMP_CHUNK_HEADER_SIZE + QJS_BUMP_HEADER_SIZE;
+      qjs_bump_set_size(ptr, size);
+      s->malloc_count++;
+      s->malloc_size += block_size;
+      return ptr;
+    }
+    a->cur = chunk + QJS_BUMP_CHUNK_HEADER_SIZE;
+    a->end = chunk + chunk_size;
+  }
+  uint8_t *ptr = a->cur + QJS_BUMP_HEADER_SIZE;
+  a->cur += block_size;
+  qjs_bump_set_size(ptr, size);
+  s->malloc_count++;
+  s->malloc_size += block_size;
+  return ptr;
+}
 
-#ifdef QJS_DEBUG_MODE
-  qts_log("Error dumping JSON:");
-  js_std_dump_error(ctx);
-#endif
+static void qjs_bump_free(JSMallocState *s, void *ptr) {
+  if (ptr != NULL) {
+    s->malloc_count--;
+  }
+}
+
+static void *qjs_bump_realloc(JSMallocState *s, void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return size == 0 ? NULL : qjs_bump_malloc(s, size);
+  }
+  if (size == 0) {
+    qjs_bump_free(s, ptr);
+    return NULL;
+  }
+  QJS_BumpArena *a = static_cast<QJS_BumpArena *>(s->opaque);
+  size_t old_size = qjs_bump_usable_size(ptr);
+  size = qjs_bump_align(size);
+  if (size <= old_size) {
+    return ptr;
+  }
+  // the last block grows in place, like the buffers being appended to.
+  uint8_t *end = static_cast<uint8_t *>(ptr) + old_size;
+  if (end == a->cur && size - old_size <= (size_t)(a->end - a->cur)) {
+    if (s->malloc_size + (size - old_size) > s->malloc_limit) {
+      return NULL;
+    }
+    a->cur += size - old_size;
+    s->malloc_size += size - old_size;
+    qjs_bump_set_size(ptr, size);
+    return ptr;
+  }
+  void *moved = qjs_bump_malloc(s, size);
+  if (moved == NULL) {
+    return NULL;
+  }
+  memcpy(moved, ptr, old_size);
+  s->malloc_count--;
+  return moved;
+}
 
-  // Fallback: convert to string
-  return QJS_GetString(ctx, obj);
+static const JSMallocFunctions qjs_bump_malloc_funcs = {
+  &qjs_bump_malloc,
+  &qjs_bump_free,
+  &qjs_bump_realloc,
+  &qjs_bump_usable_size,
+};
+
+static QJS_BumpArena *qjs_bump_new() {
+  QJS_BumpArena *a = static_cast<QJS_BumpArena *>(calloc(1, sizeof(QJS_BumpArena)));
+  if (a != NULL) {
+    a->next_chunk_size = QJS_BUMP_MIN_CHUNK_SIZE;
+  }
+  return a;
+}
+
+static void qjs_bump_release(QJS_BumpArena *a) {
+  while (a->chunks != NULL) {
+    void *chunk = a->chunks;
+    memcpy(&a->chunks, chunk, sizeof(void *));
+    free(chunk);
+  }
+  free(a);
+}
+
+#define QJS_ALLOCATOR_SYSTEM 0
+#define QJS_ALLOCATOR_SLAB 1
+// see QJS_BumpArena, automatic GC is disabled.
+#define QJS_ALLOCATOR_ARENA 2
+
+/**
+ * Create a runtime allocating with `allocator`, one of QJS_ALLOCATOR_*.
+ */
+JSRuntime *QJS_NewRuntimeWithAllocator(int32_t allocator) {
+  QJS_RuntimeState *state = static_cast<QJS_RuntimeState *>(calloc(1, sizeof(QJS_RuntimeState)));
+  if (state == NULL) {
+    return NULL;
+  }
+  JSRuntime *rt;
+  if (allocator == QJS_ALLOCATOR_SLAB) {
+    state->slab = qjs_slab_new();
+    rt = state->slab == NULL ? NULL : JS_NewRuntime2(&qjs_slab_malloc_funcs, state->slab);
+  } else if (allocator == QJS_ALLOCATOR_ARENA) {
+    state->arena = qjs_bump_new();
+    rt = state->arena == NULL ? NULL : JS_NewRuntime2(&qjs_bump_malloc_funcs, state->arena);
+    if (rt != NULL) {
+      // a collection would not give any memory back.
+      JS_SetGCThreshold(rt, (size_t)-1);
+    }
+  } else {
+    rt = JS_NewRuntime();
+  }
+  if (rt == NULL) {
+    if (state->slab != NULL) {
+      qjs_slab_release(state->slab);
+    }
+    if (state->arena != NULL) {
+      qjs_bump_release(state->arena);
+    }
+    free(state);
+    return NULL;
+  }
+  state->polls_left = -1;
+  JS_SetRuntimeOpaque(rt, state);
+  JSArrayBufferFunctions ab_funcs = {&qjs_external_buffer_alloc, &qjs_external_buffer_free, rt};
+  JS_SetArrayBufferFunctions(rt, &ab_funcs);
+  return rt;
+}
+
+JSRuntime *QJS_NewRuntime() {
+  return QJS_NewRuntimeWithAllocator(QJS_ALLOCATOR_SYSTEM);
+}
+
+void QJS_FreeRuntime(JSRuntime *rt) {
+  QJS_RuntimeState *state = qjs_get_runtime_state(rt);
+  JS_FreeRuntime(rt);
+  if (state->slab != NULL) {
+    qjs_slab_release(state->slab);
+  }
+  if (state->arena != NULL) {
+    qjs_bump_release(state->arena);
+  }
+  free(state);
+}
+
+/**
+ * Write the counters of the size classes of a QJS_ALLOCATOR_SLAB runtime to `out`, 4 per class: block size (0 for
+ * the large blocks, last), blocks in use, blocks allocated overall and blocks carved from chunks. Returns the
+ * number of classes, 0 for other allocators.
+ */
+int32_t QJS_RuntimeGetAllocatorStats(JSRuntime *rt, int64_t *out) {
+  QJS_SlabAllocator *a = qjs_get_runtime_state(rt)->slab;
+  if (a == NULL) {
+    return 0;
+  }
+  for (int i = 0; i <= QJS_SLAB_CLASS_COUNT; i++) {
+    out[i * 4] = i == QJS_SLAB_LARGE ? 0 : qjs_slab_block_size(i);
+    out[i * 4 + 1] = a->live[i];
+    out[i * 4 + 2] = a->allocs[i];
+    out[i * 4 + 3] = a->reserved[i];
+  }
+  return QJS_SLAB_CLASS_COUNT + 1;
+}
+
+/**
+ * Global snapshots
+ *
+ * A context is recycled by putting the own properties of its global object and global let/const
+ * definitions back to a snapshot: properties added since are deleted, even when not configurable,
+ * and properties replaced or deleted are restored. Objects reachable from the globals, such as
+ * builtin prototypes, are not reverted.
+ */
+void qjs_snapshot_free(JSContext *ctx, QJS_ObjectSnapshot *snapshot) {
+  for (uint32_t i = 0; i < snapshot->count; i++) {
+    QJS_PropertySnapshot *prop = &snapshot->props[i];
+    JS_FreeAtom(ctx, prop->atom);
+    JS_FreeValue(ctx, prop->desc.value);
+    JS_FreeValue(ctx, prop->desc.getter);
+    JS_FreeValue(ctx, prop->desc.setter);
+  }
+  free(snapshot->props);
+  snapshot->props = NULL;
+  snapshot->count = 0;
+}
+
+void dart_free_prop_enums(JSContext *ctx, JSPropertyEnum *tab, uint32_t len);
+
+static int qjs_compare_property_snapshot(const void *a, const void *b) {
+  JSAtom atom_a = static_cast<const QJS_PropertySnapshot *>(a)->atom;
+  JSAtom atom_b = static_cast<const QJS_PropertySnapshot *>(b)->atom;
+  return atom_a < atom_b ? -1 : (atom_a > atom_b ? 1 : 0);
+}
+
+static QJS_PropertySnapshot *qjs_snapshot_find(QJS_ObjectSnapshot *snapshot, JSAtom atom) {
+  QJS_PropertySnapshot key;
+  key.atom = atom;
+  return static_cast<QJS_PropertySnapshot *>(bsearch(&key, snapshot->props, snapshot->count, sizeof(QJS_PropertySnapshot), qjs_compare_property_snapshot));
+}
+
+/**
+ * True if [a] and [b] are the very same value, without any conversion.
+ */
+static bool qjs_is_identical(JSValueConst a, JSValueConst b) {
+  if (JS_VALUE_GET_TAG(a) != JS_VALUE_GET_TAG(b)) {
+    return false;
+  }
+  if (JS_VALUE_HAS_REF_COUNT(a)) {
+    return JS_VALUE_GET_PTR(a) == JS_VALUE_GET_PTR(b);
+  }
+  if (JS_TAG_IS_FLOAT64(JS_VALUE_GET_TAG(a))) {
+    double da = JS_VALUE_GET_FLOAT64(a);
+    double db = JS_VALUE_GET_FLOAT64(b);
+    return memcmp(&da, &db, sizeof(double)) == 0;
+  }
+  return JS_VALUE_GET_INT(a) == JS_VALUE_GET_INT(b);
+}
+
+int qjs_snapshot_take(JSContext *ctx, QJS_ObjectSnapshot *snapshot, JSValueConst obj) {
+  JSPropertyEnum *tab;
+  uint32_t len;
+  qjs_snapshot_free(ctx, snapshot);
+  if (JS_GetOwnPropertyNames(ctx, &tab, &len, obj, JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK) != 0) {
+    return -1;
+  }
+  snapshot->props = static_cast<QJS_PropertySnapshot *>(malloc(sizeof(QJS_PropertySnapshot) * (len == 0 ? 1 : len)));
+  if (snapshot->props == NULL) {
+    dart_free_prop_enums(ctx, tab, len);
+    JS_ThrowOutOfMemory(ctx);
+    return -1;
+  }
+  for (uint32_t i = 0; i < len; i++) {
+    QJS_PropertySnapshot *prop = &snapshot->props[snapshot->count];
+    // takes over the atom reference of the enum table.
+    prop->atom = tab[i].atom;
+    if (JS_GetOwnProperty(ctx, &prop->desc, obj, prop->atom) == 1) {
+      snapshot->count++;
+    } else {
+      JS_FreeAtom(ctx, prop->atom);
+    }
+  }
+  js_free(ctx, tab);
+  qsort(snapshot->props, snapshot->count, sizeof(QJS_PropertySnapshot), qjs_compare_property_snapshot);
+  return 0;
+}
+
+static int qjs_snapshot_define(JSContext *ctx, JSValueConst obj, QJS_PropertySnapshot *prop) {
+  int flags = prop->desc.flags | JS_PROP_HAS_CONFIGURABLE | JS_PROP_HAS_ENUMERABLE;
+  if (prop->desc.flags & JS_PROP_GETSET) {
+    flags |= JS_PROP_HAS_GET | JS_PROP_HAS_SET;
+  } else {
+    flags |= JS_PROP_HAS_VALUE | JS_PROP_HAS_WRITABLE;
+  }
+  return JS_DefineProperty(ctx, obj, prop->atom, prop->desc.value, prop->desc.getter, prop->desc.setter, flags);
+}
+
+int qjs_snapshot_restore(JSContext *ctx, QJS_ObjectSnapshot *snapshot, JSValueConst obj) {
+  JSPropertyEnum *tab;
+  uint32_t len;
+  if (JS_GetOwnPropertyNames(ctx, &tab, &len, obj, JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK) != 0) {
+    return -1;
+  }
+  int res = 0;
+  for (uint32_t i = 0; i < len && res >= 0; i++) {
+    QJS_PropertySnapshot *prop = qjs_snapshot_find(snapshot, tab[i].atom);
+    if (prop != NULL) {
+      JSPropertyDescriptor desc;
+      if (JS_GetOwnProperty(ctx, &desc, obj, tab[i].atom) == 1) {
+        bool unchanged = desc.flags == prop->desc.flags
+          && qjs_is_identical(desc.value, prop->desc.value)
+          && qjs_is_identical(desc.getter, prop->desc.getter)
+          && qjs_is_identical(desc.setter, prop->desc.setter);
+        JS_FreeValue(ctx, desc.value);
+        JS_FreeValue(ctx, desc.getter);
+        JS_FreeValue(ctx, desc.setter);
+        if (unchanged) {
+          continue;
+        }
+      }
+    }
+    res = JS_DeletePropertyForce(ctx, obj, tab[i].atom);
+  }
+  dart_free_prop_enums(ctx, tab, len);
+  // put back what was replaced or deleted
+  for (uint32_t i = 0; i < snapshot->count && res >= 0; i++) {
+    QJS_PropertySnapshot *prop = &snapshot->props[i];
+    int has = JS_GetOwnProperty(ctx, NULL, obj, prop->atom);
+    if (has < 0) {
+      res = -1;
+    } else if (has == 0) {
+      res = qjs_snapshot_define(ctx, obj, prop);
+    }
+  }
+  return res < 0 ? -1 : 0;
+}
+
+/**
+ * Capture the current globals as the state QJS_ResetGlobals returns to.
+ * Returns -1 with the exception pending in [ctx] on failure.
+ */
+int QJS_SnapshotGlobals(JSContext *ctx) {
+  QJS_ContextState *state = qjs_get_context_state(ctx);
+  JSValue global = JS_GetGlobalObject(ctx);
+  JSValue global_vars = JS_GetGlobalVarObject(ctx);
+  int res = qjs_snapshot_take(ctx, &state->globals, global);
+  if (res == 0) {
+    res = qjs_snapshot_take(ctx, &state->global_vars, global_vars);
+  }
+  JS_FreeValue(ctx, global);
+  JS_FreeValue(ctx, global_vars);
+  return res;
+}
+
+/**
+ * Put the globals back to the last QJS_SnapshotGlobals and drop the pending jobs of the runtime.
+ * Returns -1 with the exception pending in [ctx] on failure.
+ */
+int QJS_ResetGlobals(JSContext *ctx) {
+  QJS_ContextState *state = qjs_get_context_state(ctx);
+  JS_ClearPendingJobs(JS_GetRuntime(ctx));
+  JSValue global = JS_GetGlobalObject(ctx);
+  JSValue global_vars = JS_GetGlobalVarObject(ctx);
+  int res = qjs_snapshot_restore(ctx, &state->global_vars, global_vars);
+  if (res == 0) {
+    res = qjs_snapshot_restore(ctx, &state->globals, global);
+  }
+  JS_FreeValue(ctx, global);
+  JS_FreeValue(ctx, global_vars);
+  return res;
+}
+
+JSContext *QJS_NewContext(JSRuntime *rt) {
+  JSContext *ctx = JS_NewContext(rt);
+  if (ctx == NULL) {
+    return NULL;
+  }
+  QJS_ContextState *state = static_cast<QJS_ContextState *>(malloc(sizeof(QJS_ContextState)));
+  if (state == NULL) {
+    JS_FreeContext(ctx);
+    return NULL;
+  }
+  memset(state, 0, sizeof(QJS_ContextState));
+  qjs_arena_init(&state->arena);
+  JS_SetContextOpaque(ctx, state);
+  return ctx;
+}
+
+/**
+ * Frees all handles still held by the host in bulk, then frees the context.
+ */
+void QJS_FreeContext(JSContext *ctx) {
+  QJS_ContextState *state = qjs_get_context_state(ctx);
+  if (state != NULL) {
+    qjs_snapshot_free(ctx, &state->globals);
+    qjs_snapshot_free(ctx, &state->global_vars);
+    qjs_arena_destroy(ctx, &state->arena);
+    free(state->args);
+    JS_SetContextOpaque(ctx, NULL);
+    free(state);
+  }
+  JS_FreeContext(ctx);
+}
+
+void QJS_FreeValuePointer(JSContext *ctx, JSValue *value) {
+  if (qjs_is_constant_pointer(value)) {
+    return;
+  }
+  QJS_HandleSlot *slot = reinterpret_cast<QJS_HandleSlot *>(value);
+  if (!qjs_slot_is_live(slot)) {
+    printf(PKG "QJS_FreeValuePointer: double free of handle %p\n", value);
+    return;
+  }
+  JS_FreeValue(ctx, jsvalue_take_from_heap(ctx, value));
+}
+
+/**
+ * Handle scopes
+ *
+ * QJS_OpenHandleScope returns a mark, QJS_CloseHandleScope frees every handle allocated
+ * after that mark which is still alive, in a single pass. Scopes must be closed in
+ * reverse order of opening.
+ */
+uint64_t QJS_OpenHandleScope(JSContext *ctx) {
+  return qjs_get_context_state(ctx)->arena.next_serial;
+}
+
+void QJS_CloseHandleScope(JSContext *ctx, uint64_t mark) {
+  qjs_arena_release_since(ctx, &qjs_get_context_state(ctx)->arena, mark);
+}
+
+/**
+ * Move a live handle out of every open handle scope, it must then be freed explicitly.
+ */
+void QJS_EscapeHandle(JSContext *ctx, JSValue *value) {
+  if (qjs_is_constant_pointer(value)) {
+    return;
+  }
+  QJS_HandleArena *arena = &qjs_get_context_state(ctx)->arena;
+  QJS_HandleSlot *slot = reinterpret_cast<QJS_HandleSlot *>(value);
+  // keep the live list ordered by serial: escaped slots sit at the head with serial 0.
+  slot->prev->next = slot->next;
+  slot->next->prev = slot->prev;
+  slot->serial = 0;
+  slot->prev = &arena->live;
+  slot->next = arena->live.next;
+  arena->live.next->prev = slot;
+  arena->live.next = slot;
+}
+
+/**
+ * Number of handles currently held by the host.
+ */
+int64_t QJS_GetLiveHandleCount(JSContext *ctx) {
+  return (int64_t) qjs_get_context_state(ctx)->arena.live_count;
+}
+
+JSValue *QJS_DupValuePointer(JSContext* ctx, JSValueConst *val) {
+  return jsvalue_to_heap(ctx, JS_DupValue(ctx, *val));
+}
+
+JSValue *QJS_NewObject(JSContext *ctx) {
+  return jsvalue_to_heap(ctx, JS_NewObject(ctx));
+}
+
+JSValue *QJS_NewObjectProto(JSContext *ctx, JSValueConst *proto) {
+  return jsvalue_to_heap(ctx, JS_NewObjectProto(ctx, *proto));
+}
+
+JSValue *QJS_NewArray(JSContext *ctx) {
+  return jsvalue_to_heap(ctx, JS_NewArray(ctx));
+}
+
+JSValue *QJS_NewFloat64(JSContext *ctx, double num) {
+  return jsvalue_to_heap(ctx, JS_NewFloat64(ctx, num));
+}
+
+double QJS_GetFloat64(JSContext *ctx, JSValueConst *value) {
+  double result = NAN;
+  JS_ToFloat64(ctx, &result, *value);
+  return result;
+}
+
+JSValue *QJS_NewString(JSContext *ctx, HeapChar *string) {
+  return jsvalue_to_heap(ctx, JS_NewString(ctx, string));
+}
+
+/**
+ * Create a string from `len` bytes of UTF-8, `string` does not need to be NUL terminated.
+ */
+JSValue *QJS_NewStringLen(JSContext *ctx, const char *string, size_t len) {
+  return jsvalue_to_heap(ctx, JS_NewStringLen(ctx, string, len));
+}
+
+/**
+ * Create a string from `len` Latin-1 characters, copied without conversion.
+ */
+JSValue *QJS_NewStringLatin1(JSContext *ctx, const uint8_t *string, size_t len) {
+  return jsvalue_to_heap(ctx, JS_NewStringLatin1(ctx, string, len));
+}
+
+/**
+ * Create a string from `len` UTF-16 code units, copied without conversion.
+ */
+JSValue *QJS_NewStringUTF16(JSContext *ctx, const uint16_t *string, size_t len) {
+  return jsvalue_to_heap(ctx, JS_NewStringUTF16(ctx, string, len));
+}
+
+/**
+ * Borrow the characters of a string value, see JS_GetStringBuffer.
+ *
+ * Returns Latin-1 bytes when `*wide` is 0, UTF-16 code units otherwise, or NULL when `value` is not
+ * a string. The buffer is valid as long as `value` is alive.
+ */
+const void *QJS_GetStringBuffer(JSValueConst *value, size_t *len, int32_t *wide) {
+  JS_BOOL is_wide = 0;
+  const void *buf = JS_GetStringBuffer(*value, len, &is_wide);
+  *wide = is_wide;
+  return buf;
+}
+
+/**
+ * Convert `value` to UTF-8 without copying the result, it must be released with QJS_FreeCString.
+ */
+const char *QJS_ToCStringLen(JSContext *ctx, JSValueConst *value, size_t *len) {
+  return JS_ToCStringLen(ctx, len, *value);
+}
+
+void QJS_FreeCString(JSContext *ctx, const char *ptr) {
+  JS_FreeCString(ctx, ptr);
+}
+
+char* QJS_GetString(JSContext *ctx, JSValueConst *value) {
+  const char* owned = JS_ToCString(ctx, *value);
+  if(owned == NULL) {
+    return NULL;
+  }
+  char* result = strdup(owned);
+  JS_FreeCString(ctx, owned);
+  return result;
+}
+
+int QJS_IsJobPending(JSRuntime *rt) {
+  return JS_IsJobPending(rt);
+}
+
+/*
+  runs pending jobs (Promises/async functions) until it encounters
+  an exception or it executed the passed maxJobsToExecute jobs.
+
+  Passing a negative value will run the loop until there are no more
+  pending jobs or an exception happened
+
+  Returns the executed number of jobs or the exception encountered.
+  The returned handle is allocated in [ctx], which must belong to [rt].
+*/
+JSValue *QJS_ExecutePendingJob(JSRuntime *rt, JSContext *ctx, int maxJobsToExecute) {
+  JSContext *pctx;
+  int status = 1;
+  int executed = 0;
+  while (executed != maxJobsToExecute && status == 1) {
+    status = JS_ExecutePendingJob(rt, &pctx);
+    if (status == -1) {
+      return jsvalue_to_heap(ctx, JS_GetException(pctx));
+    } else if (status == 1) {
+      executed++;
+    }
+  }
+  return jsvalue_to_heap(ctx, JS_NewFloat64(ctx, executed));
+}
+
+JSValue *QJS_GetProp(JSContext *ctx, JSValueConst *this_val, JSValueConst *prop_name) {
+  JSAtom prop_atom = JS_ValueToAtom(ctx, *prop_name);
+  JSValue prop_val = JS_GetProperty(ctx, *this_val, prop_atom);
+  JS_FreeAtom(ctx, prop_atom);
+  return jsvalue_to_heap(ctx, prop_val);
+}
+
+/**
+ * `obj.length` as an integer, -1 with the exception pending on failure.
+ */
+int64_t QJS_GetLength(JSContext *ctx, JSValueConst *obj) {
+  int64_t len;
+  if (JS_GetLength64(ctx, &len, *obj) < 0) {
+    return -1;
+  }
+  return len;
+}
+
+JSValue *QJS_GetIndexed(JSContext *ctx, JSValueConst *obj, uint32_t idx) {
+  return jsvalue_to_heap(ctx, JS_GetPropertyUint32(ctx, *obj, idx));
+}
+
+/**
+ * Write a handle for each element of the fast array [obj] to [out] when it has at most [capacity] elements.
+ * Returns the number of elements, which are written only if it fits in [capacity], or -1 if [obj] is not
+ * a fast array.
+ */
+int64_t QJS_GetFastArrayElements(JSContext *ctx, JSValueConst *obj, JSValue **out, uint32_t capacity) {
+  JSValue *values;
+  uint32_t count;
+  if (!JS_GetFastArray(ctx, *obj, &values, &count)) {
+    return -1;
+  }
+  if (count <= capacity) {
+    for (uint32_t i = 0; i < count; i++) {
+      out[i] = jsvalue_to_heap(ctx, JS_DupValue(ctx, values[i]));
+    }
+  }
+  return count;
+}
+
+void QJS_SetProp(JSContext *ctx, JSValueConst *this_val, JSValueConst *prop_name, JSValueConst *prop_value) {
+  JSAtom prop_atom = JS_ValueToAtom(ctx, *prop_name);
+  JSValue extra_prop_value = JS_DupValue(ctx, *prop_value);
+  // TODO: should we use DefineProperty internally if this object doesn't have the property yet?
+  JS_SetProperty(ctx, *this_val, prop_atom, extra_prop_value); // consumes extra_prop_value
+  JS_FreeAtom(ctx, prop_atom);
+}
+
+void QJS_DefineProp(JSContext *ctx, JSValueConst *this_val, JSValueConst *prop_name, JSValueConst *prop_value, JSValueConst *get, JSValueConst *set, bool configurable, bool enumerable, bool writable, bool has_value) {
+  JSAtom prop_atom = JS_ValueToAtom(ctx, *prop_name);
+
+  int flags = 0;
+  if (configurable) {
+    flags = flags | JS_PROP_CONFIGURABLE;
+    if (has_value) {
+      flags = flags | JS_PROP_HAS_CONFIGURABLE;
+    }
+  }
+  if (enumerable) {
+    flags = flags | JS_PROP_ENUMERABLE;
+    if (has_value) {
+      flags = flags | JS_PROP_HAS_ENUMERABLE;
+    }
+  }
+  if (writable) {
+      flags = flags | JS_PROP_WRITABLE;
+      if (has_value) {
+          flags = flags | JS_PROP_HAS_WRITABLE;
+      }
+  }
+  if (!JS_IsUndefined(*get)) {
+    flags = flags | JS_PROP_HAS_GET;
+  }
+  if (!JS_IsUndefined(*set)) {
+    flags = flags | JS_PROP_HAS_SET;
+  }
+  if (has_value) {
+    flags = flags | JS_PROP_HAS_VALUE;
+  }
+
+  JS_DefineProperty(ctx, *this_val, prop_atom, *prop_value, *get, *set, flags);
+  JS_FreeAtom(ctx, prop_atom);
+}
+
+
+/**
+ * Calls
+ *
+ * Arguments are unpacked on the stack, calls allocate nothing. Larger argument lists fall back to
+ * the heap. QJS_CallArgs and friends read the arguments from the argument arena of the context,
+ * where the host copies the JSValues themselves: QJS_GetArgArena hands out a buffer that is reused
+ * by every call, and is free again as soon as the call starts, so calls may nest.
+ */
+#define QJS_MAX_STACK_ARGS 32
+
+#define QJS_WITH_ARGV(argc, argv, fill, call) \
+  JSValueConst argv##_stack[QJS_MAX_STACK_ARGS]; \
+  JSValueConst *argv = argv##_stack; \
+  if ((argc) > QJS_MAX_STACK_ARGS) { \
+    argv = static_cast<JSValueConst *>(malloc(sizeof(JSValueConst) * (argc))); \
+    if (argv == NULL) { \
+      call = JS_ThrowOutOfMemory(ctx); \
+    } \
+  } \
+  if (argv != NULL) { \
+    for (int i = 0; i < (argc); i++) { \
+      argv[i] = (fill); \
+    } \
+    call; \
+    if (argv != argv##_stack) { \
+      free(argv); \
+    } \
+  }
+
+JSValue *QJS_Call(JSContext *ctx, JSValueConst *func_obj, JSValueConst *this_obj, int argc, JSValueConst **argv_ptrs) {
+  JSValue result;
+  QJS_WITH_ARGV(argc, argv, *(argv_ptrs[i]), result = JS_Call(ctx, *func_obj, *this_obj, argc, argv));
+  return jsvalue_to_heap(ctx, result);
+}
+
+void QJS_CallVoid(JSContext *ctx, JSValueConst *func_obj, JSValueConst *this_obj, int argc, JSValueConst **argv_ptrs) {
+  JSValue result;
+  QJS_WITH_ARGV(argc, argv, *(argv_ptrs[i]), result = JS_Call(ctx, *func_obj, *this_obj, argc, argv));
+  JS_FreeValue(ctx, result);
+}
+
+/**
+ * A buffer of at least `argc` JSValues for the arguments of the next QJS_CallArgs, QJS_CallArgsInto or
+ * QJS_CallConstructorArgs. The buffer is reused by every call, and only moves when it grows.
+ * The values are borrowed, the host keeps owning them. Returns NULL when out of memory.
+ */
+JSValue *QJS_GetArgArena(JSContext *ctx, int argc) {
+  QJS_ContextState *state = qjs_get_context_state(ctx);
+  if (argc > state->args_capacity) {
+    int capacity = argc < 16 ? 16 : argc;
+    JSValue *args = static_cast<JSValue *>(realloc(state->args, sizeof(JSValue) * capacity));
+    if (args == NULL) {
+      return NULL;
+    }
+    state->args = args;
+    state->args_capacity = capacity;
+  }
+  return state->args;
+}
+
+size_t QJS_SizeOfJSValue() {
+  return sizeof(JSValue);
+}
+
+JSValue *QJS_CallArgs(JSContext *ctx, JSValueConst *func_obj, JSValueConst *this_obj, int argc) {
+  JSValue *args = qjs_get_context_state(ctx)->args;
+  JSValue result;
+  QJS_WITH_ARGV(argc, argv, args[i], result = JS_Call(ctx, *func_obj, *this_obj, argc, argv));
+  return jsvalue_to_heap(ctx, result);
+}
+
+/**
+ * Like QJS_CallArgs, but store the result in the handle `result`, replacing (and freeing) its value,
+ * so calling in a loop does not allocate a handle per call. Returns 0, or -1 with the exception
+ * pending and `result` unchanged.
+ */
+int QJS_CallArgsInto(JSContext *ctx, JSValueConst *func_obj, JSValueConst *this_obj, int argc, JSValue *result) {
+  JSValue *args = qjs_get_context_state(ctx)->args;
+  JSValue value;
+  QJS_WITH_ARGV(argc, argv, args[i], value = JS_Call(ctx, *func_obj, *this_obj, argc, argv));
+  if (JS_IsException(value)) {
+    return -1;
+  }
+  JS_FreeValue(ctx, *result);
+  *result = value;
+  return 0;
+}
+
+JSValue *QJS_CallConstructorArgs(JSContext *ctx, JSValueConst *func_obj, int argc) {
+  JSValue *args = qjs_get_context_state(ctx)->args;
+  JSValue result;
+  QJS_WITH_ARGV(argc, argv, args[i], result = JS_CallConstructor(ctx, *func_obj, argc, argv));
+  return jsvalue_to_heap(ctx, result);
+}
+
+/**
+ * If maybe_exception is an exception, get the error.
+ * Otherwise, return NULL.
+ */
+JSValue *QJS_ResolveException(JSContext *ctx, JSValue *maybe_exception) {
+  if (JS_IsException(*maybe_exception)) {
+    return jsvalue_to_heap(ctx, JS_GetException(ctx));
+  }
+
+  return NULL;
 }
 
 JSValue *QJS_Eval(JSContext *ctx, HeapChar *js_code, size_t js_code_len, HeapChar *filename, int eval_flags) {
-  return jsvalue_to_heap(JS_Eval(ctx, js_code, js_code_len, filename, eval_flags));
+  return jsvalue_to_heap(ctx, JS_Eval(ctx, js_code, js_code_len, filename, eval_flags));
 }
 
 char* QJS_Typeof(JSContext *ctx, JSValueConst *value) {
@@ -506,15 +1747,15 @@ char* QJS_Typeof(JSContext *ctx, JSValueConst *value) {
 }
 
 JSValue *QJS_GetGlobalObject(JSContext *ctx) {
-  return jsvalue_to_heap(JS_GetGlobalObject(ctx));
+  return jsvalue_to_heap(ctx, JS_GetGlobalObject(ctx));
 }
 
 JSValue *QJS_NewPromiseCapability(JSContext *ctx, JSValue **resolve_funcs_out) {
   JSValue resolve_funcs[2];
   JSValue promise = JS_NewPromiseCapability(ctx, resolve_funcs);
-  resolve_funcs_out[0] = jsvalue_to_heap(resolve_funcs[0]);
-  resolve_funcs_out[1] = jsvalue_to_heap(resolve_funcs[1]);
-  return jsvalue_to_heap(promise);
+  resolve_funcs_out[0] = jsvalue_to_heap(ctx, resolve_funcs[0]);
+  resolve_funcs_out[1] = jsvalue_to_heap(ctx, resolve_funcs[1]);
+  return jsvalue_to_heap(ctx, promise);
 }
 
 void QJS_TestStringArg(const char *string) {
@@ -533,7 +1774,7 @@ void QJS_TestStringArg(const char *string) {
   }
 
   JSValue *QJS_NewArrayBufferCopy(JSContext *ctx, const uint8_t *buf, size_t len) {
-    return jsvalue_to_heap(JS_NewArrayBufferCopy(ctx, buf, len));
+    return jsvalue_to_heap(ctx, JS_NewArrayBufferCopy(ctx, buf, len));
   }
 
   //static void djs_buf_free(JSRuntime *rt, void *opaque, void *ptr) {
@@ -542,9 +1783,9 @@ void QJS_TestStringArg(const char *string) {
 
   JSValue *QJS_NewArrayBuffer(JSContext *ctx, uint8_t *buf, size_t len, JSFreeArrayBufferDataFunc *free_func, void *opaque, int is_shared) {
     if (free_func == NULL) {
-      return jsvalue_to_heap(JS_NewArrayBuffer(ctx, buf, len, nullptr, opaque, is_shared));
+      return jsvalue_to_heap(ctx, JS_NewArrayBuffer(ctx, buf, len, nullptr, opaque, is_shared));
     }
-    return jsvalue_to_heap(JS_NewArrayBuffer(ctx, buf, len, free_func, opaque, is_shared));
+    return jsvalue_to_heap(ctx, JS_NewArrayBuffer(ctx, buf, len, free_func, opaque, is_shared));
   }
 
   uint8_t *QJS_GetArrayBuffer(JSContext *ctx, size_t *psize, JSValueConst *obj) {
@@ -592,11 +1833,11 @@ void QJS_TestStringArg(const char *string) {
   }
 
   JSValue *QJS_AtomToString(JSContext *ctx, JSAtom atom) {
-    return jsvalue_to_heap(JS_AtomToString(ctx, atom));
+    return jsvalue_to_heap(ctx, JS_AtomToString(ctx, atom));
   }
 
   JSValue *QJS_GetProperty(JSContext *ctx, JSValueConst *this_obj, JSAtom prop) {
-    return jsvalue_to_heap(JS_GetPropertyInternal(ctx, *this_obj, prop, *this_obj, 0));
+    return jsvalue_to_heap(ctx, JS_GetPropertyInternal(ctx, *this_obj, prop, *this_obj, 0));
   }
 
   int QJS_HasProp(JSContext* ctx, JSValueConst* this_obj, JSValueConst *prop_name) {
@@ -610,6 +1851,40 @@ void QJS_TestStringArg(const char *string) {
       return JS_HasProperty(ctx, *this_obj, prop);
   }
 
+  /**
+   * Atoms
+   *
+   * A property name turned into an atom once can be used by the atom keyed functions below, which
+   * skip creating a key string and hashing it into the atom table on every access.
+   * An atom returned by QJS_NewAtomLen or QJS_DupAtom must be released with QJS_FreeAtom.
+   */
+  JSAtom QJS_NewAtomLen(JSContext *ctx, const char *name, size_t len) {
+    return JS_NewAtomLen(ctx, name, len);
+  }
+
+  JSAtom QJS_DupAtom(JSContext *ctx, JSAtom atom) {
+    return JS_DupAtom(ctx, atom);
+  }
+
+  void QJS_FreeAtom(JSContext *ctx, JSAtom atom) {
+    JS_FreeAtom(ctx, atom);
+  }
+
+  /**
+   * Returns -1 with the exception pending, otherwise 0 or 1 like JS_SetProperty.
+   */
+  int QJS_SetProperty(JSContext *ctx, JSValueConst *this_obj, JSAtom prop, JSValueConst *value) {
+    return JS_SetProperty(ctx, *this_obj, prop, JS_DupValue(ctx, *value));
+  }
+
+  /**
+   * Define a data property with the JS_PROP_C_W_E bits of [flags].
+   * Returns -1 with the exception pending, otherwise 0 or 1 like JS_DefinePropertyValue.
+   */
+  int QJS_DefinePropertyValue(JSContext *ctx, JSValueConst *this_obj, JSAtom prop, JSValueConst *value, int flags) {
+    return JS_DefinePropertyValue(ctx, *this_obj, prop, JS_DupValue(ctx, *value), (flags & JS_PROP_C_W_E) | JS_PROP_THROW);
+  }
+
   // copied from quickjs.c
   typedef enum {
       /* classid tag        */    /* union usage   | properties */
@@ -675,8 +1950,132 @@ void QJS_TestStringArg(const char *string) {
       JS_CLASS_ASYNC_GENERATOR_FUNCTION,  /* u.func */
       JS_CLASS_ASYNC_GENERATOR,   /* u.async_generator_data */
 
-      JS_CLASS_INIT_COUNT, /* last entry for predefined classes */
-  } ClassID;
+      JS_CLASS_INIT_COUNT, /* last entry for predefined classes */
+  } ClassID;
+
+  /**
+   * Typed arrays
+   *
+   * Element types are numbered independently of the class ids, which depend on CONFIG_BIGNUM.
+   */
+#define QJS_TYPED_ARRAY_UINT8C 0
+#define QJS_TYPED_ARRAY_INT8 1
+#define QJS_TYPED_ARRAY_UINT8 2
+#define QJS_TYPED_ARRAY_INT16 3
+#define QJS_TYPED_ARRAY_UINT16 4
+#define QJS_TYPED_ARRAY_INT32 5
+#define QJS_TYPED_ARRAY_UINT32 6
+#define QJS_TYPED_ARRAY_BIG_INT64 7
+#define QJS_TYPED_ARRAY_BIG_UINT64 8
+#define QJS_TYPED_ARRAY_FLOAT32 9
+#define QJS_TYPED_ARRAY_FLOAT64 10
+
+  /**
+   * The class id of the QJS_TYPED_ARRAY_* [type], 0 when it is not supported by this build.
+   */
+  static JSClassID qjs_typed_array_class(int32_t type) {
+    switch (type) {
+      case QJS_TYPED_ARRAY_UINT8C: return JS_CLASS_UINT8C_ARRAY;
+      case QJS_TYPED_ARRAY_INT8: return JS_CLASS_INT8_ARRAY;
+      case QJS_TYPED_ARRAY_UINT8: return JS_CLASS_UINT8_ARRAY;
+      case QJS_TYPED_ARRAY_INT16: return JS_CLASS_INT16_ARRAY;
+      case QJS_TYPED_ARRAY_UINT16: return JS_CLASS_UINT16_ARRAY;
+      case QJS_TYPED_ARRAY_INT32: return JS_CLASS_INT32_ARRAY;
+      case QJS_TYPED_ARRAY_UINT32: return JS_CLASS_UINT32_ARRAY;
+#ifdef CONFIG_BIGNUM
+      case QJS_TYPED_ARRAY_BIG_INT64: return JS_CLASS_BIG_INT64_ARRAY;
+      case QJS_TYPED_ARRAY_BIG_UINT64: return JS_CLASS_BIG_UINT64_ARRAY;
+#endif
+      case QJS_TYPED_ARRAY_FLOAT32: return JS_CLASS_FLOAT32_ARRAY;
+      case QJS_TYPED_ARRAY_FLOAT64: return JS_CLASS_FLOAT64_ARRAY;
+      default: return 0;
+    }
+  }
+
+  /**
+   * The QJS_TYPED_ARRAY_* type of [class_id], -1 when it is not a typed array.
+   */
+  static int qjs_typed_array_type(JSClassID class_id) {
+    switch (class_id) {
+      case JS_CLASS_UINT8C_ARRAY: return QJS_TYPED_ARRAY_UINT8C;
+      case JS_CLASS_INT8_ARRAY: return QJS_TYPED_ARRAY_INT8;
+      case JS_CLASS_UINT8_ARRAY: return QJS_TYPED_ARRAY_UINT8;
+      case JS_CLASS_INT16_ARRAY: return QJS_TYPED_ARRAY_INT16;
+      case JS_CLASS_UINT16_ARRAY: return QJS_TYPED_ARRAY_UINT16;
+      case JS_CLASS_INT32_ARRAY: return QJS_TYPED_ARRAY_INT32;
+      case JS_CLASS_UINT32_ARRAY: return QJS_TYPED_ARRAY_UINT32;
+#ifdef CONFIG_BIGNUM
+      case JS_CLASS_BIG_INT64_ARRAY: return QJS_TYPED_ARRAY_BIG_INT64;
+      case JS_CLASS_BIG_UINT64_ARRAY: return QJS_TYPED_ARRAY_BIG_UINT64;
+#endif
+      case JS_CLASS_FLOAT32_ARRAY: return QJS_TYPED_ARRAY_FLOAT32;
+      case JS_CLASS_FLOAT64_ARRAY: return QJS_TYPED_ARRAY_FLOAT64;
+      default: return -1;
+    }
+  }
+
+  /**
+   * Take a reference of the external buffer holding the ArrayBuffer of the typed array [obj], see
+   * QJS_RetainArrayBuffer. The elements start [*pbyte_offset] bytes into it and span [*pbyte_length] bytes,
+   * [*ptype] is their QJS_TYPED_ARRAY_* type.
+   * Returns NULL with an exception pending when [obj] is not a typed array or is detached.
+   */
+  uint8_t *QJS_RetainTypedArray(JSContext *ctx, JSValueConst *obj, size_t *psize, size_t *pbyte_offset, size_t *pbyte_length, int32_t *ptype) {
+    int type = JS_VALUE_GET_TAG(*obj) == JS_TAG_OBJECT ? qjs_typed_array_type(JS_GetClassID(*obj)) : -1;
+    if (type < 0) {
+      JS_ThrowTypeError(ctx, "not a typed array");
+      return NULL;
+    }
+    size_t bytes_per_element;
+    JSValue buffer = JS_GetTypedArrayBuffer(ctx, *obj, pbyte_offset, pbyte_length, &bytes_per_element);
+    if (JS_IsException(buffer)) {
+      return NULL;
+    }
+    uint8_t *data = QJS_RetainArrayBuffer(ctx, &buffer, psize);
+    JS_FreeValue(ctx, buffer);
+    *ptype = type;
+    return data;
+  }
+
+  /**
+   * `new <type>Array(buffer, byte_offset, length)`, [type] is one of QJS_TYPED_ARRAY_*. The builtin constructor is
+   * used, whatever scripts assigned to the global.
+   */
+  JSValue *QJS_NewTypedArray(JSContext *ctx, JSValueConst *buffer, size_t byte_offset, size_t length, int32_t type) {
+    JSClassID class_id = qjs_typed_array_class(type);
+    if (class_id == 0) {
+      return jsvalue_to_heap(ctx, JS_ThrowRangeError(ctx, "invalid typed array type %d", type));
+    }
+    return jsvalue_to_heap(ctx, JS_NewTypedArrayOfClass(ctx, class_id, *buffer, byte_offset, length));
+  }
+
+  /**
+   * Write the elements of the fast array [obj] to [out] as doubles, when they are all numbers and fit in
+   * [capacity]. Returns the number of elements, or -1 when [obj] is not a fast array or holds an element
+   * which is not a number.
+   */
+  int64_t QJS_GetFloat64Elements(JSContext *ctx, JSValueConst *obj, double *out, uint32_t capacity) {
+    JSValue *values;
+    uint32_t count;
+    if (!JS_GetFastArray(ctx, *obj, &values, &count)) {
+      return -1;
+    }
+    if (count > capacity) {
+      return count;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      JSValueConst value = values[i];
+      uint32_t tag = JS_VALUE_GET_NORM_TAG(value);
+      if (tag == JS_TAG_INT) {
+        out[i] = JS_VALUE_GET_INT(value);
+      } else if (tag == JS_TAG_FLOAT64) {
+        out[i] = JS_VALUE_GET_FLOAT64(value);
+      } else {
+        return -1;
+      }
+    }
+    return count;
+  }
 
   int8_t QJS_HandyTypeof(JSContext *ctx, JSValueConst *value) {
     uint32_t tag = JS_VALUE_GET_TAG(*value);
@@ -747,6 +2146,9 @@ void QJS_TestStringArg(const char *string) {
       if (classID == JS_CLASS_REGEXP) {
           return 20/*"RegExp"*/;
       }
+      if (qjs_typed_array_type(classID) >= 0) {
+          return 23/*"TypedArray"*/;
+      }
       if(JS_IsArray(ctx, *value)) {
         return 21/*"Array"*/;
       }
@@ -763,18 +2165,14 @@ void QJS_TestStringArg(const char *string) {
       JSValue result = JS_CallConstructor(ctx, date_constructor, 1, {&t});
       JS_FreeValue(ctx, t);
       JS_FreeValue(ctx, date_constructor);
-      return jsvalue_to_heap(result);
+      return jsvalue_to_heap(ctx, result);
   }
 
   JSValue* QJS_CallConstructor(JSContext* ctx, JSValueConst *func_obj,
       int argc, JSValueConst** argv_ptrs) {
-      // convert array of pointers to array of values
-      JSValueConst* argv = new JSValueConst[argc];
-      int i;
-      for (i = 0; i < argc; i++) {
-          argv[i] = *(argv_ptrs[i]);
-      }
-      return jsvalue_to_heap(JS_CallConstructor(ctx, *func_obj, argc, argv));
+      JSValue result;
+      QJS_WITH_ARGV(argc, argv, *(argv_ptrs[i]), result = JS_CallConstructor(ctx, *func_obj, argc, argv));
+      return jsvalue_to_heap(ctx, result);
   }
 
   void QJS_ToConstructor(JSContext* ctx, JSValueConst *func_obj) {
@@ -782,11 +2180,11 @@ void QJS_TestStringArg(const char *string) {
   }
 
   JSValue* QJS_GetException(JSContext *ctx) {
-    return jsvalue_to_heap(JS_GetException(ctx));
+    return jsvalue_to_heap(ctx, JS_GetException(ctx));
   }
 
   JSValue* QJS_JSONStringify(JSContext *ctx, JSValueConst *obj) {
-    return jsvalue_to_heap(JS_JSONStringify(ctx, *obj, JS_UNDEFINED, JS_UNDEFINED));
+    return jsvalue_to_heap(ctx, JS_JSONStringify(ctx, *obj, JS_UNDEFINED, JS_UNDEFINED));
   }
 
   /* for test */
@@ -799,32 +2197,58 @@ void QJS_TestStringArg(const char *string) {
       JS_FreeCString(ctx, error);
   }
 
-  typedef uint8_t QJS_Module_Loader(JSContext* ctx, char **buff, size_t *len, const char* module_name);
-  QJS_Module_Loader *qjs_module_loader = NULL;
-
+  /**
+   * Module loader result, returned by the host loader.
+   */
+#define QJS_MODULE_NOT_FOUND 0
+  // `*buff` holds `*len` bytes of UTF-8 source, NUL terminated.
+#define QJS_MODULE_SOURCE 1
+  // `*buff` holds `*len` bytes of bytecode written by QJS_CompileToBytecode.
+#define QJS_MODULE_BYTECODE 2
+  // the host compiled the module with QJS_CompileModule, `*buff` is not set.
+#define QJS_MODULE_COMPILED 3
+
+  /**
+   * `*buff` must be allocated with QJS_NewBuffer, it is freed by the loader.
+   */
   JSModuleDef *js_module_loader(JSContext *ctx,
                                 const char *module_name, void *opaque)
   {
+      QJS_Module_Loader *qjs_module_loader = static_cast<QJS_RuntimeState *>(opaque)->module_loader;
       if (qjs_module_loader == NULL) {
           JS_ThrowReferenceError(ctx, "module loader not set");
           return NULL;
       }
     JSModuleDef *m;
     size_t buf_len = 0;
-    char**buf = (char**)malloc(sizeof(char *));
+    char *buf = NULL;
     JSValue func_val;
-    uint8_t result = qjs_module_loader(ctx, buf, &buf_len, module_name);
+    uint8_t result = qjs_module_loader(ctx, &buf, &buf_len, module_name);
     //printf("qjs_module_loader result %d, buf_len:%Id\n", result, buf_len);
-    //printf("module source:\n%s\n", *buf);
 
-    if(result == 0) {
+    if(result == QJS_MODULE_COMPILED) {
+      m = JS_FindLoadedModule(ctx, module_name);
+      if (m == NULL) {
+        JS_ThrowReferenceError(ctx, "module '%s' was not compiled", module_name);
+        return NULL;
+      }
+      func_val = JS_DupValue(ctx, JS_MKPTR(JS_TAG_MODULE, m));
+    } else if(result == QJS_MODULE_NOT_FOUND || buf == NULL) {
       //printf("could not load module filename '%s'", module_name);
+      free(buf);
       JS_ThrowReferenceError(ctx, "could not load module filename '%s'", module_name);
       return NULL;
+    } else if(result == QJS_MODULE_BYTECODE) {
+      func_val = JS_ReadObject(ctx, reinterpret_cast<const uint8_t *>(buf), buf_len, JS_READ_OBJ_BYTECODE);
+      if (!JS_IsException(func_val) && JS_VALUE_GET_TAG(func_val) != JS_TAG_MODULE) {
+        JS_FreeValue(ctx, func_val);
+        func_val = JS_ThrowTypeError(ctx, "bytecode of '%s' is not a module", module_name);
+      }
+    } else {
+      /* compile the module */
+      func_val = JS_Eval(ctx, buf, buf_len, module_name, JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
     }
-    /* compile the module */
-    func_val = JS_Eval(ctx, *buf, buf_len, module_name, JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
-    js_free(ctx, buf);
+    free(buf);
     if (JS_IsException(func_val)) {
         //print_exception(ctx, func_val);
         return NULL;
@@ -847,8 +2271,1263 @@ void QJS_TestStringArg(const char *string) {
   }
 
  void QJS_SetModuleLoaderFunc(JSRuntime* rt, QJS_Module_Loader *handler) {
-    qjs_module_loader = handler;
-    JS_SetModuleLoaderFunc(rt, NULL, &js_module_loader, NULL);
+    QJS_RuntimeState *state = qjs_get_runtime_state(rt);
+    state->module_loader = handler;
+    JS_SetModuleLoaderFunc(rt, NULL, &js_module_loader, state);
+  }
+
+  /**
+   * Serializer
+   *
+   * QJS_Serialize walks a value graph natively and writes it into a single buffer, so the host
+   * can convert a whole object tree with one FFI call instead of one call per property.
+   *
+   * All numbers are little-endian. A value is a one byte tag followed by its payload:
+   * - QJS_SER_UNDEFINED, QJS_SER_NULL, QJS_SER_FALSE, QJS_SER_TRUE: no payload
+   * - QJS_SER_INT32: int32
+   * - QJS_SER_FLOAT64: float64
+   * - QJS_SER_STRING: varuint byte length, UTF-8 bytes
+   * - QJS_SER_ARRAY: uint32 length, elements
+   * - QJS_SER_OBJECT: uint32 count, then count * (key, value). A key is a varuint `k`, when `k` is
+   *   even it is followed by `k >> 1` UTF-8 bytes and appended to the key table, otherwise it
+   *   refers to entry `k >> 1` of the key table.
+   * - QJS_SER_DATE: float64 milliseconds since epoch
+   * - QJS_SER_BYTES: varuint byte length, bytes copied out of an ArrayBuffer
+   * - QJS_SER_HANDLE: uint64 JSValue* owned by the caller, for values the host has to handle itself
+   *   (functions, promises, errors, ...)
+   *
+   * With QJS_SERIALIZE_JSON the value is written as JSON.stringify would see it instead, so the host
+   * gets JSON data without a JSON string in between. No handles, dates or bytes are written then.
+   */
+#define QJS_SER_UNDEFINED 0
+#define QJS_SER_NULL 1
+#define QJS_SER_FALSE 2
+#define QJS_SER_TRUE 3
+#define QJS_SER_INT32 4
+#define QJS_SER_FLOAT64 5
+#define QJS_SER_STRING 6
+#define QJS_SER_ARRAY 7
+#define QJS_SER_OBJECT 8
+#define QJS_SER_DATE 9
+#define QJS_SER_BYTES 10
+#define QJS_SER_HANDLE 11
+
+  // emit plain objects as handles, the host serializes them through JSON.
+#define QJS_SERIALIZE_OBJECT_AS_HANDLE (1 << 0)
+  // JSON.stringify semantics: toJSON() is applied, boxed primitives are unwrapped, functions, symbols
+  // and undefined properties are left out, and cycles throw.
+#define QJS_SERIALIZE_JSON (1 << 1)
+  // with QJS_SERIALIZE_JSON, also write the name, message and stack of a top level object when they are
+  // not enumerable own properties, as for errors.
+#define QJS_SERIALIZE_DUMP (1 << 2)
+
+#define QJS_SERIALIZE_MAX_DEPTH 1000
+
+  typedef struct QJS_KeyEntry {
+    JSAtom atom;
+    uint32_t index;
+  } QJS_KeyEntry;
+
+  typedef struct QJS_Serializer {
+    JSContext *ctx;
+    int flags;
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    bool oom;
+    // handles written to the buffer, released if serialization fails.
+    JSValue **handles;
+    size_t handle_count;
+    size_t handle_cap;
+    // atom -> key table index, open addressing, JS_ATOM_NULL marks an empty entry.
+    QJS_KeyEntry *keys;
+    uint32_t key_cap;
+    uint32_t key_count;
+    // QJS_SERIALIZE_JSON: the top level value, and the objects being written to detect cycles.
+    JSValueConst root;
+    JSAtom to_json;
+    void **stack;
+    size_t stack_len;
+    size_t stack_cap;
+  } QJS_Serializer;
+
+  static bool qjs_ser_reserve(QJS_Serializer *s, size_t extra) {
+    if (s->oom) {
+      return false;
+    }
+    if (s->len + extra <= s->cap) {
+      return true;
+    }
+    size_t cap = s->cap < 256 ? 256 : s->cap;
+    while (cap < s->len + extra) {
+      cap += cap >> 1;
+    }
+    uint8_t *buf = static_cast<uint8_t *>(realloc(s->buf, cap));
+    if (buf == NULL) {
+      s->oom = true;
+      return false;
+    }
+    s->buf = buf;
+    s->cap = cap;
+    return true;
+  }
+
+  static inline void qjs_ser_u8(QJS_Serializer *s, uint8_t v) {
+    if (qjs_ser_reserve(s, 1)) {
+      s->buf[s->len++] = v;
+    }
+  }
+
+  static inline void qjs_ser_raw(QJS_Serializer *s, const void *data, size_t size) {
+    if (qjs_ser_reserve(s, size)) {
+      memcpy(s->buf + s->len, data, size);
+      s->len += size;
+    }
+  }
+
+  static inline void qjs_ser_u32_at(QJS_Serializer *s, size_t offset, uint32_t v) {
+    uint8_t bytes[4] = {(uint8_t) v, (uint8_t) (v >> 8), (uint8_t) (v >> 16), (uint8_t) (v >> 24)};
+    memcpy(s->buf + offset, bytes, 4);
+  }
+
+  static inline void qjs_ser_u32(QJS_Serializer *s, uint32_t v) {
+    if (qjs_ser_reserve(s, 4)) {
+      qjs_ser_u32_at(s, s->len, v);
+      s->len += 4;
+    }
+  }
+
+  static inline void qjs_ser_u64(QJS_Serializer *s, uint64_t v) {
+    qjs_ser_u32(s, (uint32_t) v);
+    qjs_ser_u32(s, (uint32_t) (v >> 32));
+  }
+
+  static inline void qjs_ser_f64(QJS_Serializer *s, double d) {
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    qjs_ser_u64(s, v);
+  }
+
+  static inline void qjs_ser_varuint(QJS_Serializer *s, uint64_t v) {
+    while (v >= 0x80) {
+      qjs_ser_u8(s, (uint8_t) (v | 0x80));
+      v >>= 7;
+    }
+    qjs_ser_u8(s, (uint8_t) v);
+  }
+
+  static bool qjs_ser_string(QJS_Serializer *s, JSValueConst value) {
+    size_t len;
+    const char *str = JS_ToCStringLen(s->ctx, &len, value);
+    if (str == NULL) {
+      return false;
+    }
+    qjs_ser_u8(s, QJS_SER_STRING);
+    qjs_ser_varuint(s, len);
+    qjs_ser_raw(s, str, len);
+    JS_FreeCString(s->ctx, str);
+    return true;
+  }
+
+  static bool qjs_ser_handle(QJS_Serializer *s, JSValueConst value) {
+    if (s->handle_count == s->handle_cap) {
+      size_t cap = s->handle_cap == 0 ? 8 : s->handle_cap * 2;
+      JSValue **handles = static_cast<JSValue **>(realloc(s->handles, cap * sizeof(JSValue *)));
+      if (handles == NULL) {
+        s->oom = true;
+        return false;
+      }
+      s->handles = handles;
+      s->handle_cap = cap;
+    }
+    JSValue *handle = jsvalue_to_heap(s->ctx, JS_DupValue(s->ctx, value));
+    if (handle == NULL) {
+      s->oom = true;
+      return false;
+    }
+    s->handles[s->handle_count++] = handle;
+    qjs_ser_u8(s, QJS_SER_HANDLE);
+    qjs_ser_u64(s, (uint64_t) (uintptr_t) handle);
+    return true;
+  }
+
+  static bool qjs_ser_key(QJS_Serializer *s, JSAtom atom) {
+    if (s->key_count * 2 >= s->key_cap) {
+      uint32_t cap = s->key_cap == 0 ? 64 : s->key_cap * 2;
+      QJS_KeyEntry *keys = static_cast<QJS_KeyEntry *>(calloc(cap, sizeof(QJS_KeyEntry)));
+      if (keys == NULL) {
+        s->oom = true;
+        return false;
+      }
+      for (uint32_t i = 0; i < s->key_cap; i++) {
+        if (s->keys[i].atom != JS_ATOM_NULL) {
+          uint32_t h = (s->keys[i].atom * 2654435761u) & (cap - 1);
+          while (keys[h].atom != JS_ATOM_NULL) {
+            h = (h + 1) & (cap - 1);
+          }
+          keys[h] = s->keys[i];
+        }
+      }
+      free(s->keys);
+      s->keys = keys;
+      s->key_cap = cap;
+    }
+    uint32_t h = (atom * 2654435761u) & (s->key_cap - 1);
+    while (s->keys[h].atom != JS_ATOM_NULL) {
+      if (s->keys[h].atom == atom) {
+        qjs_ser_varuint(s, ((uint64_t) s->keys[h].index << 1) | 1);
+        return true;
+      }
+      h = (h + 1) & (s->key_cap - 1);
+    }
+    const char *str = JS_AtomToCString(s->ctx, atom);
+    if (str == NULL) {
+      return false;
+    }
+    size_t len = strlen(str);
+    qjs_ser_varuint(s, (uint64_t) len << 1);
+    qjs_ser_raw(s, str, len);
+    JS_FreeCString(s->ctx, str);
+    // hold the atom so that its index can not be reused by another key during this call.
+    s->keys[h].atom = JS_DupAtom(s->ctx, atom);
+    s->keys[h].index = s->key_count++;
+    return true;
+  }
+
+  static bool qjs_ser_value(QJS_Serializer *s, JSValueConst value, int depth);
+
+  /**
+   * The key toJSON() is called with: [atom], [index] when [atom] is JS_ATOM_NULL, or "" for the top
+   * level value.
+   */
+  static JSValue qjs_ser_json_key(JSContext *ctx, JSAtom atom, int64_t index) {
+    if (atom != JS_ATOM_NULL) {
+      return JS_AtomToString(ctx, atom);
+    }
+    if (index >= 0) {
+      return JS_ToString(ctx, JS_NewInt64(ctx, index));
+    }
+    return JS_NewString(ctx, "");
+  }
+
+  /**
+   * Apply toJSON() and unwrap boxed primitives like JSON.stringify. [value] is consumed.
+   * Returns JS_UNDEFINED for the values JSON leaves out.
+   */
+  static JSValue qjs_ser_json_check(QJS_Serializer *s, JSValue value, JSAtom key, int64_t index) {
+    JSContext *ctx = s->ctx;
+    if (JS_IsObject(value)) {
+      JSValue to_json = JS_GetProperty(ctx, value, s->to_json);
+      if (JS_IsException(to_json)) {
+        JS_FreeValue(ctx, value);
+        return JS_EXCEPTION;
+      }
+      if (JS_IsFunction(ctx, to_json)) {
+        JSValue key_value = qjs_ser_json_key(ctx, key, index);
+        JSValue result = JS_IsException(key_value) ? JS_EXCEPTION : JS_Call(ctx, to_json, value, 1, &key_value);
+        JS_FreeValue(ctx, key_value);
+        JS_FreeValue(ctx, value);
+        value = result;
+      }
+      JS_FreeValue(ctx, to_json);
+      if (JS_IsException(value)) {
+        return value;
+      }
+    }
+    switch (JS_VALUE_GET_NORM_TAG(value)) {
+      case JS_TAG_UNDEFINED:
+      case JS_TAG_UNINITIALIZED:
+      case JS_TAG_SYMBOL:
+        JS_FreeValue(ctx, value);
+        return JS_UNDEFINED;
+      case JS_TAG_OBJECT:
+        break;
+      default:
+        return value;
+    }
+    if (JS_IsFunction(ctx, value)) {
+      JS_FreeValue(ctx, value);
+      return JS_UNDEFINED;
+    }
+    switch (JS_GetClassID(value)) {
+      case JS_CLASS_NUMBER:
+      case JS_CLASS_BOOLEAN: {
+        // valueOf() of the wrapper.
+        double d;
+        int ret = JS_ToFloat64(ctx, &d, value);
+        bool is_bool = JS_GetClassID(value) == JS_CLASS_BOOLEAN;
+        JS_FreeValue(ctx, value);
+        if (ret != 0) {
+          return JS_EXCEPTION;
+        }
+        return is_bool ? JS_NewBool(ctx, d != 0) : JS_NewFloat64(ctx, d);
+      }
+      case JS_CLASS_STRING: {
+        JSValue str = JS_ToString(ctx, value);
+        JS_FreeValue(ctx, value);
+        return str;
+      }
+      default:
+        return value;
+    }
+  }
+
+  /**
+   * Enter the object [value] for QJS_SERIALIZE_JSON, failing like JSON.stringify on a cycle.
+   */
+  static bool qjs_ser_json_enter(QJS_Serializer *s, JSValueConst value) {
+    void *ptr = JS_VALUE_GET_PTR(value);
+    for (size_t i = 0; i < s->stack_len; i++) {
+      if (s->stack[i] == ptr) {
+        JS_ThrowTypeError(s->ctx, "circular reference");
+        return false;
+      }
+    }
+    if (s->stack_len == s->stack_cap) {
+      size_t cap = s->stack_cap == 0 ? 16 : s->stack_cap * 2;
+      void **stack = static_cast<void **>(realloc(s->stack, cap * sizeof(void *)));
+      if (stack == NULL) {
+        s->oom = true;
+        return false;
+      }
+      s->stack = stack;
+      s->stack_cap = cap;
+    }
+    s->stack[s->stack_len++] = ptr;
+    return true;
+  }
+
+  /**
+   * Write the property [key] of the object being written with QJS_SERIALIZE_JSON, unless JSON leaves
+   * it out. [prop] is consumed, [*count] is incremented when the property is written.
+   */
+  static bool qjs_ser_json_prop(QJS_Serializer *s, JSAtom key, JSValue prop, uint32_t *count, int depth) {
+    prop = qjs_ser_json_check(s, prop, key, -1);
+    if (JS_IsException(prop)) {
+      return false;
+    }
+    if (JS_IsUndefined(prop)) {
+      return true;
+    }
+    bool ok = qjs_ser_key(s, key) && qjs_ser_value(s, prop, depth + 1);
+    JS_FreeValue(s->ctx, prop);
+    (*count)++;
+    return ok;
+  }
+
+  static bool qjs_ser_json_object(QJS_Serializer *s, JSValueConst value, int depth) {
+    JSContext *ctx = s->ctx;
+    JSPropertyEnum *tab;
+    uint32_t len;
+    if (JS_GetOwnPropertyNames(ctx, &tab, &len, value, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) != 0) {
+      return false;
+    }
+    qjs_ser_u8(s, QJS_SER_OBJECT);
+    size_t count_offset = s->len;
+    qjs_ser_u32(s, 0);
+    uint32_t count = 0;
+    bool ok = true;
+    // the dump extras are the properties of the top level value, whatever toJSON() returned.
+    bool dump = depth == 0 && (s->flags & QJS_SERIALIZE_DUMP);
+    static const char *const dump_names[] = {"name", "message", "stack"};
+    bool dumped[3] = {false, false, false};
+    for (uint32_t i = 0; i < len && ok; i++) {
+      JSValue prop = JS_GetProperty(ctx, value, tab[i].atom);
+      if (JS_IsException(prop)) {
+        ok = false;
+        break;
+      }
+      uint32_t before = count;
+      ok = qjs_ser_json_prop(s, tab[i].atom, prop, &count, depth);
+      if (dump && count != before) {
+        const char *name = JS_AtomToCString(ctx, tab[i].atom);
+        for (int j = 0; j < 3 && name != NULL; j++) {
+          dumped[j] = dumped[j] || strcmp(name, dump_names[j]) == 0;
+        }
+        JS_FreeCString(ctx, name);
+      }
+    }
+    dart_free_prop_enums(ctx, tab, len);
+    for (int j = 0; j < 3 && dump && ok; j++) {
+      if (dumped[j]) {
+        continue;
+      }
+      JSAtom atom = JS_NewAtom(ctx, dump_names[j]);
+      JSValue prop = JS_GetProperty(ctx, s->root, atom);
+      ok = !JS_IsException(prop) && qjs_ser_json_prop(s, atom, prop, &count, depth);
+      JS_FreeAtom(ctx, atom);
+    }
+    if (ok && !s->oom) {
+      qjs_ser_u32_at(s, count_offset, count);
+    }
+    return ok;
+  }
+
+  static bool qjs_ser_array(QJS_Serializer *s, JSValueConst value, int depth) {
+    JSContext *ctx = s->ctx;
+    int64_t length;
+    if (JS_GetLength64(ctx, &length, value) != 0) {
+      return false;
+    }
+    qjs_ser_u8(s, QJS_SER_ARRAY);
+    qjs_ser_u32(s, (uint32_t) length);
+    for (uint32_t i = 0; i < (uint32_t) length; i++) {
+      JSValue *values;
+      uint32_t count;
+      // fast arrays are read in place, fetched again for each element as serializing may run JS code.
+      JSValue element = JS_GetFastArray(ctx, value, &values, &count) && i < count
+          ? JS_DupValue(ctx, values[i]) : JS_GetPropertyUint32(ctx, value, i);
+      if (JS_IsException(element)) {
+        return false;
+      }
+      if (s->flags & QJS_SERIALIZE_JSON) {
+        element = qjs_ser_json_check(s, element, JS_ATOM_NULL, i);
+        if (JS_IsException(element)) {
+          return false;
+        }
+        if (JS_IsUndefined(element)) {
+          element = JS_NULL;
+        }
+      }
+      bool ok = qjs_ser_value(s, element, depth + 1);
+      JS_FreeValue(ctx, element);
+      if (!ok) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool qjs_ser_object(QJS_Serializer *s, JSValueConst value, int depth) {
+    JSContext *ctx = s->ctx;
+    JSPropertyEnum *tab;
+    uint32_t len;
+    if (JS_GetOwnPropertyNames(ctx, &tab, &len, value, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) != 0) {
+      return false;
+    }
+    qjs_ser_u8(s, QJS_SER_OBJECT);
+    qjs_ser_u32(s, len);
+    bool ok = true;
+    for (uint32_t i = 0; i < len && ok; i++) {
+      JSValue prop = JS_GetProperty(ctx, value, tab[i].atom);
+      if (JS_IsException(prop)) {
+        ok = false;
+        break;
+      }
+      ok = qjs_ser_key(s, tab[i].atom) && qjs_ser_value(s, prop, depth + 1);
+      JS_FreeValue(ctx, prop);
+    }
+    dart_free_prop_enums(ctx, tab, len);
+    return ok;
+  }
+
+  static bool qjs_ser_value(QJS_Serializer *s, JSValueConst value, int depth) {
+    JSContext *ctx = s->ctx;
+    if (s->oom) {
+      return false;
+    }
+    if (depth > QJS_SERIALIZE_MAX_DEPTH) {
+      JS_ThrowRangeError(ctx, "value is too deeply nested or cyclic");
+      return false;
+    }
+    switch (JS_VALUE_GET_NORM_TAG(value)) {
+      case JS_TAG_UNDEFINED:
+      case JS_TAG_UNINITIALIZED:
+        qjs_ser_u8(s, QJS_SER_UNDEFINED);
+        return true;
+      case JS_TAG_NULL:
+        qjs_ser_u8(s, QJS_SER_NULL);
+        return true;
+      case JS_TAG_BOOL:
+        qjs_ser_u8(s, JS_VALUE_GET_BOOL(value) ? QJS_SER_TRUE : QJS_SER_FALSE);
+        return true;
+      case JS_TAG_INT:
+        qjs_ser_u8(s, QJS_SER_INT32);
+        qjs_ser_u32(s, (uint32_t) JS_VALUE_GET_INT(value));
+        return true;
+      case JS_TAG_FLOAT64:
+        if ((s->flags & QJS_SERIALIZE_JSON) && !isfinite(JS_VALUE_GET_FLOAT64(value))) {
+          qjs_ser_u8(s, QJS_SER_NULL);
+          return true;
+        }
+        qjs_ser_u8(s, QJS_SER_FLOAT64);
+        qjs_ser_f64(s, JS_VALUE_GET_FLOAT64(value));
+        return true;
+      case JS_TAG_STRING:
+        return qjs_ser_string(s, value);
+      case JS_TAG_SYMBOL:
+        qjs_ser_u8(s, QJS_SER_NULL);
+        return true;
+      case JS_TAG_OBJECT:
+        break;
+      default:
+        if (s->flags & QJS_SERIALIZE_JSON) {
+          JS_ThrowTypeError(ctx, "bigint are forbidden in JSON.stringify");
+          return false;
+        }
+        return qjs_ser_handle(s, value);
+    }
+    if (s->flags & QJS_SERIALIZE_JSON) {
+      // what qjs_ser_json_check() returned: plain data, arrays and other objects.
+      if (!qjs_ser_json_enter(s, value)) {
+        return false;
+      }
+      int is_array = JS_IsArray(ctx, value);
+      bool ok = is_array > 0 ? qjs_ser_array(s, value, depth)
+          : is_array == 0 && qjs_ser_json_object(s, value, depth);
+      s->stack_len--;
+      return ok;
+    }
+    if (JS_IsFunction(ctx, value)) {
+      return qjs_ser_handle(s, value);
+    }
+    switch (JS_GetClassID(value)) {
+      case JS_CLASS_STRING:
+        return qjs_ser_string(s, value);
+      case JS_CLASS_BOOLEAN:
+        // same as the host: every object is truthy.
+        qjs_ser_u8(s, QJS_SER_TRUE);
+        return true;
+      case JS_CLASS_DATE: {
+        double d;
+        if (JS_ToFloat64(ctx, &d, value) != 0) {
+          return false;
+        }
+        qjs_ser_u8(s, QJS_SER_DATE);
+        qjs_ser_f64(s, d);
+        return true;
+      }
+      case JS_CLASS_ARRAY_BUFFER:
+      case JS_CLASS_SHARED_ARRAY_BUFFER: {
+        size_t size;
+        uint8_t *data = JS_GetArrayBuffer(ctx, &size, value);
+        if (data == NULL) {
+          return false;
+        }
+        qjs_ser_u8(s, QJS_SER_BYTES);
+        qjs_ser_varuint(s, size);
+        qjs_ser_raw(s, data, size);
+        return true;
+      }
+      case JS_CLASS_PROMISE:
+      case JS_CLASS_NUMBER:
+      case JS_CLASS_ERROR:
+      case JS_CLASS_REGEXP:
+        return qjs_ser_handle(s, value);
+      default:
+        if (qjs_typed_array_type(JS_GetClassID(value)) >= 0) {
+          return qjs_ser_handle(s, value);
+        }
+        break;
+    }
+    // the remaining classes are what QJS_HandyTypeof reports as "Array" or "object".
+    int is_array = JS_IsArray(ctx, value);
+    if (is_array < 0) {
+      return false;
+    }
+    if (is_array) {
+      return qjs_ser_array(s, value, depth);
+    }
+    if (s->flags & QJS_SERIALIZE_OBJECT_AS_HANDLE) {
+      return qjs_ser_handle(s, value);
+    }
+    return qjs_ser_object(s, value, depth);
+  }
+
+  /**
+   * Release the key table of [s] and hand out its buffer, or release everything when [ok] is false.
+   */
+  static uint8_t *qjs_ser_finish(QJS_Serializer *s, bool ok, size_t *out_len) {
+    JSContext *ctx = s->ctx;
+    ok = ok && !s->oom;
+    for (uint32_t i = 0; i < s->key_cap; i++) {
+      if (s->keys[i].atom != JS_ATOM_NULL) {
+        JS_FreeAtom(ctx, s->keys[i].atom);
+      }
+    }
+    free(s->keys);
+    free(s->stack);
+    if (s->to_json != JS_ATOM_NULL) {
+      JS_FreeAtom(ctx, s->to_json);
+    }
+    if (!ok) {
+      for (size_t i = 0; i < s->handle_count; i++) {
+        QJS_FreeValuePointer(ctx, s->handles[i]);
+      }
+      free(s->handles);
+      free(s->buf);
+      if (s->oom) {
+        JS_ThrowOutOfMemory(ctx);
+      }
+      *out_len = 0;
+      return NULL;
+    }
+    free(s->handles);
+    *out_len = s->len;
+    return s->buf;
+  }
+
+  /**
+   * Serialize [value] into a buffer allocated with malloc, release it with QJS_FreeBuffer.
+   * Returns NULL on failure, with the exception pending in [ctx] unless memory ran out.
+   */
+  uint8_t *QJS_Serialize(JSContext *ctx, JSValueConst *value, int flags, size_t *out_len) {
+    QJS_Serializer s;
+    memset(&s, 0, sizeof(s));
+    s.ctx = ctx;
+    s.flags = flags;
+    if (!(flags & QJS_SERIALIZE_JSON)) {
+      return qjs_ser_finish(&s, qjs_ser_value(&s, *value, 0), out_len);
+    }
+    s.root = *value;
+    s.to_json = JS_NewAtom(ctx, "toJSON");
+    JSValue root = qjs_ser_json_check(&s, JS_DupValue(ctx, *value), JS_ATOM_NULL, -1);
+    bool ok = !JS_IsException(root) && qjs_ser_value(&s, root, 0);
+    JS_FreeValue(ctx, root);
+    return qjs_ser_finish(&s, ok, out_len);
+  }
+
+  void QJS_FreeBuffer(void *buf) {
+    free(buf);
+  }
+
+  /**
+   * Builder
+   *
+   * QJS_BuildValue creates a value graph from a buffer in the QJS_Serialize format with a single
+   * call. QJS_SER_HANDLE entries are borrowed JSValue* whose values are duplicated into the graph,
+   * QJS_SER_BYTES entries become ArrayBuffers holding a copy of the bytes.
+   */
+  typedef struct QJS_Builder {
+    JSContext *ctx;
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    // key table, in order of first appearance.
+    JSAtom *keys;
+    uint32_t key_count;
+    uint32_t key_cap;
+    JSValue date_ctor;
+  } QJS_Builder;
+
+  static bool qjs_build_need(QJS_Builder *b, size_t size) {
+    if (b->len - b->pos < size) {
+      JS_ThrowSyntaxError(b->ctx, "truncated value buffer at %zu", b->pos);
+      return false;
+    }
+    return true;
+  }
+
+  static inline uint32_t qjs_build_u32(QJS_Builder *b) {
+    const uint8_t *p = b->buf + b->pos;
+    b->pos += 4;
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+  }
+
+  static inline uint64_t qjs_build_u64(QJS_Builder *b) {
+    uint64_t lo = qjs_build_u32(b);
+    uint64_t hi = qjs_build_u32(b);
+    return lo | (hi << 32);
+  }
+
+  static inline double qjs_build_f64(QJS_Builder *b) {
+    uint64_t v = qjs_build_u64(b);
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    return d;
+  }
+
+  static bool qjs_build_varuint(QJS_Builder *b, uint64_t *out) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (!qjs_build_need(b, 1)) {
+        return false;
+      }
+      uint8_t byte = b->buf[b->pos++];
+      result |= (uint64_t) (byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        *out = result;
+        return true;
+      }
+    }
+    JS_ThrowSyntaxError(b->ctx, "invalid varuint at %zu", b->pos);
+    return false;
+  }
+
+  static JSAtom qjs_build_key(QJS_Builder *b) {
+    uint64_t k;
+    if (!qjs_build_varuint(b, &k)) {
+      return JS_ATOM_NULL;
+    }
+    if (k & 1) {
+      if ((k >> 1) >= b->key_count) {
+        JS_ThrowSyntaxError(b->ctx, "invalid key reference at %zu", b->pos);
+        return JS_ATOM_NULL;
+      }
+      return JS_DupAtom(b->ctx, b->keys[k >> 1]);
+    }
+    size_t len = k >> 1;
+    if (!qjs_build_need(b, len)) {
+      return JS_ATOM_NULL;
+    }
+    if (b->key_count == b->key_cap) {
+      uint32_t cap = b->key_cap == 0 ? 32 : b->key_cap * 2;
+      JSAtom *keys = static_cast<JSAtom *>(realloc(b->keys, cap * sizeof(JSAtom)));
+      if (keys == NULL) {
+        JS_ThrowOutOfMemory(b->ctx);
+        return JS_ATOM_NULL;
+      }
+      b->keys = keys;
+      b->key_cap = cap;
+    }
+    JSAtom atom = JS_NewAtomLen(b->ctx, reinterpret_cast<const char *>(b->buf + b->pos), len);
+    if (atom == JS_ATOM_NULL) {
+      return JS_ATOM_NULL;
+    }
+    b->pos += len;
+    b->keys[b->key_count++] = atom;
+    return JS_DupAtom(b->ctx, atom);
+  }
+
+  static JSValue qjs_build_value(QJS_Builder *b, int depth);
+
+  static JSValue qjs_build_array(QJS_Builder *b, int depth) {
+    JSContext *ctx = b->ctx;
+    if (!qjs_build_need(b, 4)) {
+      return JS_EXCEPTION;
+    }
+    uint32_t length = qjs_build_u32(b);
+    // every element takes at least one byte, this bounds the allocation by the buffer size.
+    if (!qjs_build_need(b, length)) {
+      return JS_EXCEPTION;
+    }
+    JSValue *values = static_cast<JSValue *>(malloc(sizeof(JSValue) * (length == 0 ? 1 : length)));
+    if (values == NULL) {
+      return JS_ThrowOutOfMemory(ctx);
+    }
+    for (uint32_t i = 0; i < length; i++) {
+      values[i] = qjs_build_value(b, depth + 1);
+      if (JS_IsException(values[i])) {
+        for (uint32_t j = 0; j < i; j++) {
+          JS_FreeValue(ctx, values[j]);
+        }
+        free(values);
+        return JS_EXCEPTION;
+      }
+    }
+    JSValue result = JS_NewArrayFrom(ctx, length, values);
+    free(values);
+    return result;
+  }
+
+  static JSValue qjs_build_object(QJS_Builder *b, int depth) {
+    JSContext *ctx = b->ctx;
+    if (!qjs_build_need(b, 4)) {
+      return JS_EXCEPTION;
+    }
+    uint32_t count = qjs_build_u32(b);
+    JSValue obj = JS_NewObject(ctx);
+    if (JS_IsException(obj)) {
+      return obj;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      JSAtom key = qjs_build_key(b);
+      if (key == JS_ATOM_NULL) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+      }
+      JSValue value = qjs_build_value(b, depth + 1);
+      int res = JS_IsException(value) ? -1 : JS_DefinePropertyValue(ctx, obj, key, value, JS_PROP_C_W_E);
+      JS_FreeAtom(ctx, key);
+      if (res < 0) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+      }
+    }
+    return obj;
+  }
+
+  static JSValue qjs_build_value(QJS_Builder *b, int depth) {
+    JSContext *ctx = b->ctx;
+    if (depth > QJS_SERIALIZE_MAX_DEPTH) {
+      return JS_ThrowRangeError(ctx, "value is too deeply nested");
+    }
+    if (!qjs_build_need(b, 1)) {
+      return JS_EXCEPTION;
+    }
+    uint8_t tag = b->buf[b->pos++];
+    switch (tag) {
+      case QJS_SER_UNDEFINED:
+        return JS_UNDEFINED;
+      case QJS_SER_NULL:
+        return JS_NULL;
+      case QJS_SER_FALSE:
+        return JS_FALSE;
+      case QJS_SER_TRUE:
+        return JS_TRUE;
+      case QJS_SER_INT32:
+        if (!qjs_build_need(b, 4)) {
+          return JS_EXCEPTION;
+        }
+        return JS_NewInt32(ctx, (int32_t) qjs_build_u32(b));
+      case QJS_SER_FLOAT64:
+        if (!qjs_build_need(b, 8)) {
+          return JS_EXCEPTION;
+        }
+        return JS_NewFloat64(ctx, qjs_build_f64(b));
+      case QJS_SER_STRING: {
+        uint64_t len;
+        if (!qjs_build_varuint(b, &len) || !qjs_build_need(b, len)) {
+          return JS_EXCEPTION;
+        }
+        JSValue str = JS_NewStringLen(ctx, reinterpret_cast<const char *>(b->buf + b->pos), len);
+        b->pos += len;
+        return str;
+      }
+      case QJS_SER_ARRAY:
+        return qjs_build_array(b, depth);
+      case QJS_SER_OBJECT:
+        return qjs_build_object(b, depth);
+      case QJS_SER_DATE: {
+        if (!qjs_build_need(b, 8)) {
+          return JS_EXCEPTION;
+        }
+        if (JS_IsUndefined(b->date_ctor)) {
+          JSValue global = JS_GetGlobalObject(ctx);
+          b->date_ctor = JS_GetPropertyStr(ctx, global, "Date");
+          JS_FreeValue(ctx, global);
+          if (JS_IsException(b->date_ctor)) {
+            b->date_ctor = JS_UNDEFINED;
+            return JS_EXCEPTION;
+          }
+        }
+        JSValue t = JS_NewFloat64(ctx, qjs_build_f64(b));
+        return JS_CallConstructor(ctx, b->date_ctor, 1, &t);
+      }
+      case QJS_SER_BYTES: {
+        uint64_t len;
+        if (!qjs_build_varuint(b, &len) || !qjs_build_need(b, len)) {
+          return JS_EXCEPTION;
+        }
+        JSValue buffer = JS_NewArrayBufferCopy(ctx, b->buf + b->pos, len);
+        b->pos += len;
+        return buffer;
+      }
+      case QJS_SER_HANDLE:
+        if (!qjs_build_need(b, 8)) {
+          return JS_EXCEPTION;
+        }
+        return JS_DupValue(ctx, *reinterpret_cast<JSValueConst *>((uintptr_t) qjs_build_u64(b)));
+      default:
+        return JS_ThrowSyntaxError(ctx, "unknown value tag %d at %zu", tag, b->pos - 1);
+    }
+  }
+
+  /**
+   * Build a value from [buf], see QJS_Serialize for the format.
+   */
+  JSValue *QJS_BuildValue(JSContext *ctx, const uint8_t *buf, size_t len) {
+    QJS_Builder b;
+    memset(&b, 0, sizeof(b));
+    b.ctx = ctx;
+    b.buf = buf;
+    b.len = len;
+    b.date_ctor = JS_UNDEFINED;
+    JSValue result = qjs_build_value(&b, 0);
+    if (!JS_IsException(result) && b.pos != b.len) {
+      JS_FreeValue(ctx, result);
+      result = JS_ThrowSyntaxError(ctx, "unexpected data after value at %zu", b.pos);
+    }
+    for (uint32_t i = 0; i < b.key_count; i++) {
+      JS_FreeAtom(ctx, b.keys[i]);
+    }
+    free(b.keys);
+    JS_FreeValue(ctx, b.date_ctor);
+    return jsvalue_to_heap(ctx, result);
+  }
+
+  /**
+   * Batch
+   *
+   * QJS_ExecBatch runs a sequence of operations encoded by the host with a single call, instead of
+   * one FFI transition per property access. Operations read their operands from the borrowed
+   * handles passed in, from the results of earlier operations, or from values inlined in the
+   * buffer, and a value read back is serialized into one buffer.
+   *
+   * The buffer shares the format and the key table of QJS_BuildValue. Each operation is a one byte
+   * code followed by its operands:
+   * - QJS_BATCH_VALUE: value => result
+   * - QJS_BATCH_GET: ref, varuint n, n * key => result, `undefined` once the path reaches `null`
+   *   or `undefined`
+   * - QJS_BATCH_SET: ref, key, ref
+   * - QJS_BATCH_DEFINE: ref, key, ref, uint8 JS_PROP_* flags
+   * - QJS_BATCH_CALL: ref function, ref this, varuint argc, argc * ref => result
+   * - QJS_BATCH_FREE: ref of a result, which is `undefined` afterwards
+   * - QJS_BATCH_READ: ref, serialized into the output buffer in the QJS_Serialize format
+   * A ref is a varuint `r`: handle `r >> 2` when `r & 3` is 0, result `r >> 2` when it is 1, and a
+   * temporary value following in the buffer when `r` is 2.
+   */
+#define QJS_BATCH_VALUE 0
+#define QJS_BATCH_GET 1
+#define QJS_BATCH_SET 2
+#define QJS_BATCH_DEFINE 3
+#define QJS_BATCH_CALL 4
+#define QJS_BATCH_FREE 5
+#define QJS_BATCH_READ 6
+
+#define QJS_BATCH_REF_HANDLE 0
+#define QJS_BATCH_REF_RESULT 1
+#define QJS_BATCH_REF_VALUE 2
+
+  typedef struct QJS_Batch {
+    QJS_Builder b;
+    JSValueConst **handles;
+    int handle_count;
+    JSValue *results;
+    int result_count;
+    int result_cap;
+  } QJS_Batch;
+
+  /**
+   * Read a ref into [out], which is owned by the caller afterwards (refs to handles and results are
+   * duplicated).
+   */
+  static bool qjs_batch_ref(QJS_Batch *batch, JSValue *out) {
+    QJS_Builder *b = &batch->b;
+    uint64_t r;
+    if (!qjs_build_varuint(b, &r)) {
+      return false;
+    }
+    uint64_t index = r >> 2;
+    switch (r & 3) {
+      case QJS_BATCH_REF_HANDLE:
+        if (index < (uint64_t) batch->handle_count) {
+          *out = JS_DupValue(b->ctx, *batch->handles[index]);
+          return true;
+        }
+        break;
+      case QJS_BATCH_REF_RESULT:
+        if (index < (uint64_t) batch->result_count) {
+          *out = JS_DupValue(b->ctx, batch->results[index]);
+          return true;
+        }
+        break;
+      case QJS_BATCH_REF_VALUE:
+        if (index == 0) {
+          *out = qjs_build_value(b, 0);
+          return !JS_IsException(*out);
+        }
+        break;
+    }
+    JS_ThrowSyntaxError(b->ctx, "invalid batch ref %llu at %zu", (unsigned long long) r, b->pos);
+    return false;
+  }
+
+  static bool qjs_batch_push(QJS_Batch *batch, JSValue value) {
+    if (JS_IsException(value)) {
+      return false;
+    }
+    if (batch->result_count == batch->result_cap) {
+      JS_FreeValue(batch->b.ctx, value);
+      JS_ThrowSyntaxError(batch->b.ctx, "too many batch results");
+      return false;
+    }
+    batch->results[batch->result_count++] = value;
+    return true;
+  }
+
+  static JSValue qjs_batch_get(QJS_Batch *batch, JSValue obj) {
+    JSContext *ctx = batch->b.ctx;
+    uint64_t n;
+    if (!qjs_build_varuint(&batch->b, &n)) {
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    }
+    for (uint64_t i = 0; i < n; i++) {
+      JSAtom key = qjs_build_key(&batch->b);
+      if (key == JS_ATOM_NULL) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+      }
+      JSValue next = JS_IsUndefined(obj) || JS_IsNull(obj) ? JS_UNDEFINED : JS_GetProperty(ctx, obj, key);
+      JS_FreeAtom(ctx, key);
+      JS_FreeValue(ctx, obj);
+      if (JS_IsException(next)) {
+        return next;
+      }
+      obj = next;
+    }
+    return obj;
+  }
+
+  static bool qjs_batch_op(QJS_Batch *batch, QJS_Serializer *s) {
+    QJS_Builder *b = &batch->b;
+    JSContext *ctx = b->ctx;
+    uint8_t op = b->buf[b->pos++];
+    JSValue target, func, value;
+    JSAtom key;
+    bool ok;
+    switch (op) {
+      case QJS_BATCH_VALUE:
+        return qjs_batch_push(batch, qjs_build_value(b, 0));
+      case QJS_BATCH_GET:
+        return qjs_batch_ref(batch, &target) && qjs_batch_push(batch, qjs_batch_get(batch, target));
+      case QJS_BATCH_SET:
+      case QJS_BATCH_DEFINE: {
+        if (!qjs_batch_ref(batch, &target)) {
+          return false;
+        }
+        key = qjs_build_key(b);
+        if (key == JS_ATOM_NULL) {
+          JS_FreeValue(ctx, target);
+          return false;
+        }
+        ok = qjs_batch_ref(batch, &value);
+        if (ok && op == QJS_BATCH_DEFINE) {
+          ok = qjs_build_need(b, 1);
+          if (ok) {
+            int flags = b->buf[b->pos++] & JS_PROP_C_W_E;
+            ok = JS_DefinePropertyValue(ctx, target, key, value, flags | JS_PROP_THROW) >= 0;
+          } else {
+            JS_FreeValue(ctx, value);
+          }
+        } else if (ok) {
+          ok = JS_SetProperty(ctx, target, key, value) >= 0;
+        }
+        JS_FreeAtom(ctx, key);
+        JS_FreeValue(ctx, target);
+        return ok;
+      }
+      case QJS_BATCH_CALL: {
+        uint64_t argc;
+        if (!qjs_batch_ref(batch, &func)) {
+          return false;
+        }
+        if (!qjs_batch_ref(batch, &target)) {
+          JS_FreeValue(ctx, func);
+          return false;
+        }
+        ok = qjs_build_varuint(b, &argc) && qjs_build_need(b, argc);
+        JSValue *argv = ok ? static_cast<JSValue *>(malloc(sizeof(JSValue) * (argc == 0 ? 1 : argc))) : NULL;
+        if (ok && argv == NULL) {
+          JS_ThrowOutOfMemory(ctx);
+          ok = false;
+        }
+        uint64_t i = 0;
+        for (; ok && i < argc; i++) {
+          ok = qjs_batch_ref(batch, &argv[i]);
+        }
+        if (ok) {
+          ok = qjs_batch_push(batch, JS_Call(ctx, func, target, (int) argc, argv));
+        } else if (argv != NULL) {
+          // the failed ref did not produce a value.
+          i--;
+        }
+        for (uint64_t j = 0; j < i; j++) {
+          JS_FreeValue(ctx, argv[j]);
+        }
+        free(argv);
+        JS_FreeValue(ctx, func);
+        JS_FreeValue(ctx, target);
+        return ok;
+      }
+      case QJS_BATCH_FREE: {
+        uint64_t r;
+        if (!qjs_build_varuint(b, &r)) {
+          return false;
+        }
+        if ((r & 3) != QJS_BATCH_REF_RESULT || (r >> 2) >= (uint64_t) batch->result_count) {
+          JS_ThrowSyntaxError(ctx, "invalid batch result %llu at %zu", (unsigned long long) r, b->pos);
+          return false;
+        }
+        JS_FreeValue(ctx, batch->results[r >> 2]);
+        batch->results[r >> 2] = JS_UNDEFINED;
+        return true;
+      }
+      case QJS_BATCH_READ:
+        if (!qjs_batch_ref(batch, &value)) {
+          return false;
+        }
+        ok = qjs_ser_value(s, value, 0) && !s->oom;
+        JS_FreeValue(ctx, value);
+        return ok;
+      default:
+        JS_ThrowSyntaxError(ctx, "unknown batch operation %d at %zu", op, b->pos - 1);
+        return false;
+    }
+  }
+
+  /**
+   * Run the operations in [ops], see above for the format.
+   *
+   * [handles] are borrowed. [results] receives a handle for each of the [result_count] results, `NULL` for
+   * the freed ones. Values read are written to a buffer allocated with malloc in [*out], release it with
+   * QJS_FreeBuffer, [read_flags] are the flags of QJS_Serialize.
+   * Returns 0, or -1 with the exception pending in [ctx] and nothing written to [results] and [out].
+   */
+  int QJS_ExecBatch(JSContext *ctx, const uint8_t *ops, size_t len, JSValueConst **handles, int handle_count, JSValue **results, int result_count, int read_flags, uint8_t **out, size_t *out_len) {
+    QJS_Batch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.b.ctx = ctx;
+    batch.b.buf = ops;
+    batch.b.len = len;
+    batch.b.date_ctor = JS_UNDEFINED;
+    batch.handles = handles;
+    batch.handle_count = handle_count;
+    batch.result_cap = result_count;
+    QJS_Serializer s;
+    memset(&s, 0, sizeof(s));
+    s.ctx = ctx;
+    s.flags = read_flags;
+    bool ok = true;
+    if (result_count > 0) {
+      batch.results = static_cast<JSValue *>(malloc(sizeof(JSValue) * result_count));
+      if (batch.results == NULL) {
+        JS_ThrowOutOfMemory(ctx);
+        ok = false;
+      }
+    }
+    while (ok && batch.b.pos < batch.b.len) {
+      ok = qjs_batch_op(&batch, &s);
+    }
+    if (ok && batch.result_count != result_count) {
+      JS_ThrowSyntaxError(ctx, "expected %d batch results, got %d", result_count, batch.result_count);
+      ok = false;
+    }
+    for (int i = 0; i < batch.result_count; i++) {
+      if (!ok) {
+        JS_FreeValue(ctx, batch.results[i]);
+      } else if (JS_IsUndefined(batch.results[i])) {
+        results[i] = NULL;
+      } else {
+        results[i] = jsvalue_to_heap(ctx, batch.results[i]);
+      }
+    }
+    free(batch.results);
+    for (uint32_t i = 0; i < batch.b.key_count; i++) {
+      JS_FreeAtom(ctx, batch.b.keys[i]);
+    }
+    free(batch.b.keys);
+    JS_FreeValue(ctx, batch.b.date_ctor);
+    *out = qjs_ser_finish(&s, ok, out_len);
+    return ok ? 0 : -1;
+  }
+
+  /**
+   * Bytecode
+   *
+   * Compiling once and evaluating the bytecode later skips parsing and compiling, bytecode is only
+   * valid for the QuickJS version reported by QJS_GetVersion.
+   */
+
+  /**
+   * Allocate a buffer that is released by the native side, e.g. the `buff` of a QJS_Module_Loader.
+   */
+  uint8_t *QJS_NewBuffer(size_t size) {
+    return static_cast<uint8_t *>(malloc(size == 0 ? 1 : size));
+  }
+
+  const char *QJS_GetVersion() {
+    return CONFIG_VERSION;
+  }
+
+  /**
+   * Write the bytecode of [func_val] into a buffer allocated with malloc, so the host can keep it
+   * after the runtime is freed. Returns NULL with the exception pending in [ctx] on failure.
+   */
+  static uint8_t *qjs_write_bytecode(JSContext *ctx, JSValueConst func_val, size_t *out_len) {
+    size_t size;
+    uint8_t *bytecode = JS_WriteObject(ctx, &size, func_val, JS_WRITE_OBJ_BYTECODE);
+    if (bytecode == NULL) {
+      return NULL;
+    }
+    uint8_t *result = static_cast<uint8_t *>(malloc(size == 0 ? 1 : size));
+    if (result == NULL) {
+      js_free(ctx, bytecode);
+      JS_ThrowOutOfMemory(ctx);
+      return NULL;
+    }
+    memcpy(result, bytecode, size);
+    js_free(ctx, bytecode);
+    *out_len = size;
+    return result;
+  }
+
+  /**
+   * Compile [js_code] without running it and write its bytecode into a buffer allocated with malloc,
+   * release it with QJS_FreeBuffer. [eval_flags] selects global or module code.
+   * A module is neither linked nor kept in [ctx], importing it later loads it again.
+   * Returns NULL with the exception pending in [ctx] on failure.
+   */
+  uint8_t *QJS_CompileToBytecode(JSContext *ctx, HeapChar *js_code, size_t js_code_len, HeapChar *filename, int eval_flags, size_t *out_len) {
+    *out_len = 0;
+    JSValue func_val = JS_Eval(ctx, js_code, js_code_len, filename, (eval_flags & JS_EVAL_TYPE_MASK) | JS_EVAL_FLAG_COMPILE_ONLY | JS_EVAL_FLAG_NO_RESOLVE);
+    if (JS_IsException(func_val)) {
+      return NULL;
+    }
+    uint8_t *result = qjs_write_bytecode(ctx, func_val, out_len);
+    JS_FreeUnresolvedModule(ctx, func_val);
+    return result;
+  }
+
+  /**
+   * Compile the module [module_name] for a QJS_Module_Loader returning QJS_MODULE_COMPILED: the module
+   * stays in [ctx] and is linked by its importer. Its bytecode is returned like QJS_CompileToBytecode.
+   */
+  uint8_t *QJS_CompileModule(JSContext *ctx, HeapChar *js_code, size_t js_code_len, HeapChar *module_name, size_t *out_len) {
+    *out_len = 0;
+    JSValue func_val = JS_Eval(ctx, js_code, js_code_len, module_name, JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY | JS_EVAL_FLAG_NO_RESOLVE);
+    if (JS_IsException(func_val)) {
+      return NULL;
+    }
+    uint8_t *result = qjs_write_bytecode(ctx, func_val, out_len);
+    if (result == NULL) {
+      JS_FreeUnresolvedModule(ctx, func_val);
+      return NULL;
+    }
+    // the module is referenced by the loaded modules of ctx
+    JS_FreeValue(ctx, func_val);
+    return result;
+  }
+
+  /**
+   * Evaluate [js_code] like QJS_Eval and write the bytecode it was compiled to into [*out_bytecode],
+   * release it with QJS_FreeBuffer. [*out_bytecode] is NULL when the code could not be compiled.
+   */
+  JSValue *QJS_EvalToBytecode(JSContext *ctx, HeapChar *js_code, size_t js_code_len, HeapChar *filename, int eval_flags, uint8_t **out_bytecode, size_t *out_len) {
+    *out_bytecode = NULL;
+    *out_len = 0;
+    JSValue func_val = JS_Eval(ctx, js_code, js_code_len, filename, (eval_flags & JS_EVAL_TYPE_MASK) | JS_EVAL_FLAG_COMPILE_ONLY | JS_EVAL_FLAG_NO_RESOLVE);
+    if (JS_IsException(func_val)) {
+      return jsvalue_to_heap(ctx, func_val);
+    }
+    *out_bytecode = qjs_write_bytecode(ctx, func_val, out_len);
+    if (*out_bytecode == NULL) {
+      JS_FreeUnresolvedModule(ctx, func_val);
+      return jsvalue_to_heap(ctx, JS_EXCEPTION);
+    }
+    if (JS_VALUE_GET_TAG(func_val) == JS_TAG_MODULE && JS_ResolveModule(ctx, func_val) < 0) {
+      JS_FreeValue(ctx, func_val);
+      return jsvalue_to_heap(ctx, JS_EXCEPTION);
+    }
+    // consumes func_val
+    return jsvalue_to_heap(ctx, JS_EvalFunction(ctx, func_val));
+  }
+
+  /**
+   * Evaluate bytecode written by QJS_CompileToBytecode, like QJS_Eval does for source.
+   */
+  JSValue *QJS_EvalBytecode(JSContext *ctx, const uint8_t *buf, size_t len) {
+    JSValue func_val = JS_ReadObject(ctx, buf, len, JS_READ_OBJ_BYTECODE);
+    if (JS_IsException(func_val)) {
+      return jsvalue_to_heap(ctx, func_val);
+    }
+    if (JS_VALUE_GET_TAG(func_val) == JS_TAG_MODULE && JS_ResolveModule(ctx, func_val) < 0) {
+      JS_FreeValue(ctx, func_val);
+      return jsvalue_to_heap(ctx, JS_EXCEPTION);
+    }
+    // consumes func_val
+    return jsvalue_to_heap(ctx, JS_EvalFunction(ctx, func_val));
   }
 
   const char* hello_world() {
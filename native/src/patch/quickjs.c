@@ -38,6 +38,16 @@
 #elif defined(__FreeBSD__)
 #include <malloc_np.h>
 #endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSON_SCAN_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define JSON_SCAN_NEON
+#include <arm_neon.h>
+#endif
 
 #ifdef _MSC_VER
 #pragma function (ceil)
@@ -82,11 +92,18 @@ int gettimeofday(struct timeval * tp, struct timezone * tzp)
 
 #define OPTIMIZE         1
 #define SHORT_OPCODES    1
-#if defined(EMSCRIPTEN) || defined(_MSC_VER)
+/* DIRECT_DISPATCH can be set by the build (see
+   native/android/CMakeLists.txt) */
+#ifndef DIRECT_DISPATCH
+#if defined(EMSCRIPTEN) || (defined(_MSC_VER) && !defined(__clang__))
 #define DIRECT_DISPATCH  0
 #else
 #define DIRECT_DISPATCH  1
 #endif
+#endif
+#if DIRECT_DISPATCH && !defined(__GNUC__) && !defined(__clang__)
+#error "DIRECT_DISPATCH requires computed gotos (GCC or Clang)"
+#endif
 
 #if defined(__APPLE__)
 #define MALLOC_OVERHEAD  0
@@ -239,6 +256,22 @@ typedef enum JSErrorEnum {
 #define __exception __attribute__((warn_unused_result))
 
 typedef struct JSShape JSShape;
+
+/* cache of the shape obtained by adding a property to another shape.
+   Both shapes are hashed and referenced by the entry, so they are
+   cloned rather than modified while cached. The entries are released
+   at each full collection. */
+#define JS_SHAPE_TRANSITION_BITS 8
+#define JS_SHAPE_TRANSITION_SIZE (1 << JS_SHAPE_TRANSITION_BITS)
+
+typedef struct JSShapeTransition {
+    JSShape *sh; /* NULL if unused */
+    /* NULL if the transition was only taken once: 'sh' is then not
+       referenced, see add_property() */
+    JSShape *next_sh;
+    JSAtom atom;
+    int prop_flags;
+} JSShapeTransition;
 typedef struct JSString JSString;
 typedef struct JSString JSAtomStruct;
 
@@ -294,7 +327,21 @@ struct JSRuntime {
     struct list_head gc_zero_ref_count_list; 
     struct list_head tmp_obj_list; /* used during GC */
     JSGCPhaseEnum gc_phase : 8;
+    JSGCModeEnum gc_mode : 8;
     size_t malloc_gc_threshold;
+    /* percentage of malloc_size added to it to get the next
+       malloc_gc_threshold */
+    uint32_t gc_threshold_growth;
+    size_t gc_last_size; /* malloc_size after the last collection */
+    /* list of JSGCObjectHeader.link. GC objects allocated since the
+       last collection in JS_GC_MODE_GENERATIONAL */
+    struct list_head gc_young_obj_list;
+    /* list of JSGCObjectHeader.link. Objects only referenced by the
+       cycles freed by a minor collection */
+    struct list_head gc_orphan_list;
+    uint32_t gc_young_count; /* objects added to gc_young_obj_list */
+    uint32_t gc_young_threshold; /* gc_young_count triggering a minor GC */
+    JSGCStats gc_stats;
 #ifdef DUMP_LEAKS
     struct list_head string_list; /* list of JSString.link */
 #endif
@@ -324,12 +371,16 @@ struct JSRuntime {
     BOOL can_block : 8; /* TRUE if Atomics.wait can block */
     /* used to allocate, free and clone SharedArrayBuffers */
     JSSharedArrayBufferFunctions sab_funcs;
+    /* used to allocate and free the data of ArrayBuffers */
+    JSArrayBufferFunctions ab_funcs;
     
     /* Shape hash table */
     int shape_hash_bits;
     int shape_hash_size;
     int shape_hash_count; /* number of hashed shapes */
     JSShape **shape_hash;
+    /* recently taken shape transitions, see add_property() */
+    JSShapeTransition shape_transitions[JS_SHAPE_TRANSITION_SIZE];
 #ifdef CONFIG_BIGNUM
     bf_context_t bf_ctx;
     JSNumericOperations bigint_ops;
@@ -384,7 +435,8 @@ typedef enum {
 struct JSGCObjectHeader {
     int ref_count; /* must come first, 32-bit */
     JSGCObjectTypeEnum gc_obj_type : 4;
-    uint8_t mark : 4; /* used by the GC */
+    uint8_t mark : 3; /* used by the GC */
+    uint8_t young : 1; /* in gc_young_obj_list, used by the GC */
     uint8_t dummy1; /* not used by the GC */
     uint16_t dummy2; /* not used by the GC */
     struct list_head link;
@@ -614,6 +666,32 @@ typedef enum JSFunctionKindEnum {
     JS_FUNC_ASYNC_GENERATOR = (JS_FUNC_GENERATOR | JS_FUNC_ASYNC),
 } JSFunctionKindEnum;
 
+/* inline cache of the get_field, get_field2 and put_field instructions
+   of a function, allocated on the first cacheable access. A slot is
+   selected by the offset of the instruction and remembers the property
+   index for up to JS_IC_WAYS receiver shapes. The cached shapes are
+   hashed and referenced by the cache: such a shape is cloned instead of
+   being modified (see add_property() and js_shape_prepare_update()), so
+   an entry matches only while the property layout is unchanged. */
+#define JS_IC_WAYS 2
+
+typedef struct JSInlineCacheEntry {
+    JSShape *shape; /* receiver shape, NULL if unused */
+    JSShape *holder_shape; /* shape of the prototype holding the
+                              property, NULL for an own property */
+    uint32_t prop_idx;
+} JSInlineCacheEntry;
+
+typedef struct JSInlineCacheSlot {
+    uint32_t pos; /* instruction offset + 1, 0 if unused */
+    JSInlineCacheEntry e[JS_IC_WAYS]; /* most recent first */
+} JSInlineCacheSlot;
+
+typedef struct JSInlineCache {
+    int hash_bits;
+    JSInlineCacheSlot slots[0];
+} JSInlineCache;
+
 typedef struct JSFunctionBytecode {
     JSGCObjectHeader header; /* must come first */
     uint8_t js_mode;
@@ -644,6 +722,7 @@ typedef struct JSFunctionBytecode {
     JSValue *cpool; /* constant pool (self pointer) */
     int cpool_count;
     int closure_var_count;
+    JSInlineCache *ic; /* NULL until a property access is cached */
     struct {
         /* debug info, move to separate structure to save memory? */
         JSAtom filename;
@@ -1032,6 +1111,7 @@ static JSAtom __JS_NewAtomInit(JSRuntime *rt, const char *str, int len,
                                int atom_type);
 static void JS_FreeAtomStruct(JSRuntime *rt, JSAtomStruct *p);
 static void free_function_bytecode(JSRuntime *rt, JSFunctionBytecode *b);
+static int js_ic_new(JSRuntime *rt, JSFunctionBytecode *b);
 static JSValue js_call_c_function(JSContext *ctx, JSValueConst func_obj,
                                   JSValueConst this_obj,
                                   int argc, JSValueConst *argv, int flags);
@@ -1200,6 +1280,7 @@ static JSValue js_array_buffer_constructor3(JSContext *ctx,
                                             uint8_t *buf,
                                             JSFreeArrayBufferDataFunc *free_func,
                                             void *opaque, BOOL alloc_flag);
+static void js_array_buffer_free(JSRuntime *rt, void *opaque, void *ptr);
 static JSArrayBuffer *js_get_array_buffer(JSContext *ctx, JSValueConst obj);
 static JSValue js_typed_array_constructor(JSContext *ctx,
                                           JSValueConst this_val,
@@ -1250,6 +1331,7 @@ static void async_func_mark(JSRuntime *rt, JSAsyncFunctionState *s,
                             JS_MarkFunc *mark_func);
 static void JS_AddIntrinsicBasicObjects(JSContext *ctx);
 static void js_free_shape(JSRuntime *rt, JSShape *sh);
+static void js_shape_transition_flush(JSRuntime *rt);
 static void js_free_shape_null(JSRuntime *rt, JSShape *sh);
 static int js_shape_prepare_update(JSContext *ctx, JSObject *p,
                                    JSShapeProperty **pprs);
@@ -1275,6 +1357,7 @@ static JSAtom js_symbol_to_atom(JSContext *ctx, JSValue val);
 static void add_gc_object(JSRuntime *rt, JSGCObjectHeader *h,
                           JSGCObjectTypeEnum type);
 static void remove_gc_object(JSGCObjectHeader *h);
+static void gc_promote_young(JSRuntime *rt);
 static void js_async_function_free0(JSRuntime *rt, JSAsyncFunctionData *s);
 static JSValue js_instantiate_prototype(JSContext *ctx, JSObject *p, JSAtom atom, void *opaque);
 static JSValue js_module_ns_autoinit(JSContext *ctx, JSObject *p, JSAtom atom,
@@ -1289,12 +1372,24 @@ static const JSClassExoticMethods js_proxy_exotic_methods;
 static const JSClassExoticMethods js_module_ns_exotic_methods;
 static JSClassID js_class_id_alloc = JS_CLASS_INIT_COUNT;
 
+/* list holding the GC object 'h', to insert it again after it moved */
+static inline struct list_head *gc_obj_list_of(JSRuntime *rt,
+                                               JSGCObjectHeader *h)
+{
+    return h->young ? &rt->gc_young_obj_list : &rt->gc_obj_list;
+}
+
 static void js_trigger_gc(JSRuntime *rt, size_t size)
 {
     BOOL force_gc;
 #ifdef FORCE_GC_AT_MALLOC
     force_gc = TRUE;
 #else
+    if (rt->gc_mode == JS_GC_MODE_GENERATIONAL &&
+        rt->gc_young_count >= rt->gc_young_threshold &&
+        rt->malloc_gc_threshold != (size_t)-1) {
+        JS_RunMinorGC(rt);
+    }
     force_gc = ((rt->malloc_state.malloc_size + size) >
                 rt->malloc_gc_threshold);
 #endif
@@ -1305,7 +1400,7 @@ static void js_trigger_gc(JSRuntime *rt, size_t size)
 #endif
         JS_RunGC(rt);
         rt->malloc_gc_threshold = rt->malloc_state.malloc_size +
-            (rt->malloc_state.malloc_size >> 1);
+            rt->malloc_state.malloc_size / 100 * rt->gc_threshold_growth;
     }
 }
 
@@ -1652,6 +1747,7 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     }
     rt->malloc_state = ms;
     rt->malloc_gc_threshold = 256 * 1024;
+    rt->gc_threshold_growth = 50;
 
 #ifdef CONFIG_BIGNUM
     bf_context_init(&rt->bf_ctx, js_bf_realloc, rt);
@@ -1663,7 +1759,11 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     init_list_head(&rt->context_list);
     init_list_head(&rt->gc_obj_list);
     init_list_head(&rt->gc_zero_ref_count_list);
+    init_list_head(&rt->gc_young_obj_list);
+    init_list_head(&rt->gc_orphan_list);
     rt->gc_phase = JS_GC_PHASE_NONE;
+    rt->gc_mode = JS_GC_MODE_FULL;
+    rt->gc_young_threshold = 8192;
     
 #ifdef DUMP_LEAKS
     init_list_head(&rt->string_list);
@@ -1810,12 +1910,53 @@ void JS_SetMemoryLimit(JSRuntime *rt, size_t limit)
     rt->malloc_state.malloc_limit = limit;
 }
 
+/* the size is also seen by the GC threshold, so that garbage held
+   outside of the runtime allocator triggers collections */
+int JS_AddExternalMemory(JSRuntime *rt, size_t size)
+{
+    JSMallocState *s = &rt->malloc_state;
+    if (s->malloc_size + size > s->malloc_limit)
+        return -1;
+    s->malloc_size += size;
+    return 0;
+}
+
+void JS_RemoveExternalMemory(JSRuntime *rt, size_t size)
+{
+    rt->malloc_state.malloc_size -= size;
+}
+
 /* use -1 to disable automatic GC */
 void JS_SetGCThreshold(JSRuntime *rt, size_t gc_threshold)
 {
     rt->malloc_gc_threshold = gc_threshold;
 }
 
+/* percentage of the heap size allocated before the next automatic
+   GC, 50 by default */
+void JS_SetGCThresholdGrowth(JSRuntime *rt, uint32_t percent)
+{
+    rt->gc_threshold_growth = percent;
+}
+
+void JS_SetGCMode(JSRuntime *rt, JSGCModeEnum mode)
+{
+    if (mode != JS_GC_MODE_GENERATIONAL)
+        gc_promote_young(rt);
+    rt->gc_mode = mode;
+}
+
+/* number of GC objects allocated between two minor collections */
+void JS_SetGCYoungThreshold(JSRuntime *rt, uint32_t count)
+{
+    rt->gc_young_threshold = max_int(count, 1);
+}
+
+void JS_GetGCStats(JSRuntime *rt, JSGCStats *s)
+{
+    *s = rt->gc_stats;
+}
+
 #define malloc(s) malloc_is_forbidden(s)
 #define free(p) free_is_forbidden(p)
 #define realloc(p,s) realloc_is_forbidden(p,s)
@@ -1837,6 +1978,12 @@ void JS_SetSharedArrayBufferFunctions(JSRuntime *rt,
     rt->sab_funcs = *sf;
 }
 
+void JS_SetArrayBufferFunctions(JSRuntime *rt,
+                                const JSArrayBufferFunctions *af)
+{
+    rt->ab_funcs = *af;
+}
+
 /* return 0 if OK, < 0 if exception */
 int JS_EnqueueJob(JSContext *ctx, JSJobFunc *job_func,
                   int argc, JSValueConst *argv)
@@ -1858,6 +2005,21 @@ int JS_EnqueueJob(JSContext *ctx, JSJobFunc *job_func,
     return 0;
 }
 
+/* drop the pending jobs without executing them */
+void JS_ClearPendingJobs(JSRuntime *rt)
+{
+    struct list_head *el, *el1;
+    int i;
+
+    list_for_each_safe(el, el1, &rt->job_list) {
+        JSJobEntry *e = list_entry(el, JSJobEntry, link);
+        list_del(&e->link);
+        for(i = 0; i < e->argc; i++)
+            JS_FreeValueRT(rt, e->argv[i]);
+        js_free_rt(rt, e);
+    }
+}
+
 BOOL JS_IsJobPending(JSRuntime *rt)
 {
     return !list_empty(&rt->job_list);
@@ -2314,6 +2476,7 @@ void JS_FreeContext(JSContext *ctx)
     if (--ctx->header.ref_count > 0)
         return;
     assert(ctx->header.ref_count == 0);
+    js_shape_transition_flush(rt);
     
 #ifdef DUMP_ATOMS
     JS_DumpAtoms(ctx->rt);
@@ -3517,6 +3680,38 @@ static JSValue js_new_string16(JSContext *ctx, const uint16_t *buf, int len)
     return JS_MKPTR(JS_TAG_STRING, str);
 }
 
+/* create a string from 'len' Latin-1 characters */
+JSValue JS_NewStringLatin1(JSContext *ctx, const uint8_t *buf, size_t len)
+{
+    if (len > JS_STRING_LEN_MAX)
+        return JS_ThrowRangeError(ctx, "invalid string length");
+    return js_new_string8(ctx, buf, len);
+}
+
+/* create a string from 'len' UTF-16 code units */
+JSValue JS_NewStringUTF16(JSContext *ctx, const uint16_t *buf, size_t len)
+{
+    if (len > JS_STRING_LEN_MAX)
+        return JS_ThrowRangeError(ctx, "invalid string length");
+    return js_new_string16(ctx, buf, len);
+}
+
+/* return the characters of the string 'val' without conversion: Latin-1
+   bytes if '*pwide' is FALSE, UTF-16 code units otherwise. The buffer is
+   owned by 'val' and is valid as long as 'val' is alive. Return NULL if
+   'val' is not a string. */
+const void *JS_GetStringBuffer(JSValueConst val, size_t *plen, JS_BOOL *pwide)
+{
+    JSString *p;
+
+    if (JS_VALUE_GET_TAG(val) != JS_TAG_STRING)
+        return NULL;
+    p = JS_VALUE_GET_STRING(val);
+    *plen = p->len;
+    *pwide = p->is_wide_char;
+    return p->is_wide_char ? (const void *)p->u.str16 : (const void *)p->u.str8;
+}
+
 static JSValue js_new_string_char(JSContext *ctx, uint16_t c)
 {
     if (c < 0x100) {
@@ -4480,6 +4675,115 @@ static void js_free_shape_null(JSRuntime *rt, JSShape *sh)
         js_free_shape(rt, sh);
 }
 
+static inline JSShapeTransition *js_shape_transition_entry(JSRuntime *rt,
+                                                           JSShape *sh,
+                                                           JSAtom atom)
+{
+    uint32_t h;
+    h = ((uint32_t)(uintptr_t)sh >> 4) * 0x9e3779b1 + atom;
+    h = h * 0x9e3779b1;
+    return &rt->shape_transitions[h >> (32 - JS_SHAPE_TRANSITION_BITS)];
+}
+
+/* return the cached shape of 'sh' + (atom, prop_flags) or NULL */
+static inline JSShape *js_shape_transition_find(JSRuntime *rt, JSShape *sh,
+                                                JSAtom atom, int prop_flags)
+{
+    JSShapeTransition *t = js_shape_transition_entry(rt, sh, atom);
+    if (t->sh == sh && t->atom == atom && t->prop_flags == prop_flags)
+        return t->next_sh;
+    return NULL;
+}
+
+static void js_shape_transition_clear(JSRuntime *rt, JSShapeTransition *t)
+{
+    JSShape *sh = t->sh, *next_sh = t->next_sh;
+    /* the entry is cleared first: freeing a shape can free objects */
+    t->sh = NULL;
+    t->next_sh = NULL;
+    if (next_sh) {
+        js_free_shape(rt, sh);
+        js_free_shape(rt, next_sh);
+    }
+}
+
+static void js_shape_transition_add(JSRuntime *rt, JSShape *sh, JSAtom atom,
+                                    int prop_flags, JSShape *next_sh)
+{
+    JSShapeTransition *t = js_shape_transition_entry(rt, sh, atom);
+    js_shape_transition_clear(rt, t);
+    t->sh = js_dup_shape(sh);
+    t->next_sh = js_dup_shape(next_sh);
+    t->atom = atom;
+    t->prop_flags = prop_flags;
+}
+
+/* return TRUE if the transition was already taken once since it was
+   last cached, otherwise remember that it was taken */
+static BOOL js_shape_transition_seen(JSRuntime *rt, JSShape *sh, JSAtom atom,
+                                     int prop_flags)
+{
+    JSShapeTransition *t = js_shape_transition_entry(rt, sh, atom);
+    if (t->sh == sh && t->atom == atom && t->prop_flags == prop_flags &&
+        !t->next_sh)
+        return TRUE;
+    js_shape_transition_clear(rt, t);
+    /* only compared, 'sh' may be freed and its address reused */
+    t->sh = sh;
+    t->atom = atom;
+    t->prop_flags = prop_flags;
+    return FALSE;
+}
+
+static void js_shape_transition_flush(JSRuntime *rt)
+{
+    int i;
+
+    for(i = 0; i < JS_SHAPE_TRANSITION_SIZE; i++)
+        js_shape_transition_clear(rt, &rt->shape_transitions[i]);
+}
+
+static size_t js_inline_cache_size(int hash_bits)
+{
+    return sizeof(JSInlineCache) + (sizeof(JSInlineCacheSlot) << hash_bits);
+}
+
+static void js_inline_cache_free_entry(JSRuntime *rt, JSInlineCacheEntry *e)
+{
+    js_free_shape_null(rt, e->shape);
+    js_free_shape_null(rt, e->holder_shape);
+    e->shape = NULL;
+    e->holder_shape = NULL;
+}
+
+static void js_inline_cache_free(JSRuntime *rt, JSInlineCache *ic)
+{
+    int i, j;
+
+    for(i = 0; i < (1 << ic->hash_bits); i++) {
+        for(j = 0; j < JS_IC_WAYS; j++)
+            js_inline_cache_free_entry(rt, &ic->slots[i].e[j]);
+    }
+    js_free_rt(rt, ic);
+}
+
+static void js_inline_cache_mark(JSRuntime *rt, JSInlineCache *ic,
+                                 JS_MarkFunc *mark_func)
+{
+    JSInlineCacheEntry *e;
+    int i, j;
+
+    for(i = 0; i < (1 << ic->hash_bits); i++) {
+        for(j = 0; j < JS_IC_WAYS; j++) {
+            e = &ic->slots[i].e[j];
+            if (e->shape)
+                mark_func(rt, &e->shape->header);
+            if (e->holder_shape)
+                mark_func(rt, &e->holder_shape->header);
+        }
+    }
+}
+
 /* make space to hold at least 'count' properties */
 static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
                                        JSObject *p, uint32_t count)
@@ -4516,7 +4820,7 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
         /* copy all the fields and the properties */
         memcpy(sh, old_sh,
                sizeof(JSShape) + sizeof(sh->prop[0]) * old_sh->prop_count);
-        list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+        list_add_tail(&sh->header.link, gc_obj_list_of(ctx->rt, &sh->header));
         new_hash_mask = new_hash_size - 1;
         sh->prop_hash_mask = new_hash_mask;
         memset(prop_hash_end(sh) - new_hash_size, 0,
@@ -4536,11 +4840,11 @@ static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
                               get_shape_size(new_hash_size, new_size));
         if (unlikely(!sh_alloc)) {
             /* insert again in the GC list */
-            list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+            list_add_tail(&sh->header.link, gc_obj_list_of(ctx->rt, &sh->header));
             return -1;
         }
         sh = get_shape_from_alloc(sh_alloc, new_hash_size);
-        list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+        list_add_tail(&sh->header.link, gc_obj_list_of(ctx->rt, &sh->header));
     }
     *psh = sh;
     sh->prop_size = new_size;
@@ -4577,7 +4881,7 @@ static int compact_properties(JSContext *ctx, JSObject *p)
     sh = get_shape_from_alloc(sh_alloc, new_hash_size);
     list_del(&old_sh->header.link);
     memcpy(sh, old_sh, sizeof(JSShape));
-    list_add_tail(&sh->header.link, &ctx->rt->gc_obj_list);
+    list_add_tail(&sh->header.link, gc_obj_list_of(ctx->rt, &sh->header));
     
     memset(prop_hash_end(sh) - new_hash_size, 0,
            sizeof(prop_hash_end(sh)[0]) * new_hash_size);
@@ -5097,7 +5401,8 @@ typedef struct JSCFunctionDataRecord {
     JSCFunctionData *func;
     uint8_t length;
     uint8_t data_len;
-    uint16_t magic;
+    /* widened from uint16_t so that hosts can carry a full function id */
+    int32_t magic;
     JSValue data[0];
 } JSCFunctionDataRecord;
 
@@ -5547,6 +5852,12 @@ void __JS_FreeValueRT(JSRuntime *rt, JSValue v)
                 if (rt->gc_phase == JS_GC_PHASE_NONE) {
                     free_zero_refcount(rt);
                 }
+            } else if (p->mark == 0) {
+                /* not in a freed cycle: an old object only referenced
+                   by the young cycles of a minor collection. Freed
+                   once the cycles are. */
+                list_del(&p->link);
+                list_add_tail(&p->link, &rt->gc_orphan_list);
             }
         }
         break;
@@ -5594,7 +5905,14 @@ static void add_gc_object(JSRuntime *rt, JSGCObjectHeader *h,
 {
     h->mark = 0;
     h->gc_obj_type = type;
-    list_add_tail(&h->link, &rt->gc_obj_list);
+    if (rt->gc_mode == JS_GC_MODE_GENERATIONAL) {
+        h->young = 1;
+        rt->gc_young_count++;
+        list_add_tail(&h->link, &rt->gc_young_obj_list);
+    } else {
+        h->young = 0;
+        list_add_tail(&h->link, &rt->gc_obj_list);
+    }
 }
 
 static void remove_gc_object(JSGCObjectHeader *h)
@@ -5602,6 +5920,20 @@ static void remove_gc_object(JSGCObjectHeader *h)
     list_del(&h->link);
 }
 
+static void gc_list_splice_tail(struct list_head *list, struct list_head *head)
+{
+    struct list_head *first, *last;
+    if (list_empty(list))
+        return;
+    first = list->next;
+    last = list->prev;
+    first->prev = head->prev;
+    head->prev->next = first;
+    last->next = head;
+    head->prev = last;
+    init_list_head(list);
+}
+
 void JS_MarkValue(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
 {
     if (JS_VALUE_HAS_REF_COUNT(val)) {
@@ -5673,6 +6005,9 @@ static void mark_children(JSRuntime *rt, JSGCObjectHeader *gp,
             }
             if (b->realm)
                 mark_func(rt, &b->realm->header);
+            /* the cached shapes reference their prototype */
+            if (b->ic)
+                js_inline_cache_mark(rt, b->ic, mark_func);
         }
         break;
     case JS_GC_OBJ_TYPE_VAR_REF:
@@ -5827,10 +6162,140 @@ static void gc_free_cycles(JSRuntime *rt)
     }
 
     init_list_head(&rt->gc_zero_ref_count_list);
+
+    if (!list_empty(&rt->gc_orphan_list)) {
+        gc_list_splice_tail(&rt->gc_orphan_list, &rt->gc_zero_ref_count_list);
+        free_zero_refcount(rt);
+    }
+}
+
+/* minor collection: the young objects form the scanned subset. Only
+   the references between young objects are removed, so a young object
+   referenced by an old object or by a root keeps a non zero refcount
+   and is scanned as alive. Cycles spanning both generations are left
+   to the next full collection. */
+
+static void gc_decref_young_child(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->young)
+        gc_decref_child(rt, p);
+}
+
+static void gc_decref_young(JSRuntime *rt)
+{
+    struct list_head *el, *el1;
+    JSGCObjectHeader *p;
+
+    init_list_head(&rt->tmp_obj_list);
+
+    list_for_each_safe(el, el1, &rt->gc_young_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        assert(p->mark == 0);
+        mark_children(rt, p, gc_decref_young_child);
+        p->mark = 1;
+        if (p->ref_count == 0) {
+            list_del(&p->link);
+            list_add_tail(&p->link, &rt->tmp_obj_list);
+        }
+    }
+}
+
+static void gc_scan_young_incref_child(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->young) {
+        p->ref_count++;
+        if (p->ref_count == 1) {
+            list_del(&p->link);
+            list_add_tail(&p->link, &rt->gc_young_obj_list);
+            p->mark = 0;
+        }
+    }
+}
+
+static void gc_scan_young_incref_child2(JSRuntime *rt, JSGCObjectHeader *p)
+{
+    if (p->young)
+        p->ref_count++;
+}
+
+static void gc_scan_young(JSRuntime *rt)
+{
+    struct list_head *el;
+    JSGCObjectHeader *p;
+
+    list_for_each(el, &rt->gc_young_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        assert(p->ref_count > 0);
+        p->mark = 0;
+        mark_children(rt, p, gc_scan_young_incref_child);
+    }
+
+    list_for_each(el, &rt->tmp_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        mark_children(rt, p, gc_scan_young_incref_child2);
+    }
+}
+
+/* move the young objects to gc_obj_list */
+static void gc_promote_young(JSRuntime *rt)
+{
+    struct list_head *el;
+    JSGCObjectHeader *p;
+
+    list_for_each(el, &rt->gc_young_obj_list) {
+        p = list_entry(el, JSGCObjectHeader, link);
+        p->young = 0;
+    }
+    gc_list_splice_tail(&rt->gc_young_obj_list, &rt->gc_obj_list);
+    rt->gc_young_count = 0;
+}
+
+static int64_t gc_clock_us(void)
+{
+#ifdef _MSC_VER
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (now.QuadPart / freq.QuadPart) * 1000000 +
+        (now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static void gc_update_stats(JSRuntime *rt, int64_t start, size_t start_size,
+                            BOOL minor)
+{
+    JSGCStats *s = &rt->gc_stats;
+    int64_t pause = gc_clock_us() - start;
+    size_t size = rt->malloc_state.malloc_size;
+    s->last_freed_bytes = size < start_size ? start_size - size : 0;
+    s->freed_bytes += s->last_freed_bytes;
+    rt->gc_last_size = size;
+    if (minor) {
+        s->minor_count++;
+        s->minor_time_us += pause;
+    } else {
+        s->full_count++;
+        s->full_time_us += pause;
+    }
+    s->last_pause_us = pause;
+    if (pause > s->max_pause_us)
+        s->max_pause_us = pause;
 }
 
 void JS_RunGC(JSRuntime *rt)
 {
+    int64_t start = gc_clock_us();
+    size_t start_size = rt->malloc_state.malloc_size;
+
+    /* the whole heap is scanned */
+    gc_promote_young(rt);
+    /* the cached shapes reference their prototype */
+    js_shape_transition_flush(rt);
+
     /* decrement the reference of the children of each object. mark =
        1 after this pass. */
     gc_decref(rt);
@@ -5840,6 +6305,38 @@ void JS_RunGC(JSRuntime *rt)
 
     /* free the GC objects in a cycle */
     gc_free_cycles(rt);
+
+    gc_update_stats(rt, start, start_size, FALSE);
+}
+
+/* only scan the objects allocated since the previous collection, the
+   survivors are promoted. Same as JS_RunGC in JS_GC_MODE_FULL. */
+void JS_RunMinorGC(JSRuntime *rt)
+{
+    int64_t start;
+    size_t start_size;
+
+    if (rt->gc_mode != JS_GC_MODE_GENERATIONAL) {
+        JS_RunGC(rt);
+        return;
+    }
+    start = gc_clock_us();
+    start_size = rt->malloc_state.malloc_size;
+    gc_decref_young(rt);
+    gc_scan_young(rt);
+    gc_free_cycles(rt);
+    gc_promote_young(rt);
+    gc_update_stats(rt, start, start_size, TRUE);
+}
+
+/* collect if anything was allocated since the last collection, for
+   hosts running the GC while idle. Return TRUE if it ran. */
+BOOL JS_RunIdleGC(JSRuntime *rt)
+{
+    if (rt->malloc_state.malloc_size <= rt->gc_last_size)
+        return FALSE;
+    JS_RunGC(rt);
+    return TRUE;
 }
 
 /* Return false if not an object or if the object has already been
@@ -5898,6 +6395,10 @@ static void compute_bytecode_size(JSFunctionBytecode *b, JSMemoryUsage_helper *h
     if (b->closure_var) {
         js_func_size += b->closure_var_count * sizeof(*b->closure_var);
     }
+    if (b->ic) {
+        memory_used_count++;
+        js_func_size += js_inline_cache_size(b->ic->hash_bits);
+    }
     if (!b->read_only_bytecode && b->byte_code_buf) {
         hp->js_func_code_size += b->byte_code_len;
     }
@@ -5940,6 +6441,9 @@ void JS_ComputeMemoryUsage(JSRuntime *rt, JSMemoryUsage *s)
     int i;
     JSMemoryUsage_helper mem = { 0 }, *hp = &mem;
 
+    /* the walk below only covers gc_obj_list */
+    gc_promote_young(rt);
+
     memset(s, 0, sizeof(*s));
     s->malloc_count = rt->malloc_state.malloc_count;
     s->malloc_size = rt->malloc_state.malloc_size;
@@ -6265,6 +6769,7 @@ void JS_DumpMemoryUsage(FILE *fp, const JSMemoryUsage *s, JSRuntime *rt)
             int obj_classes[JS_CLASS_INIT_COUNT + 1] = { 0 };
             int class_id;
             struct list_head *el;
+            gc_promote_young(rt);
             list_for_each(el, &rt->gc_obj_list) {
                 JSGCObjectHeader *gp = list_entry(el, JSGCObjectHeader, link);
                 JSObject *p;
@@ -6396,6 +6901,7 @@ void JS_DumpMemoryUsageToCharArray(char *fp, int length, const JSMemoryUsage *s,
             int obj_classes[JS_CLASS_INIT_COUNT + 1] = { 0 };
             int class_id;
             struct list_head *el;
+            gc_promote_young(rt);
             list_for_each(el, &rt->gc_obj_list) {
                 JSGCObjectHeader *gp = list_entry(el, JSGCObjectHeader, link);
                 JSObject *p;
@@ -8149,7 +8655,12 @@ static JSProperty *add_property(JSContext *ctx,
     sh = p->shape;
     if (sh->is_hashed) {
         /* try to find an existing shape */
-        new_sh = find_hashed_shape_prop(ctx->rt, sh, prop, prop_flags);
+        new_sh = js_shape_transition_find(ctx->rt, sh, prop, prop_flags);
+        if (!new_sh) {
+            new_sh = find_hashed_shape_prop(ctx->rt, sh, prop, prop_flags);
+            if (new_sh)
+                js_shape_transition_add(ctx->rt, sh, prop, prop_flags, new_sh);
+        }
         if (new_sh) {
             /* matching shape found: use it */
             /*  the property array may need to be resized */
@@ -8172,8 +8683,20 @@ static JSProperty *add_property(JSContext *ctx,
             /* hash the cloned shape */
             new_sh->is_hashed = TRUE;
             js_shape_hash_link(ctx->rt, new_sh);
-            js_free_shape(ctx->rt, p->shape);
             p->shape = new_sh;
+            if (add_shape_property(ctx, &p->shape, p, prop, prop_flags)) {
+                js_free_shape(ctx->rt, sh);
+                return NULL;
+            }
+            /* the next objects built the same way take this transition
+               instead of cloning 'sh' again. It is only cached the second
+               time it is taken: the reference held by the cache makes the
+               object clone its shape again on its next add, too costly
+               for an object built alone key by key */
+            if (js_shape_transition_seen(ctx->rt, sh, prop, prop_flags))
+                js_shape_transition_add(ctx->rt, sh, prop, prop_flags, p->shape);
+            js_free_shape(ctx->rt, sh);
+            return &p->prop[p->shape->prop_count - 1];
         }
     }
     assert(p->shape->header.ref_count == 1);
@@ -9870,6 +10393,35 @@ int JS_DeletePropertyInt64(JSContext *ctx, JSValueConst obj, int64_t idx, int fl
     return res;
 }
 
+/* delete 'prop' of 'obj' even if it is not configurable. Used to reset
+   the global object of a context which is reused. Return TRUE if the
+   property was deleted, FALSE if it does not exist and -1 if exception */
+int JS_DeletePropertyForce(JSContext *ctx, JSValueConst obj, JSAtom prop)
+{
+    JSObject *p;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+
+    if (JS_VALUE_GET_TAG(obj) != JS_TAG_OBJECT)
+        return FALSE;
+    p = JS_VALUE_GET_OBJ(obj);
+    prs = find_own_property(&pr, p, prop);
+    if (!prs)
+        return FALSE;
+    if (!(prs->flags & JS_PROP_CONFIGURABLE)) {
+        if (js_update_property_flags(ctx, p, &prs,
+                                     prs->flags | JS_PROP_CONFIGURABLE))
+            return -1;
+    }
+    return delete_property(ctx, p, prop);
+}
+
+/* return the object holding the global let/const definitions */
+JSValue JS_GetGlobalVarObject(JSContext *ctx)
+{
+    return JS_DupValue(ctx, ctx->global_var_obj);
+}
+
 BOOL JS_IsFunction(JSContext *ctx, JSValueConst val)
 {
     JSObject *p;
@@ -15731,6 +16283,21 @@ static BOOL js_get_fast_array(JSContext *ctx, JSValueConst obj,
     return FALSE;
 }
 
+/* same as js_get_length64(), -1 with the exception pending */
+int JS_GetLength64(JSContext *ctx, int64_t *pres, JSValueConst obj)
+{
+    return js_get_length64(ctx, pres, obj);
+}
+
+/* if 'obj' is a fast array, return TRUE with its elements in '*arrpp'. The
+   elements are owned by the array and only valid until it is modified or
+   JS code runs. */
+BOOL JS_GetFastArray(JSContext *ctx, JSValueConst obj, JSValue **arrpp,
+                     uint32_t *countp)
+{
+    return js_get_fast_array(ctx, obj, arrpp, countp);
+}
+
 static __exception int js_append_enumerate(JSContext *ctx, JSValue *sp)
 {
     JSValue iterator, enumobj, method, value;
@@ -16372,6 +16939,108 @@ typedef enum {
 #define FUNC_RET_YIELD_STAR 2
 
 /* argv[] is modified if (flags & JS_CALL_FLAG_COPY_ARGV) = 0. */
+static inline JSInlineCacheSlot *js_ic_slot(JSInlineCache *ic, uint32_t pos)
+{
+    return &ic->slots[(pos * 0x9e3779b1) >> (32 - ic->hash_bits)];
+}
+
+/* return the property cached for the instruction at 'pos' if 'obj' has
+   one of the cached shapes, NULL otherwise. The property is a writable
+   own value property for OP_put_field, a value property for
+   OP_get_field and OP_get_field2. */
+static force_inline JSProperty *js_ic_find(JSFunctionBytecode *b,
+                                           uint32_t pos, JSValueConst obj)
+{
+    JSInlineCacheSlot *s;
+    JSInlineCacheEntry *e;
+    JSObject *p, *p1;
+    int i;
+
+    if (!b->ic || JS_VALUE_GET_TAG(obj) != JS_TAG_OBJECT)
+        return NULL;
+    s = js_ic_slot(b->ic, pos);
+    if (s->pos != pos + 1)
+        return NULL;
+    p = JS_VALUE_GET_OBJ(obj);
+    for(i = 0; i < JS_IC_WAYS; i++) {
+        e = &s->e[i];
+        if (e->shape == p->shape) {
+            if (!e->holder_shape)
+                return &p->prop[e->prop_idx];
+            /* exotic objects may have the property elsewhere */
+            p1 = p->shape->proto;
+            if (!p->is_exotic && p1->shape == e->holder_shape)
+                return &p1->prop[e->prop_idx];
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* lookup 'atom' in 'obj' like the instruction at 'pos' and cache the
+   result if it can be reused for objects of the same shape. Return the
+   property if it is the one the instruction accesses, NULL if the slow
+   path must be taken. */
+static no_inline JSProperty *js_ic_update(JSContext *ctx,
+                                          JSFunctionBytecode *b, uint32_t pos,
+                                          JSValueConst obj, JSAtom atom,
+                                          BOOL is_put)
+{
+    JSRuntime *rt = ctx->rt;
+    JSInlineCacheSlot *s;
+    JSShape *sh, *holder_sh;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    JSObject *p, *p1;
+    int i;
+
+    if (JS_VALUE_GET_TAG(obj) != JS_TAG_OBJECT)
+        return NULL;
+    p = JS_VALUE_GET_OBJ(obj);
+    sh = p->shape;
+    prs = find_own_property(&pr, p, atom);
+    if (prs) {
+        if (is_put) {
+            if ((prs->flags & (JS_PROP_TMASK | JS_PROP_WRITABLE |
+                               JS_PROP_LENGTH)) != JS_PROP_WRITABLE)
+                return NULL;
+        } else if ((prs->flags & JS_PROP_TMASK) != JS_PROP_NORMAL) {
+            return NULL;
+        }
+        holder_sh = NULL;
+    } else {
+        /* only the first prototype level is cached */
+        if (is_put || p->is_exotic)
+            return NULL;
+        p1 = sh->proto;
+        if (!p1)
+            return NULL;
+        prs = find_own_property(&pr, p1, atom);
+        if (!prs || (prs->flags & JS_PROP_TMASK) != JS_PROP_NORMAL)
+            return NULL;
+        holder_sh = p1->shape;
+    }
+
+    /* a non hashed shape is modified in place */
+    if (!sh->is_hashed || (holder_sh && !holder_sh->is_hashed))
+        return pr;
+    if (!b->ic && js_ic_new(rt, b))
+        return pr;
+    s = js_ic_slot(b->ic, pos);
+    if (s->pos != pos + 1) {
+        /* collision with another instruction */
+        for(i = 0; i < JS_IC_WAYS; i++)
+            js_inline_cache_free_entry(rt, &s->e[i]);
+        s->pos = pos + 1;
+    }
+    js_inline_cache_free_entry(rt, &s->e[JS_IC_WAYS - 1]);
+    memmove(&s->e[1], &s->e[0], sizeof(s->e[0]) * (JS_IC_WAYS - 1));
+    s->e[0].shape = js_dup_shape(sh);
+    s->e[0].holder_shape = holder_sh ? js_dup_shape(holder_sh) : NULL;
+    s->e[0].prop_idx = prs - get_shape_prop(holder_sh ? holder_sh : sh);
+    return pr;
+}
+
 static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                                JSValueConst this_obj, JSValueConst new_target,
                                int argc, JSValue *argv, int flags)
@@ -17711,12 +18380,22 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             {
                 JSValue val;
                 JSAtom atom;
+                JSProperty *pr;
+                uint32_t pos;
+                pos = pc - 1 - b->byte_code_buf;
                 atom = get_u32(pc);
                 pc += 4;
 
-                val = JS_GetProperty(ctx, sp[-1], atom);
-                if (unlikely(JS_IsException(val)))
-                    goto exception;
+                pr = js_ic_find(b, pos, sp[-1]);
+                if (unlikely(!pr))
+                    pr = js_ic_update(ctx, b, pos, sp[-1], atom, FALSE);
+                if (likely(pr)) {
+                    val = JS_DupValue(ctx, pr->u.value);
+                } else {
+                    val = JS_GetProperty(ctx, sp[-1], atom);
+                    if (unlikely(JS_IsException(val)))
+                        goto exception;
+                }
                 JS_FreeValue(ctx, sp[-1]);
                 sp[-1] = val;
             }
@@ -17726,12 +18405,22 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             {
                 JSValue val;
                 JSAtom atom;
+                JSProperty *pr;
+                uint32_t pos;
+                pos = pc - 1 - b->byte_code_buf;
                 atom = get_u32(pc);
                 pc += 4;
 
-                val = JS_GetProperty(ctx, sp[-1], atom);
-                if (unlikely(JS_IsException(val)))
-                    goto exception;
+                pr = js_ic_find(b, pos, sp[-1]);
+                if (unlikely(!pr))
+                    pr = js_ic_update(ctx, b, pos, sp[-1], atom, FALSE);
+                if (likely(pr)) {
+                    val = JS_DupValue(ctx, pr->u.value);
+                } else {
+                    val = JS_GetProperty(ctx, sp[-1], atom);
+                    if (unlikely(JS_IsException(val)))
+                        goto exception;
+                }
                 *sp++ = val;
             }
             BREAK;
@@ -17740,11 +18429,22 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             {
                 int ret;
                 JSAtom atom;
+                JSProperty *pr;
+                uint32_t pos;
+                pos = pc - 1 - b->byte_code_buf;
                 atom = get_u32(pc);
                 pc += 4;
 
-                ret = JS_SetPropertyInternal(ctx, sp[-2], atom, sp[-1],
-                                             JS_PROP_THROW_STRICT);
+                pr = js_ic_find(b, pos, sp[-2]);
+                if (unlikely(!pr))
+                    pr = js_ic_update(ctx, b, pos, sp[-2], atom, TRUE);
+                if (likely(pr)) {
+                    set_value(ctx, &pr->u.value, sp[-1]);
+                    ret = TRUE;
+                } else {
+                    ret = JS_SetPropertyInternal(ctx, sp[-2], atom, sp[-1],
+                                                 JS_PROP_THROW_STRICT);
+                }
                 JS_FreeValue(ctx, sp[-2]);
                 sp -= 2;
                 if (unlikely(ret < 0))
@@ -20277,6 +20977,10 @@ typedef struct JSParseState {
     BOOL is_module; /* parsing a module */
     BOOL allow_html_comments;
     BOOL ext_json; /* true if accepting JSON superset */
+    /* JSON fast path: properties of the objects being parsed */
+    struct JSONField *json_fields;
+    int json_field_count;
+    int json_field_size;
 } JSParseState;
 
 typedef struct JSOpCode {
@@ -28983,6 +29687,29 @@ static void free_bytecode_atoms(JSRuntime *rt,
     }
 }
 
+static int js_ic_new(JSRuntime *rt, JSFunctionBytecode *b)
+{
+    const JSOpCode *oi;
+    int pos, op, count, hash_bits;
+
+    /* two slots per field instruction to limit the collisions */
+    count = 0;
+    for(pos = 0; pos < b->byte_code_len; pos += oi->size) {
+        op = b->byte_code_buf[pos];
+        oi = &short_opcode_info(op);
+        if (op == OP_get_field || op == OP_get_field2 || op == OP_put_field)
+            count++;
+    }
+    hash_bits = 1;
+    while ((1 << hash_bits) < 2 * count && hash_bits < 16)
+        hash_bits++;
+    b->ic = js_mallocz_rt(rt, js_inline_cache_size(hash_bits));
+    if (!b->ic)
+        return -1;
+    b->ic->hash_bits = hash_bits;
+    return 0;
+}
+
 static void js_free_function_def(JSContext *ctx, JSFunctionDef *fd)
 {
     int i;
@@ -32882,6 +33609,8 @@ static void free_function_bytecode(JSRuntime *rt, JSFunctionBytecode *b)
     }
     if (b->realm)
         JS_FreeContext(b->realm);
+    if (b->ic)
+        js_inline_cache_free(rt, b->ic);
 
     JS_FreeAtomRT(rt, b->func_name);
     if (b->has_debug) {
@@ -33840,10 +34569,10 @@ static JSValue __JS_EvalInternal(JSContext *ctx, JSValueConst this_obj,
     fun_obj = js_create_function(ctx, fd);
     if (JS_IsException(fun_obj))
         goto fail1;
-    /* Could add a flag to avoid resolution if necessary */
     if (m) {
         m->func_obj = fun_obj;
-        if (js_resolve_module(ctx, m) < 0)
+        if (!(flags & JS_EVAL_FLAG_NO_RESOLVE) &&
+            js_resolve_module(ctx, m) < 0)
             goto fail1;
         fun_obj = JS_DupValue(ctx, JS_MKPTR(JS_TAG_MODULE, m));
     }
@@ -33923,6 +34652,33 @@ int JS_ResolveModule(JSContext *ctx, JSValueConst obj)
     return 0;
 }
 
+void JS_FreeUnresolvedModule(JSContext *ctx, JSValue obj)
+{
+    JSModuleDef *m;
+
+    if (JS_VALUE_GET_TAG(obj) != JS_TAG_MODULE) {
+        JS_FreeValue(ctx, obj);
+        return;
+    }
+    m = JS_VALUE_GET_PTR(obj);
+    assert(!m->resolved);
+    /* the reference of 'obj' is dropped with the module */
+    js_free_module_def(ctx, m);
+}
+
+JSModuleDef *JS_FindLoadedModule(JSContext *ctx, const char *name)
+{
+    JSModuleDef *m;
+    JSAtom atom;
+
+    atom = JS_NewAtom(ctx, name);
+    if (atom == JS_ATOM_NULL)
+        return NULL;
+    m = js_find_loaded_module(ctx, atom);
+    JS_FreeAtom(ctx, atom);
+    return m;
+}
+
 /*******************************************************************/
 /* object list */
 
@@ -39722,6 +40478,38 @@ static JSValue js_create_array(JSContext *ctx, int len, JSValueConst *tab)
     return obj;
 }
 
+/* create a fast array of 'len' elements, takes ownership of the values
+   of 'tab' even in case of exception */
+JSValue JS_NewArrayFrom(JSContext *ctx, uint32_t len, JSValue *tab)
+{
+    JSValue obj;
+    JSObject *p;
+    uint32_t i;
+
+    if (len > INT32_MAX) {
+        JS_ThrowRangeError(ctx, "invalid array length");
+        goto fail;
+    }
+    obj = JS_NewArray(ctx);
+    if (JS_IsException(obj))
+        goto fail;
+    if (len > 0) {
+        p = JS_VALUE_GET_OBJ(obj);
+        if (expand_fast_array(ctx, p, len)) {
+            JS_FreeValue(ctx, obj);
+            goto fail;
+        }
+        memcpy(p->u.array.u.values, tab, sizeof(JSValue) * len);
+        p->u.array.count = len;
+        p->prop[0].u.value = JS_NewInt32(ctx, len);
+    }
+    return obj;
+ fail:
+    for(i = 0; i < len; i++)
+        JS_FreeValue(ctx, tab[i]);
+    return JS_EXCEPTION;
+}
+
 static JSValue js_create_array_iterator(JSContext *ctx, JSValueConst this_val,
                                         int argc, JSValueConst *argv, int magic)
 {
@@ -43832,6 +44620,381 @@ static JSValue json_parse_value(JSParseState *s)
     return JS_EXCEPTION;
 }
 
+/* JSON fast path: strict JSON is parsed directly from the input bytes
+   instead of through json_next_token(). Strings are scanned for their
+   end 16 or 32 bytes at a time. On any input it does not handle,
+   including all errors, it gives up and the input is parsed again by
+   json_parse_value(), so that values and error messages are unchanged. */
+
+/* return the first '"', '\\', control character or, if 'ascii_only', non
+   ASCII character of [p, end) */
+static force_inline const uint8_t *json_scan(const uint8_t *p,
+                                             const uint8_t *end,
+                                             BOOL ascii_only)
+{
+#if defined(__AVX2__)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i space = _mm256_set1_epi8(0x20);
+        const __m256i ctrl_max = _mm256_set1_epi8(0x1f);
+        while (end - p >= 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)p);
+            __m256i ctrl;
+            if (ascii_only) {
+                /* signed compare: the non ASCII bytes are negative */
+                ctrl = _mm256_cmpgt_epi8(space, v);
+            } else {
+                ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl_max), v);
+            }
+            __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                                        _mm256_cmpeq_epi8(v, backslash)),
+                                        ctrl);
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+            if (mask)
+                return p + ctz32(mask);
+            p += 32;
+        }
+    }
+#endif
+#if defined(JSON_SCAN_SSE2)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i space = _mm_set1_epi8(0x20);
+        const __m128i ctrl_max = _mm_set1_epi8(0x1f);
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)p);
+            __m128i ctrl;
+            if (ascii_only)
+                ctrl = _mm_cmpgt_epi8(space, v);
+            else
+                ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl_max), v);
+            __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                                  _mm_cmpeq_epi8(v, backslash)),
+                                     ctrl);
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+            if (mask)
+                return p + ctz32(mask);
+            p += 16;
+        }
+    }
+#elif defined(JSON_SCAN_NEON)
+    {
+        const uint8x16_t quote = vdupq_n_u8('"');
+        const uint8x16_t backslash = vdupq_n_u8('\\');
+        const uint8x16_t space = vdupq_n_u8(0x20);
+        const uint8x16_t printable = vdupq_n_u8(0x60);
+        while (end - p >= 16) {
+            uint8x16_t v = vld1q_u8(p);
+            uint8x16_t ctrl;
+            if (ascii_only) {
+                /* c < 0x20 || c >= 0x80 <=> (uint8_t)(c - 0x20) >= 0x60 */
+                ctrl = vcgeq_u8(vsubq_u8(v, space), printable);
+            } else {
+                ctrl = vcltq_u8(v, space);
+            }
+            uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+                                    ctrl);
+            /* 4 bits per byte */
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+            if (mask)
+                return p + (ctz64(mask) >> 2);
+            p += 16;
+        }
+    }
+#endif
+    while (p < end && *p >= 0x20 && !(ascii_only && *p >= 0x80) &&
+           *p != '"' && *p != '\\')
+        p++;
+    return p;
+}
+
+static const uint8_t *json_fast_skip_ws(const uint8_t *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    return p;
+}
+
+/* 'p' points after the opening quote. Return JS_EXCEPTION to give up. */
+static JSValue json_fast_parse_string(JSParseState *s, const uint8_t *p,
+                                      const uint8_t **pp)
+{
+    const uint8_t *end;
+    JSToken token;
+
+    end = json_scan(p, s->buf_end, TRUE);
+    if (end < s->buf_end && *end == '"') {
+        *pp = end + 1;
+        return js_new_string8(s->ctx, p, end - p);
+    }
+    /* escapes and non ASCII characters */
+    if (js_parse_string(s, '"', FALSE, p, &token, pp))
+        return JS_EXCEPTION;
+    return token.u.str.str;
+}
+
+static JSAtom json_fast_parse_key(JSParseState *s, const uint8_t *p,
+                                  const uint8_t **pp)
+{
+    const uint8_t *end;
+    JSValue str;
+    JSAtom atom;
+
+    end = json_scan(p, s->buf_end, TRUE);
+    if (end < s->buf_end && *end == '"') {
+        *pp = end + 1;
+        return JS_NewAtomLen(s->ctx, (const char *)p, end - p);
+    }
+    str = json_fast_parse_string(s, p, pp);
+    if (JS_IsException(str))
+        return JS_ATOM_NULL;
+    atom = JS_ValueToAtom(s->ctx, str);
+    JS_FreeValue(s->ctx, str);
+    return atom;
+}
+
+static JSValue json_fast_parse_number(JSParseState *s, const uint8_t *p,
+                                      const uint8_t **pp)
+{
+    const uint8_t *q, *d;
+    uint32_t v;
+
+    q = p;
+    if (*q == '-')
+        q++;
+    if (!is_digit(*q) || (*q == '0' && is_digit(q[1])))
+        return JS_EXCEPTION;
+    /* integers of up to 9 digits, the common case */
+    v = 0;
+    for (d = q; is_digit(*d) && d - q < 9; d++)
+        v = v * 10 + (*d - '0');
+    if (!is_digit(*d) && *d != '.' && *d != 'e' && *d != 'E' &&
+        !(p != q && v == 0)) {
+        *pp = d;
+        return JS_NewInt32(s->ctx, p != q ? -(int32_t)v : (int32_t)v);
+    }
+    return js_atof(s->ctx, (const char *)p, (const char **)pp, 10, 0);
+}
+
+typedef struct JSONField {
+    JSAtom atom;
+    JSValue val;
+} JSONField;
+
+/* free the fields parsed from 'base' */
+static void json_free_fields(JSParseState *s, int base)
+{
+    int i;
+
+    for(i = base; i < s->json_field_count; i++) {
+        JS_FreeAtom(s->ctx, s->json_fields[i].atom);
+        JS_FreeValue(s->ctx, s->json_fields[i].val);
+    }
+    s->json_field_count = base;
+}
+
+/* create the object of the fields parsed from 'base'. When objects with
+   the same keys were built before, the shape transitions of the keys are
+   cached and the object is allocated with its final shape at once. */
+static JSValue json_new_object(JSParseState *s, int base)
+{
+    JSContext *ctx = s->ctx;
+    JSRuntime *rt = ctx->rt;
+    JSONField *fields;
+    JSShape *sh;
+    JSObject *p;
+    JSValue obj;
+    int count, i, ret;
+
+    fields = s->json_fields + base;
+    count = s->json_field_count - base;
+    s->json_field_count = base;
+    sh = find_hashed_shape_proto(rt, JS_VALUE_GET_OBJ(ctx->class_proto[JS_CLASS_OBJECT]));
+    for(i = 0; i < count && sh; i++)
+        sh = js_shape_transition_find(rt, sh, fields[i].atom, JS_PROP_C_W_E);
+    i = 0;
+    if (sh) {
+        obj = JS_NewObjectFromShape(ctx, js_dup_shape(sh), JS_CLASS_OBJECT);
+        if (JS_IsException(obj))
+            goto fail;
+        p = JS_VALUE_GET_OBJ(obj);
+        for(i = 0; i < count; i++) {
+            p->prop[i].u.value = fields[i].val;
+            JS_FreeAtom(ctx, fields[i].atom);
+        }
+        return obj;
+    }
+    /* the transitions are cached by add_property() for the next objects */
+    obj = JS_NewObject(ctx);
+    if (JS_IsException(obj))
+        goto fail;
+    while (i < count) {
+        ret = JS_DefinePropertyValue(ctx, obj, fields[i].atom, fields[i].val,
+                                     JS_PROP_C_W_E);
+        JS_FreeAtom(ctx, fields[i].atom);
+        i++;
+        if (ret < 0) {
+            JS_FreeValue(ctx, obj);
+            goto fail;
+        }
+    }
+    return obj;
+ fail:
+    for(; i < count; i++) {
+        JS_FreeAtom(ctx, fields[i].atom);
+        JS_FreeValue(ctx, fields[i].val);
+    }
+    return JS_EXCEPTION;
+}
+
+static BOOL json_fast_match(const uint8_t *p, const char *ident, int len)
+{
+    return !strncmp((const char *)p, ident, len) &&
+        !(p[len] < 128 && lre_js_is_ident_next(p[len]));
+}
+
+static JSValue json_fast_parse_value(JSParseState *s, const uint8_t **pp)
+{
+    JSContext *ctx = s->ctx;
+    const uint8_t *p;
+    JSValue val;
+    int ret;
+
+    /* json_parse_value() reports it */
+    if (js_check_stack_overflow(ctx->rt, 0))
+        return JS_EXCEPTION;
+    p = json_fast_skip_ws(*pp);
+    switch(*p) {
+    case '{':
+        {
+            /* the object is created once its fields are parsed */
+            int base = s->json_field_count;
+
+            p = json_fast_skip_ws(p + 1);
+            while (*p != '}') {
+                JSAtom prop_name;
+                JSValue prop_val;
+                JSONField *f;
+
+                if (*p != '"')
+                    goto fail_fields;
+                prop_name = json_fast_parse_key(s, p + 1, &p);
+                if (prop_name == JS_ATOM_NULL)
+                    goto fail_fields;
+                p = json_fast_skip_ws(p);
+                if (*p != ':') {
+                    JS_FreeAtom(ctx, prop_name);
+                    goto fail_fields;
+                }
+                p++;
+                prop_val = json_fast_parse_value(s, &p);
+                if (JS_IsException(prop_val)) {
+                    JS_FreeAtom(ctx, prop_name);
+                    goto fail_fields;
+                }
+                if (js_resize_array(ctx, (void **)&s->json_fields,
+                                    sizeof(s->json_fields[0]),
+                                    &s->json_field_size,
+                                    s->json_field_count + 1)) {
+                    JS_FreeAtom(ctx, prop_name);
+                    JS_FreeValue(ctx, prop_val);
+                    goto fail_fields;
+                }
+                f = &s->json_fields[s->json_field_count++];
+                f->atom = prop_name;
+                f->val = prop_val;
+                p = json_fast_skip_ws(p);
+                if (*p != ',') {
+                    if (*p != '}')
+                        goto fail_fields;
+                    break;
+                }
+                p = json_fast_skip_ws(p + 1);
+                if (*p == '}')
+                    goto fail_fields;
+            }
+            p++;
+            val = json_new_object(s, base);
+            if (JS_IsException(val))
+                return val;
+            break;
+        fail_fields:
+            json_free_fields(s, base);
+            return JS_EXCEPTION;
+        }
+    case '[':
+        {
+            JSValue el;
+            uint32_t idx;
+
+            val = JS_NewArray(ctx);
+            if (JS_IsException(val))
+                return val;
+            p = json_fast_skip_ws(p + 1);
+            if (*p == ']') {
+                p++;
+                break;
+            }
+            for(idx = 0;; idx++) {
+                el = json_fast_parse_value(s, &p);
+                if (JS_IsException(el))
+                    goto fail;
+                ret = JS_DefinePropertyValueUint32(ctx, val, idx, el,
+                                                   JS_PROP_C_W_E);
+                if (ret < 0)
+                    goto fail;
+                p = json_fast_skip_ws(p);
+                if (*p != ',')
+                    break;
+                p++;
+            }
+            if (*p != ']')
+                goto fail;
+            p++;
+        }
+        break;
+    case '"':
+        val = json_fast_parse_string(s, p + 1, &p);
+        if (JS_IsException(val))
+            return val;
+        break;
+    case 't':
+        if (!json_fast_match(p, "true", 4))
+            return JS_EXCEPTION;
+        val = JS_TRUE;
+        p += 4;
+        break;
+    case 'f':
+        if (!json_fast_match(p, "false", 5))
+            return JS_EXCEPTION;
+        val = JS_FALSE;
+        p += 5;
+        break;
+    case 'n':
+        if (!json_fast_match(p, "null", 4))
+            return JS_EXCEPTION;
+        val = JS_NULL;
+        p += 4;
+        break;
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        val = json_fast_parse_number(s, p, &p);
+        if (JS_IsException(val))
+            return val;
+        break;
+    default:
+        return JS_EXCEPTION;
+    }
+    *pp = p;
+    return val;
+ fail:
+    JS_FreeValue(ctx, val);
+    return JS_EXCEPTION;
+}
+
 JSValue JS_ParseJSON2(JSContext *ctx, const char *buf, size_t buf_len,
                       const char *filename, int flags)
 {
@@ -43840,6 +45003,21 @@ JSValue JS_ParseJSON2(JSContext *ctx, const char *buf, size_t buf_len,
 
     js_parse_init(ctx, s, buf, buf_len, filename);
     s->ext_json = ((flags & JS_PARSE_JSON_EXT) != 0);
+    if (!s->ext_json) {
+        const uint8_t *p = s->buf_ptr;
+        val = json_fast_parse_value(s, &p);
+        js_free(ctx, s->json_fields);
+        if (!JS_IsException(val)) {
+            if (json_fast_skip_ws(p) == s->buf_end)
+                return val;
+            JS_FreeValue(ctx, val);
+        }
+        /* parse again, an exception raised by the fast path is raised
+           again if the input is valid */
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        js_parse_init(ctx, s, buf, buf_len, filename);
+        val = JS_UNDEFINED;
+    }
     if (json_next_token(s))
         goto fail;
     val = json_parse_value(s);
@@ -43965,6 +45143,24 @@ static JSValue js_json_parse(JSContext *ctx, JSValueConst this_val,
     return obj;
 }
 
+typedef struct JSONShapeKey {
+    JSAtom atom;
+    uint32_t prop_idx;
+    JSValue quoted;
+} JSONShapeKey;
+
+/* keys of the objects of a shape in enumeration order, quoted once for
+   all the objects sharing the shape */
+typedef struct JSONShapeKeys {
+    struct JSONShapeKeys *next;
+    JSShape *sh;
+    int count; /* -1 if the keys cannot be read from the shape */
+    JSONShapeKey keys[0];
+} JSONShapeKeys;
+
+#define JSON_SHAPE_HASH_SIZE 64
+#define JSON_SHAPE_MAX_COUNT 256
+
 typedef struct JSONStringifyContext {
     JSValueConst replacer_func;
     JSValue stack;
@@ -43972,12 +45168,191 @@ typedef struct JSONStringifyContext {
     JSValue gap;
     JSValue empty;
     StringBuffer *b;
+    JSONShapeKeys *shape_hash[JSON_SHAPE_HASH_SIZE];
+    int shape_count;
 } JSONStringifyContext;
 
-static JSValue JS_ToQuotedStringFree(JSContext *ctx, JSValue val) {
-    JSValue r = JS_ToQuotedString(ctx, val);
-    JS_FreeValue(ctx, val);
-    return r;
+/* append the JSON quoted form of 'p' to 'b' */
+static int json_quote_string(StringBuffer *b, JSString *p)
+{
+    char buf[16];
+    uint32_t c;
+    int i, j;
+
+    if (string_buffer_putc8(b, '\"'))
+        return -1;
+    for(i = 0; i < p->len; ) {
+        /* copy the characters which need no escape at once */
+        if (!p->is_wide_char) {
+            j = json_scan(p->u.str8 + i, p->u.str8 + p->len, FALSE) - p->u.str8;
+            if (string_buffer_write8(b, p->u.str8 + i, j - i))
+                return -1;
+        } else {
+            for(j = i; j < p->len; j++) {
+                c = p->u.str16[j];
+                if (c < 32 || c == '\"' || c == '\\' ||
+                    (c >= 0xd800 && c < 0xe000))
+                    break;
+            }
+            if (string_buffer_write16(b, p->u.str16 + i, j - i))
+                return -1;
+        }
+        i = j;
+        if (i >= p->len)
+            break;
+        c = string_getc(p, &i);
+        switch(c) {
+        case '\t':
+            c = 't';
+            goto quote;
+        case '\r':
+            c = 'r';
+            goto quote;
+        case '\n':
+            c = 'n';
+            goto quote;
+        case '\b':
+            c = 'b';
+            goto quote;
+        case '\f':
+            c = 'f';
+            goto quote;
+        case '\"':
+        case '\\':
+        quote:
+            if (string_buffer_putc8(b, '\\'))
+                return -1;
+            if (string_buffer_putc8(b, c))
+                return -1;
+            break;
+        default:
+            if (c < 32 || (c >= 0xd800 && c < 0xe000)) {
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                if (string_buffer_puts8(b, buf))
+                    return -1;
+            } else {
+                if (string_buffer_putc(b, c))
+                    return -1;
+            }
+            break;
+        }
+    }
+    return string_buffer_putc8(b, '\"');
+}
+
+static int json_put_int32(StringBuffer *b, int32_t v)
+{
+    char buf[16], *q;
+    uint32_t n;
+
+    q = buf + sizeof(buf);
+    n = v < 0 ? -(uint32_t)v : (uint32_t)v;
+    do {
+        *--q = '0' + n % 10;
+        n /= 10;
+    } while (n != 0);
+    if (v < 0)
+        *--q = '-';
+    return string_buffer_write8(b, (const uint8_t *)q, buf + sizeof(buf) - q);
+}
+
+/* the key of a value is only used by toJSON() and the replacer */
+static BOOL json_needs_key(JSContext *ctx, JSONStringifyContext *jsc,
+                           JSValueConst val)
+{
+    return !JS_IsUndefined(jsc->replacer_func) || JS_IsObject(val)
+#ifdef CONFIG_BIGNUM
+        || JS_IsBigInt(ctx, val)
+#endif
+        ;
+}
+
+/* set '*psk' to the keys of the objects of 'sh', NULL if they must be
+   enumerated by js_object_keys() */
+static int json_get_shape_keys(JSContext *ctx, JSONStringifyContext *jsc,
+                               JSShape *sh, JSONShapeKeys **psk)
+{
+    JSONShapeKeys *sk;
+    JSShapeProperty *prs;
+    StringBuffer b_s, *b = &b_s;
+    uint32_t h, idx;
+    int i, n;
+
+    *psk = NULL;
+    /* unhashed shapes are modified in place by their object */
+    if (!sh->is_hashed)
+        return 0;
+    h = ((uintptr_t)sh >> 4) & (JSON_SHAPE_HASH_SIZE - 1);
+    for(sk = jsc->shape_hash[h]; sk != NULL; sk = sk->next) {
+        if (sk->sh == sh) {
+            if (sk->count >= 0)
+                *psk = sk;
+            return 0;
+        }
+    }
+    if (jsc->shape_count >= JSON_SHAPE_MAX_COUNT)
+        return 0;
+    n = 0;
+    for(i = 0, prs = get_shape_prop(sh); i < sh->prop_count; i++, prs++) {
+        if (prs->atom == JS_ATOM_NULL || !(prs->flags & JS_PROP_ENUMERABLE) ||
+            !JS_AtomIsString(ctx, prs->atom))
+            continue;
+        /* array indexes are enumerated first and getters may modify the
+           object */
+        if ((prs->flags & JS_PROP_TMASK) != JS_PROP_NORMAL ||
+            JS_AtomIsArrayIndex(ctx, &idx, prs->atom)) {
+            n = -1;
+            break;
+        }
+        n++;
+    }
+    sk = js_malloc(ctx, sizeof(*sk) + sizeof(sk->keys[0]) * max_int(n, 0));
+    if (!sk)
+        return -1;
+    /* a hashed shape cannot change while it is referenced here, the
+       objects using it get a new shape when modified */
+    sk->sh = js_dup_shape(sh);
+    sk->count = 0;
+    sk->next = jsc->shape_hash[h];
+    jsc->shape_hash[h] = sk;
+    jsc->shape_count++;
+    if (n < 0) {
+        sk->count = -1;
+        return 0;
+    }
+    for(i = 0, prs = get_shape_prop(sh); i < sh->prop_count; i++, prs++) {
+        JSONShapeKey *k;
+        if (prs->atom == JS_ATOM_NULL || !(prs->flags & JS_PROP_ENUMERABLE) ||
+            !JS_AtomIsString(ctx, prs->atom))
+            continue;
+        string_buffer_init(ctx, b, 16);
+        json_quote_string(b, ctx->rt->atom_array[prs->atom]);
+        k = &sk->keys[sk->count];
+        k->atom = prs->atom;
+        k->prop_idx = i;
+        k->quoted = string_buffer_end(b);
+        if (JS_IsException(k->quoted))
+            return -1;
+        sk->count++;
+    }
+    *psk = sk;
+    return 0;
+}
+
+static void json_free_shape_keys(JSContext *ctx, JSONStringifyContext *jsc)
+{
+    JSONShapeKeys *sk, *sk_next;
+    int h, i;
+
+    for(h = 0; h < JSON_SHAPE_HASH_SIZE; h++) {
+        for(sk = jsc->shape_hash[h]; sk != NULL; sk = sk_next) {
+            sk_next = sk->next;
+            for(i = 0; i < sk->count; i++)
+                JS_FreeValue(ctx, sk->keys[i].quoted);
+            js_free_shape(ctx->rt, sk->sh);
+            js_free(ctx, sk);
+        }
+    }
 }
 
 static JSValue js_json_check(JSContext *ctx, JSONStringifyContext *jsc,
@@ -44067,10 +45442,7 @@ static int js_json_to_str(JSContext *ctx, JSONStringifyContext *jsc,
             val = JS_ToStringFree(ctx, val);
             if (JS_IsException(val))
                 goto exception;
-            val = JS_ToQuotedStringFree(ctx, val);
-            if (JS_IsException(val))
-                goto exception;
-            return string_buffer_concat_value_free(jsc->b, val);
+            goto quote_string;
         } else if (cl == JS_CLASS_NUMBER) {
             val = JS_ToNumberFree(ctx, val);
             if (JS_IsException(val))
@@ -44096,7 +45468,10 @@ static int js_json_to_str(JSContext *ctx, JSONStringifyContext *jsc,
             JS_ThrowTypeError(ctx, "circular reference");
             goto exception;
         }
-        indent1 = JS_ConcatString(ctx, JS_DupValue(ctx, indent), JS_DupValue(ctx, jsc->gap));
+        if (JS_IsEmptyString(jsc->gap))
+            indent1 = JS_DupValue(ctx, indent);
+        else
+            indent1 = JS_ConcatString(ctx, JS_DupValue(ctx, indent), JS_DupValue(ctx, jsc->gap));
         if (JS_IsException(indent1))
             goto exception;
         if (!JS_IsEmptyString(jsc->gap)) {
@@ -44127,10 +45502,15 @@ static int js_json_to_str(JSContext *ctx, JSONStringifyContext *jsc,
                 v = JS_GetPropertyInt64(ctx, val, i);
                 if (JS_IsException(v))
                     goto exception;
-                /* XXX: could do this string conversion only when needed */
-                prop = JS_ToStringFree(ctx, JS_NewInt64(ctx, i));
-                if (JS_IsException(prop))
-                    goto exception;
+                if (json_needs_key(ctx, jsc, v)) {
+                    prop = JS_ToStringFree(ctx, JS_NewInt64(ctx, i));
+                    if (JS_IsException(prop)) {
+                        JS_FreeValue(ctx, v);
+                        goto exception;
+                    }
+                } else {
+                    prop = JS_DupValue(ctx, jsc->empty);
+                }
                 v = js_json_check(ctx, jsc, val, v, prop);
                 JS_FreeValue(ctx, prop);
                 prop = JS_UNDEFINED;
@@ -44147,6 +45527,52 @@ static int js_json_to_str(JSContext *ctx, JSONStringifyContext *jsc,
             }
             string_buffer_putc8(jsc->b, ']');
         } else {
+            JSONShapeKeys *sk = NULL;
+            if (JS_IsUndefined(jsc->property_list) && cl == JS_CLASS_OBJECT) {
+                if (json_get_shape_keys(ctx, jsc, p->shape, &sk))
+                    goto exception;
+            }
+            if (sk) {
+                string_buffer_putc8(jsc->b, '{');
+                has_content = FALSE;
+                for(i = 0; i < sk->count; i++) {
+                    JSONShapeKey *k = &sk->keys[i];
+                    /* toJSON() or the replacer may have modified the object */
+                    if (p->shape == sk->sh) {
+                        v = JS_DupValue(ctx, p->prop[k->prop_idx].u.value);
+                    } else {
+                        v = JS_GetProperty(ctx, val, k->atom);
+                        if (JS_IsException(v))
+                            goto exception;
+                    }
+                    if (json_needs_key(ctx, jsc, v)) {
+                        prop = JS_AtomToString(ctx, k->atom);
+                        if (JS_IsException(prop)) {
+                            JS_FreeValue(ctx, v);
+                            goto exception;
+                        }
+                    } else {
+                        prop = JS_DupValue(ctx, jsc->empty);
+                    }
+                    v = js_json_check(ctx, jsc, val, v, prop);
+                    JS_FreeValue(ctx, prop);
+                    prop = JS_UNDEFINED;
+                    if (JS_IsException(v))
+                        goto exception;
+                    if (!JS_IsUndefined(v)) {
+                        if (has_content)
+                            string_buffer_putc8(jsc->b, ',');
+                        string_buffer_concat_value(jsc->b, sep);
+                        string_buffer_concat_value(jsc->b, k->quoted);
+                        string_buffer_putc8(jsc->b, ':');
+                        string_buffer_concat_value(jsc->b, sep1);
+                        if (js_json_to_str(ctx, jsc, val, v, indent1))
+                            goto exception;
+                        has_content = TRUE;
+                    }
+                }
+                goto end_object;
+            }
             if (!JS_IsUndefined(jsc->property_list))
                 tab = JS_DupValue(ctx, jsc->property_list);
             else
@@ -44171,13 +45597,11 @@ static int js_json_to_str(JSContext *ctx, JSONStringifyContext *jsc,
                 if (!JS_IsUndefined(v)) {
                     if (has_content)
                         string_buffer_putc8(jsc->b, ',');
-                    prop = JS_ToQuotedStringFree(ctx, prop);
-                    if (JS_IsException(prop)) {
+                    string_buffer_concat_value(jsc->b, sep);
+                    if (json_quote_string(jsc->b, JS_VALUE_GET_STRING(prop))) {
                         JS_FreeValue(ctx, v);
                         goto exception;
                     }
-                    string_buffer_concat_value(jsc->b, sep);
-                    string_buffer_concat_value(jsc->b, prop);
                     string_buffer_putc8(jsc->b, ':');
                     string_buffer_concat_value(jsc->b, sep1);
                     if (js_json_to_str(ctx, jsc, val, v, indent1))
@@ -44185,6 +45609,7 @@ static int js_json_to_str(JSContext *ctx, JSONStringifyContext *jsc,
                     has_content = TRUE;
                 }
             }
+        end_object:
             if (has_content && JS_VALUE_GET_STRING(jsc->gap)->len != 0) {
                 string_buffer_putc8(jsc->b, '\n');
                 string_buffer_concat_value(jsc->b, indent);
@@ -44201,16 +45626,17 @@ static int js_json_to_str(JSContext *ctx, JSONStringifyContext *jsc,
         JS_FreeValue(ctx, prop);
         return 0;
     case JS_TAG_STRING:
-        val = JS_ToQuotedStringFree(ctx, val);
-        if (JS_IsException(val))
-            goto exception;
-        goto concat_value;
+    quote_string:
+        ret = json_quote_string(jsc->b, JS_VALUE_GET_STRING(val));
+        JS_FreeValue(ctx, val);
+        return ret;
+    case JS_TAG_INT:
+        return json_put_int32(jsc->b, JS_VALUE_GET_INT(val));
     case JS_TAG_FLOAT64:
         if (!isfinite(JS_VALUE_GET_FLOAT64(val))) {
             val = JS_NULL;
         }
         goto concat_value;
-    case JS_TAG_INT:
 #ifdef CONFIG_BIGNUM
     case JS_TAG_BIG_FLOAT:
 #endif
@@ -44253,6 +45679,8 @@ JSValue JS_JSONStringify(JSContext *ctx, JSValueConst obj,
     jsc->gap = JS_UNDEFINED;
     jsc->b = &b_s;
     jsc->empty = JS_AtomToString(ctx, JS_ATOM_empty_string);
+    memset(jsc->shape_hash, 0, sizeof(jsc->shape_hash));
+    jsc->shape_count = 0;
     ret = JS_UNDEFINED;
     wrapper = JS_UNDEFINED;
 
@@ -44369,6 +45797,7 @@ done:
     JS_FreeValue(ctx, jsc->gap);
     JS_FreeValue(ctx, jsc->property_list);
     JS_FreeValue(ctx, jsc->stack);
+    json_free_shape_keys(ctx, jsc);
     return ret;
 }
 
@@ -51305,6 +52734,17 @@ static JSValue js_array_buffer_constructor3(JSContext *ctx,
             if (!abuf->data)
                 goto fail;
             memset(abuf->data, 0, len);
+        } else if (rt->ab_funcs.ab_alloc &&
+                   free_func == js_array_buffer_free) {
+            abuf->data = rt->ab_funcs.ab_alloc(rt->ab_funcs.ab_opaque,
+                                               max_int(len, 1));
+            if (!abuf->data) {
+                JS_ThrowOutOfMemory(ctx);
+                goto fail;
+            }
+            memset(abuf->data, 0, len);
+            free_func = rt->ab_funcs.ab_free;
+            opaque = rt->ab_funcs.ab_opaque;
         } else {
             /* the allocation must be done after the object creation */
             abuf->data = js_mallocz(ctx, max_int(len, 1));
@@ -51514,6 +52954,22 @@ uint8_t *JS_GetArrayBuffer(JSContext *ctx, size_t *psize, JSValueConst obj)
     return NULL;
 }
 
+/* same as JS_GetArrayBuffer, also return the function and opaque which
+   free the data */
+uint8_t *JS_GetArrayBufferInfo(JSContext *ctx, size_t *psize,
+                               JSFreeArrayBufferDataFunc **pfree_func,
+                               void **popaque, JSValueConst obj)
+{
+    JSArrayBuffer *abuf;
+    uint8_t *data = JS_GetArrayBuffer(ctx, psize, obj);
+    if (!data)
+        return NULL;
+    abuf = js_get_array_buffer(ctx, obj);
+    *pfree_func = abuf->free_func;
+    *popaque = abuf->opaque;
+    return data;
+}
+
 static JSValue js_array_buffer_slice(JSContext *ctx,
                                      JSValueConst this_val,
                                      int argc, JSValueConst *argv, int class_id)
@@ -51739,6 +53195,27 @@ JSValue JS_GetTypedArrayBuffer(JSContext *ctx, JSValueConst obj,
     }
     return JS_DupValue(ctx, JS_MKPTR(JS_TAG_OBJECT, ta->buffer));
 }
+
+JSValue JS_NewTypedArrayOfClass(JSContext *ctx, JSClassID class_id,
+                                JSValueConst buffer, uint64_t byte_offset,
+                                uint64_t length)
+{
+    JSValue args[3];
+    JSValue obj;
+
+    if (!(class_id >= JS_CLASS_UINT8C_ARRAY &&
+          class_id <= JS_CLASS_FLOAT64_ARRAY))
+        return JS_ThrowTypeError(ctx, "not a typed array class");
+    args[0] = buffer;
+    args[1] = JS_NewInt64(ctx, byte_offset);
+    args[2] = JS_NewInt64(ctx, length);
+    /* no new_target: the prototype is the one of the class */
+    obj = js_typed_array_constructor(ctx, JS_UNDEFINED, 3,
+                                     (JSValueConst *)args, class_id);
+    JS_FreeValue(ctx, args[1]);
+    JS_FreeValue(ctx, args[2]);
+    return obj;
+}
                                
 static JSValue js_typed_array_get_toStringTag(JSContext *ctx,
                                               JSValueConst this_val)
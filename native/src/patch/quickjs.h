@@ -335,6 +335,10 @@ static inline JS_BOOL JS_VALUE_IS_NAN(JSValue v)
 #define JS_EVAL_FLAG_COMPILE_ONLY (1 << 5)
 /* don't include the stack frames before this eval in the Error() backtraces */
 #define JS_EVAL_FLAG_BACKTRACE_BARRIER (1 << 6)
+/* with JS_EVAL_FLAG_COMPILE_ONLY: do not load the imports of a
+   module. They are loaded by JS_ResolveModule() or when the module is
+   imported. */
+#define JS_EVAL_FLAG_NO_RESOLVE (1 << 7)
 
 typedef JSValue JSCFunction(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
 typedef JSValue JSCFunctionMagic(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic);
@@ -356,11 +360,42 @@ typedef struct JSMallocFunctions {
 
 typedef struct JSGCObjectHeader JSGCObjectHeader;
 
+typedef enum JSGCModeEnum {
+    /* each collection scans all the GC objects */
+    JS_GC_MODE_FULL,
+    /* collections triggered by allocations only scan the objects
+       allocated since the previous one. The whole heap is scanned
+       once the GC threshold is reached. */
+    JS_GC_MODE_GENERATIONAL,
+} JSGCModeEnum;
+
+/* times in microseconds */
+typedef struct JSGCStats {
+    int64_t minor_count;
+    int64_t minor_time_us;
+    int64_t full_count;
+    int64_t full_time_us;
+    int64_t max_pause_us;
+    int64_t last_pause_us;
+    /* decrease of the malloc size over the collections */
+    int64_t freed_bytes;
+    int64_t last_freed_bytes;
+} JSGCStats;
+
 JSRuntime *JS_NewRuntime(void);
 /* info lifetime must exceed that of rt */
 void JS_SetRuntimeInfo(JSRuntime *rt, const char *info);
 void JS_SetMemoryLimit(JSRuntime *rt, size_t limit);
+/* count 'size' bytes allocated outside of the runtime allocator in its
+   memory usage. Returns -1 and counts nothing when the memory limit would
+   be exceeded. */
+int JS_AddExternalMemory(JSRuntime *rt, size_t size);
+void JS_RemoveExternalMemory(JSRuntime *rt, size_t size);
 void JS_SetGCThreshold(JSRuntime *rt, size_t gc_threshold);
+void JS_SetGCThresholdGrowth(JSRuntime *rt, uint32_t percent);
+void JS_SetGCMode(JSRuntime *rt, JSGCModeEnum mode);
+void JS_SetGCYoungThreshold(JSRuntime *rt, uint32_t count);
+void JS_GetGCStats(JSRuntime *rt, JSGCStats *s);
 /* use 0 to disable maximum stack size check */
 void JS_SetMaxStackSize(JSRuntime *rt, size_t stack_size);
 /* should be called when changing thread to update the stack top value
@@ -373,6 +408,8 @@ void JS_SetRuntimeOpaque(JSRuntime *rt, void *opaque);
 typedef void JS_MarkFunc(JSRuntime *rt, JSGCObjectHeader *gp);
 void JS_MarkValue(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func);
 void JS_RunGC(JSRuntime *rt);
+void JS_RunMinorGC(JSRuntime *rt);
+JS_BOOL JS_RunIdleGC(JSRuntime *rt);
 JS_BOOL JS_IsLiveObject(JSRuntime *rt, JSValueConst obj);
 
 JSContext *JS_NewContext(JSRuntime *rt);
@@ -722,6 +759,9 @@ int JS_ToBigInt64(JSContext *ctx, int64_t *pres, JSValueConst val);
 int JS_ToInt64Ext(JSContext *ctx, int64_t *pres, JSValueConst val);
 
 JSValue JS_NewStringLen(JSContext *ctx, const char *str1, size_t len1);
+JSValue JS_NewStringLatin1(JSContext *ctx, const uint8_t *buf, size_t len);
+JSValue JS_NewStringUTF16(JSContext *ctx, const uint16_t *buf, size_t len);
+const void *JS_GetStringBuffer(JSValueConst val, size_t *plen, JS_BOOL *pwide);
 JSValue JS_NewString(JSContext *ctx, const char *str);
 JSValue JS_NewAtomString(JSContext *ctx, const char *str);
 JSValue JS_ToString(JSContext *ctx, JSValueConst val);
@@ -747,7 +787,11 @@ JS_BOOL JS_IsConstructor(JSContext* ctx, JSValueConst val);
 JS_BOOL JS_SetConstructorBit(JSContext *ctx, JSValueConst func_obj, JS_BOOL val);
 
 JSValue JS_NewArray(JSContext *ctx);
+JSValue JS_NewArrayFrom(JSContext *ctx, uint32_t len, JSValue *tab);
 int JS_IsArray(JSContext *ctx, JSValueConst val);
+int JS_GetLength64(JSContext *ctx, int64_t *pres, JSValueConst obj);
+JS_BOOL JS_GetFastArray(JSContext *ctx, JSValueConst obj, JSValue **arrpp,
+                        uint32_t *countp);
 
 JSValue JS_GetPropertyInternal(JSContext *ctx, JSValueConst obj,
                                JSAtom prop, JSValueConst receiver,
@@ -780,6 +824,8 @@ int JS_HasProperty(JSContext *ctx, JSValueConst this_obj, JSAtom prop);
 int JS_IsExtensible(JSContext *ctx, JSValueConst obj);
 int JS_PreventExtensions(JSContext *ctx, JSValueConst obj);
 int JS_DeleteProperty(JSContext *ctx, JSValueConst obj, JSAtom prop, int flags);
+int JS_DeletePropertyForce(JSContext *ctx, JSValueConst obj, JSAtom prop);
+JSValue JS_GetGlobalVarObject(JSContext *ctx);
 int JS_SetPrototype(JSContext *ctx, JSValueConst obj, JSValueConst proto_val);
 JSValue JS_GetPrototype(JSContext *ctx, JSValueConst val);
 
@@ -848,10 +894,18 @@ JSValue JS_NewArrayBuffer(JSContext *ctx, uint8_t *buf, size_t len,
 JSValue JS_NewArrayBufferCopy(JSContext *ctx, const uint8_t *buf, size_t len);
 void JS_DetachArrayBuffer(JSContext *ctx, JSValueConst obj);
 uint8_t *JS_GetArrayBuffer(JSContext *ctx, size_t *psize, JSValueConst obj);
+uint8_t *JS_GetArrayBufferInfo(JSContext *ctx, size_t *psize,
+                               JSFreeArrayBufferDataFunc **pfree_func,
+                               void **popaque, JSValueConst obj);
 JSValue JS_GetTypedArrayBuffer(JSContext *ctx, JSValueConst obj,
                                size_t *pbyte_offset,
                                size_t *pbyte_length,
                                size_t *pbytes_per_element);
+/* 'new <class>(buffer, byte_offset, length)' with the builtin constructor
+   of the typed array class 'class_id', even if the global was replaced */
+JSValue JS_NewTypedArrayOfClass(JSContext *ctx, JSClassID class_id,
+                                JSValueConst buffer, uint64_t byte_offset,
+                                uint64_t length);
 typedef struct {
     void *(*sab_alloc)(void *opaque, size_t size);
     void (*sab_free)(void *opaque, void *ptr);
@@ -860,6 +914,15 @@ typedef struct {
 } JSSharedArrayBufferFunctions;
 void JS_SetSharedArrayBufferFunctions(JSRuntime *rt,
                                       const JSSharedArrayBufferFunctions *sf);
+/* allocator of the data of the ArrayBuffers created by the engine, the
+   default is js_mallocz, counted in the memory usage of the runtime */
+typedef struct {
+    void *(*ab_alloc)(void *opaque, size_t size);
+    JSFreeArrayBufferDataFunc *ab_free;
+    void *ab_opaque;
+} JSArrayBufferFunctions;
+void JS_SetArrayBufferFunctions(JSRuntime *rt,
+                                const JSArrayBufferFunctions *af);
 
 JSValue JS_NewPromiseCapability(JSContext *ctx, JSValue *resolving_funcs);
 
@@ -902,6 +965,7 @@ typedef JSValue JSJobFunc(JSContext *ctx, int argc, JSValueConst *argv);
 int JS_EnqueueJob(JSContext *ctx, JSJobFunc *job_func, int argc, JSValueConst *argv);
 
 JS_BOOL JS_IsJobPending(JSRuntime *rt);
+void JS_ClearPendingJobs(JSRuntime *rt);
 int JS_ExecutePendingJob(JSRuntime *rt, JSContext **pctx);
 
 /* Object Writer/Reader (currently only used to handle precompiled code) */
@@ -928,6 +992,12 @@ JSValue JS_EvalFunction(JSContext *ctx, JSValue fun_obj);
 /* load the dependencies of the module 'obj'. Useful when JS_ReadObject()
    returns a module. */
 int JS_ResolveModule(JSContext *ctx, JSValueConst obj);
+/* free a module compiled with JS_EVAL_FLAG_COMPILE_ONLY |
+   JS_EVAL_FLAG_NO_RESOLVE and remove it from the loaded modules, so
+   that a later import loads it again */
+void JS_FreeUnresolvedModule(JSContext *ctx, JSValue obj);
+/* return the loaded module named 'name' or NULL */
+JSModuleDef *JS_FindLoadedModule(JSContext *ctx, const char *name);
 
 /* only exported for os.Worker() */
 JSAtom JS_GetScriptOrModuleName(JSContext *ctx, int n_stack_levels);